@@ -0,0 +1,101 @@
+#include "stdafx.h"
+#include "AllocationCounter.h"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+static std::atomic<uint64_t> allocations(0);
+static std::atomic<uint64_t> bytes(0);
+
+static void Count(const size_t size)
+{
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	bytes.fetch_add(size, std::memory_order_relaxed);
+}
+
+namespace
+{
+	// Forwards to OpenCV's standard allocator, the returned UMatData is released by it as usual
+	class CountingMatAllocator : public cv::MatAllocator
+	{
+	public:
+		cv::UMatData* allocate(const int dims, const int* sizes, const int type, void* data, size_t* step,
+			const int flags, const cv::UMatUsageFlags usageFlags) const override
+		{
+			if (!data)
+			{
+				size_t total = CV_ELEM_SIZE(type);
+				for (auto i = 0; i < dims; i++) total *= sizes[i];
+				Count(total);
+			}
+
+			return cv::Mat::getStdAllocator()->allocate(dims, sizes, type, data, step, flags, usageFlags);
+		}
+
+		bool allocate(cv::UMatData* data, const int accessFlags, const cv::UMatUsageFlags usageFlags) const override
+		{
+			return cv::Mat::getStdAllocator()->allocate(data, accessFlags, usageFlags);
+		}
+
+		void deallocate(cv::UMatData* data) const override
+		{
+			cv::Mat::getStdAllocator()->deallocate(data);
+		}
+	};
+}
+
+AllocationCounter::Snapshot AllocationCounter::Now()
+{
+	return Snapshot{ allocations.load(std::memory_order_relaxed), bytes.load(std::memory_order_relaxed) };
+}
+
+void AllocationCounter::Install()
+{
+	static CountingMatAllocator allocator;
+
+	cv::Mat::setDefaultAllocator(&allocator);
+}
+
+void* operator new(const size_t size)
+{
+	Count(size);
+	if (auto p = malloc(size ? size : 1)) return p;
+
+	throw std::bad_alloc();
+}
+
+void* operator new[](const size_t size)
+{
+	return operator new(size);
+}
+
+void* operator new(const size_t size, const std::nothrow_t&) noexcept
+{
+	Count(size);
+	return malloc(size ? size : 1);
+}
+
+void* operator new[](const size_t size, const std::nothrow_t& tag) noexcept
+{
+	return operator new(size, tag);
+}
+
+void operator delete(void* p) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+	free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+	free(p);
+}
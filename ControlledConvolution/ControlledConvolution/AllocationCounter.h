@@ -0,0 +1,32 @@
+#pragma once
+#ifndef ALLOCATION_COUNTER_H
+#define ALLOCATION_COUNTER_H
+#include <cstdint>
+
+/*
+ * Process wide count of heap allocations: operator new (global replacement in AllocationCounter.cpp)
+ * and, once Install() ran, cv::Mat buffers created through the default Mat allocator.
+ * Take a Snapshot before and after a piece of work and subtract them to see how many heap
+ * allocations it made.
+ */
+class AllocationCounter
+{
+public:
+	struct Snapshot
+	{
+		uint64_t allocations;
+		uint64_t bytes;
+
+		Snapshot operator-(const Snapshot& before) const
+		{
+			return Snapshot{ allocations - before.allocations, bytes - before.bytes };
+		}
+	};
+
+	static Snapshot Now();
+	/// <summary>
+	/// Routes cv::Mat allocations through a counting allocator. Call once at start up.
+	/// </summary>
+	static void Install();
+};
+#endif
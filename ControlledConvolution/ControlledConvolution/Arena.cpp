@@ -0,0 +1,74 @@
+#include "stdafx.h"
+#include "Arena.h"
+
+Arena::Arena(const size_t blockSize) : block_size_(blockSize), block_(0), offset_(0), used_(0), peak_(0), scopes_(0)
+{
+}
+
+void* Arena::Allocate(const size_t bytes, const size_t alignment)
+{
+	for (;;)
+	{
+		if (block_ < blocks_.size())
+		{
+			const auto base = reinterpret_cast<uintptr_t>(blocks_[block_].get());
+			const auto aligned = (base + offset_ + alignment - 1) & ~(static_cast<uintptr_t>(alignment) - 1);
+			const auto end = aligned - base + bytes;
+
+			if (end <= sizes_[block_])
+			{
+				used_ += end - offset_;
+				peak_ = (std::max)(peak_, used_);
+				offset_ = end;
+				return reinterpret_cast<void*>(aligned);
+			}
+
+			//Doesn't fit, continue in the next block
+			block_++;
+			offset_ = 0;
+			if (block_ < blocks_.size() && sizes_[block_] >= bytes + alignment) continue;
+		}
+
+		//Grow: blocks after this one stay available for later samples
+		const auto size = (std::max)(block_size_, bytes + alignment);
+		blocks_.emplace(blocks_.begin() + block_, new char[size]);
+		sizes_.insert(sizes_.begin() + block_, size);
+		offset_ = 0;
+	}
+}
+
+cv::Mat Arena::Mat(const int rows, const int cols, const int type)
+{
+	const auto bytes = static_cast<size_t>(rows) * cols * CV_ELEM_SIZE(type);
+
+	return cv::Mat(rows, cols, type, Allocate(bytes));
+}
+
+void Arena::Rewind(const Marker& marker)
+{
+	block_ = marker.block;
+	offset_ = marker.offset;
+	used_ = marker.used;
+}
+
+size_t Arena::Reserved() const
+{
+	size_t reserved = 0;
+	for (const auto size : sizes_) reserved += size;
+
+	return reserved;
+}
+
+Arena& Arena::ForThread()
+{
+	thread_local Arena arena;
+
+	return arena;
+}
+
+Arena* Arena::Active()
+{
+	auto& arena = ForThread();
+
+	return arena.scopes_ > 0 ? &arena : nullptr;
+}
@@ -0,0 +1,110 @@
+#pragma once
+#ifndef ARENA_H
+#define ARENA_H
+#include <opencv2/core.hpp>
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+/*
+ * Bump allocator for the temporaries of one sample (patch copies, histograms, SSIM maps,
+ * joint histograms). Allocation is a pointer bump in the current block; memory is never freed
+ * individually, the whole arena is rewound in O(1) once the sample is done and its blocks are
+ * reused by the next one.
+ *
+ * Every thread has its own arena (ForThread). Code only draws from it while an ArenaScope is
+ * open on the thread (Active), so callers that don't open one keep using the heap.
+ * Mats returned by Mat() don't own their data: they must not outlive the scope.
+ */
+class Arena
+{
+public:
+	static const size_t DEFAULT_BLOCK_SIZE = 4 << 20;
+	static const size_t ALIGNMENT = 64;
+
+	struct Marker
+	{
+		size_t block;
+		size_t offset;
+		size_t used;
+	};
+
+	explicit Arena(size_t blockSize = DEFAULT_BLOCK_SIZE);
+	Arena(const Arena&) = delete;
+	Arena& operator=(const Arena&) = delete;
+
+	void* Allocate(size_t bytes, size_t alignment = ALIGNMENT);
+
+	template <typename T>
+	T* Allocate(const size_t count)
+	{
+		return static_cast<T*>(Allocate(count * sizeof(T), (std::max)(alignof(T), ALIGNMENT)));
+	}
+
+	/// <summary>
+	/// Continuous Mat over arena memory, contents are uninitialized.
+	/// </summary>
+	cv::Mat Mat(int rows, int cols, int type);
+
+	Marker Mark() const { return Marker{ block_, offset_, used_ }; }
+	void Rewind(const Marker& marker);
+	void Reset() { Rewind(Marker{ 0, 0, 0 }); }
+
+	size_t Used() const { return used_; }
+	size_t Peak() const { return peak_; }
+	size_t Reserved() const;
+
+	static Arena& ForThread();
+	/// <summary>
+	/// The thread's arena while an ArenaScope is open on it, nullptr otherwise.
+	/// </summary>
+	static Arena* Active();
+
+private:
+	friend class ArenaScope;
+
+	std::vector<std::unique_ptr<char[]>> blocks_;
+	std::vector<size_t> sizes_;
+	size_t block_size_;
+	size_t block_;
+	size_t offset_;
+	size_t used_;
+	size_t peak_;
+	int scopes_;
+};
+
+/// <summary>
+/// Opens the thread's arena for the lifetime of the scope and rewinds it to where it was on exit.
+/// Declare it before the Sample whose temporaries it holds, so the sample is destroyed first.
+/// </summary>
+class ArenaScope
+{
+public:
+	ArenaScope() : arena_(Arena::ForThread()), marker_(arena_.Mark()) { arena_.scopes_++; }
+	~ArenaScope()
+	{
+		arena_.scopes_--;
+		arena_.Rewind(marker_);
+	}
+
+	ArenaScope(const ArenaScope&) = delete;
+	ArenaScope& operator=(const ArenaScope&) = delete;
+
+	Arena& Get() const { return arena_; }
+
+private:
+	Arena& arena_;
+	Arena::Marker marker_;
+};
+
+/// <summary>
+/// Temporary Mat from the active arena, or from the heap when no ArenaScope is open.
+/// </summary>
+inline cv::Mat ScratchMat(const int rows, const int cols, const int type)
+{
+	const auto arena = Arena::Active();
+
+	return arena ? arena->Mat(rows, cols, type) : cv::Mat(rows, cols, type);
+}
+#endif
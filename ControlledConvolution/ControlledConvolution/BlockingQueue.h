@@ -0,0 +1,63 @@
+#pragma once
+#ifndef BLOCKING_QUEUE_H
+#define BLOCKING_QUEUE_H
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+/*
+ * Bounded FIFO shared by the stages of a pipeline. Push blocks while the queue is full and
+ * Pop blocks while it is empty; once closed, Pop drains the remaining items and then fails.
+ */
+template <typename T>
+class BlockingQueue
+{
+public:
+	explicit BlockingQueue(const size_t capacity) : capacity_(capacity), closed_(false)
+	{
+	}
+
+	bool Push(T item)
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		not_full_.wait(lock, [this] { return closed_ || items_.size() < capacity_; });
+
+		if (closed_) return false;
+
+		items_.push_back(std::move(item));
+		not_empty_.notify_one();
+
+		return true;
+	}
+
+	bool Pop(T& item)
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		not_empty_.wait(lock, [this] { return closed_ || !items_.empty(); });
+
+		if (items_.empty()) return false;
+
+		item = std::move(items_.front());
+		items_.pop_front();
+		not_full_.notify_one();
+
+		return true;
+	}
+
+	void Close()
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		closed_ = true;
+		not_empty_.notify_all();
+		not_full_.notify_all();
+	}
+
+private:
+	size_t capacity_;
+	bool closed_;
+	std::deque<T> items_;
+	std::mutex mutex_;
+	std::condition_variable not_empty_;
+	std::condition_variable not_full_;
+};
+#endif
@@ -0,0 +1,178 @@
+#include "stdafx.h"
+#include "ClassScheduler.h"
+#include "por.h"
+#include "Arena.h"
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <mutex>
+
+namespace
+{
+	typedef std::chrono::steady_clock Clock;
+
+	double Seconds(const Clock::duration& d)
+	{
+		return std::chrono::duration<double>(d).count();
+	}
+}
+
+ClassScheduler::ClassScheduler(const ClassRunOptions& options, ThreadPool& pool) : options_(options), pool_(pool)
+{
+}
+
+vector<std::pair<std::string, vector<std::string>>> ClassScheduler::ListClasses(const std::string& root)
+{
+	vector<std::pair<std::string, vector<std::string>>> classes;
+
+	for (auto& entry : fs::directory_iterator(fs::path(root)))
+	{
+		if (!fs::is_directory(entry.status())) continue;
+
+		vector<std::string> samples;
+		for (auto& file : fs::directory_iterator(entry.path()))
+		{
+			if (fs::is_regular_file(file.status())) samples.push_back(file.path().string());
+		}
+
+		std::sort(samples.begin(), samples.end());
+		classes.emplace_back(entry.path().filename().string(), std::move(samples));
+	}
+
+	std::sort(classes.begin(), classes.end(),
+		[](const std::pair<std::string, vector<std::string>>& a, const std::pair<std::string, vector<std::string>>& b)
+	{
+		return a.first < b.first;
+	});
+
+	return classes;
+}
+
+bool ClassScheduler::Process(const std::string& sample, const std::string& outputDir, Semaphore& io) const
+{
+	cv::Mat image;
+	{
+		Semaphore::Slot slot(io);
+		image = cv::imread(sample, IMREAD_COLOR);
+	}
+
+	if (image.empty())
+	{
+		cerr << "Unable to read image from file, file: " << sample << endl;
+		return false;
+	}
+
+	//Patches live in the worker's arena until they are on disc
+	ArenaScope arena;
+	Sample s(sample);
+	s.FromMat(image, options_.inputSize, options_.roundUp);
+
+	Permutation permutation;
+	if (!por::OrderSample(s, options_.patchSize, options_.measure, options_.order, options_.sortType, permutation))
+	{
+		cerr << "SortPatches failed, unable to save sorted patches of " << sample << endl;
+		return false;
+	}
+
+	auto patches = s.Permute(permutation);
+	if (options_.pixelSort)
+	{
+		const auto pixelOrder = options_.order == Order::decreasing ? Order::decreasing : Order::increasing;
+		//In place: every patch owns a distinct region and only the sorted patches are saved
+		for (auto& p : patches)
+		{
+			auto m = p.GetMat();
+			if (options_.pixelSortRows) PixelSort::SortRows(m, options_.pixelKey, pixelOrder);
+			else PixelSort::SortRegion(m, options_.pixelKey, pixelOrder);
+		}
+	}
+	s.SetSortedSamplePatches(patches);
+
+	const auto sampleDir = outputDir + "\\" + s.BaseName();
+	Semaphore::Slot slot(io);
+	fs::create_directories(fs::path(sampleDir));
+	s.SaveToDisc(sampleDir, options_.format);
+
+	return true;
+}
+
+vector<ClassThroughput> ClassScheduler::Run(const std::string& root, const std::string& outputRoot)
+{
+	const auto classes = ListClasses(root);
+	vector<ClassThroughput> throughput(classes.size());
+
+	// class major, the pool works on one or two classes at a time
+	vector<std::pair<size_t, size_t>> jobs;
+	for (size_t c = 0; c < classes.size(); c++)
+	{
+		throughput[c].name = classes[c].first;
+		fs::create_directories(fs::path(outputRoot + "\\" + classes[c].first));
+		for (size_t i = 0; i < classes[c].second.size(); i++) jobs.emplace_back(c, i);
+	}
+
+	vector<Clock::time_point> first(classes.size(), Clock::time_point::max());
+	vector<Clock::time_point> last(classes.size(), Clock::time_point::min());
+	vector<size_t> remaining(classes.size());
+	for (size_t c = 0; c < classes.size(); c++) remaining[c] = classes[c].second.size();
+
+	Semaphore io(options_.ioLimit);
+	std::mutex mutex;
+
+	pool_.ParallelFor(0, jobs.size(), [&](const size_t j)
+	{
+		const auto c = jobs[j].first;
+		const auto& sample = classes[c].second[jobs[j].second];
+		const auto start = Clock::now();
+
+		auto ok = false;
+		try
+		{
+			ok = Process(sample, outputRoot + "\\" + classes[c].first, io);
+		}
+		catch (const std::exception& e)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			cerr << "Failed to process " << sample << ": " << e.what() << endl;
+		}
+
+		const auto end = Clock::now();
+		std::lock_guard<std::mutex> lock(mutex);
+		auto& t = throughput[c];
+		if (ok) t.samples++;
+		else t.failed++;
+		t.sampleSeconds += Seconds(end - start);
+		first[c] = (std::min)(first[c], start);
+		last[c] = (std::max)(last[c], end);
+
+		if (--remaining[c] == 0)
+		{
+			t.wallSeconds = Seconds(last[c] - first[c]);
+			cout << "Class " << t.name << " done, " << t.samples << " samples in " << t.wallSeconds << " sec.\n";
+		}
+	});
+
+	return throughput;
+}
+
+void ClassScheduler::Report(ostream& out, const vector<ClassThroughput>& classes)
+{
+	size_t samples = 0, failed = 0;
+
+	out << "\nPer class throughput:\n";
+	out << std::left << std::setw(24) << "\tClass" << std::right << std::setw(10) << "Samples" << std::setw(8) << "Failed"
+		<< std::setw(12) << "Wall (s)" << std::setw(12) << "Samples/s" << std::setw(14) << "ms/sample" << endl;
+
+	for (const auto& c : classes)
+	{
+		const auto attempted = c.samples + c.failed;
+		out << std::left << std::setw(24) << "\t" + c.name << std::right << std::setw(10) << c.samples << std::setw(8) << c.failed
+			<< std::setw(12) << std::fixed << std::setprecision(2) << c.wallSeconds << std::setw(12) << c.SamplesPerSecond()
+			<< std::setw(14) << (attempted > 0 ? 1000.0 * c.sampleSeconds / attempted : 0.0) << endl;
+
+		samples += c.samples;
+		failed += c.failed;
+	}
+
+	out.unsetf(std::ios::fixed);
+	out << std::setprecision(6) << "\tTotal: " << samples << " samples, " << failed << " failed, " << classes.size() << " classes.\n";
+}
@@ -0,0 +1,72 @@
+#pragma once
+#ifndef CLASS_SCHEDULER_H
+#define CLASS_SCHEDULER_H
+#include "stdafx.h"
+#include "Reconstructor.h"
+#include "PixelSort.h"
+#include "ThreadPool.h"
+#include "Semaphore.h"
+#include <cstdint>
+
+/*
+ * Per class processing of a dataset root (ccMain --per_class).
+ *
+ * Every subdirectory of the root is a class. The samples of all classes are ordered on one
+ * shared pool, class after class, and the patches of a sample are written to
+ *   <outputRoot>\<class>\<sample>
+ * Reading a sample and writing its patches hold one of ioLimit permits, so the workers don't
+ * all hit the disc at once while the others keep computing orderings.
+ */
+struct ClassRunOptions
+{
+	cv::Size inputSize;
+	bool roundUp;
+	cv::Size patchSize;
+	MeasureType measure;
+	Order order;
+	SemiRandomSortType sortType;
+	std::string format;
+	size_t ioLimit;
+	bool pixelSort;
+	PixelSortKey pixelKey;
+	bool pixelSortRows;
+};
+
+struct ClassThroughput
+{
+	std::string name;
+	size_t samples = 0;
+	size_t failed = 0;
+	// first read to last write of the class
+	double wallSeconds = 0;
+	// sum of the per sample times, io waits included
+	double sampleSeconds = 0;
+
+	double SamplesPerSecond() const { return wallSeconds > 0 ? samples / wallSeconds : 0.0; }
+};
+
+class ClassScheduler
+{
+public:
+	ClassScheduler(const ClassRunOptions& options, ThreadPool& pool);
+
+	/// <summary>
+	/// Lists the class subdirectories of root and their samples, sorted by name.
+	/// </summary>
+	static vector<std::pair<std::string, vector<std::string>>> ListClasses(const std::string& root);
+
+	/// <summary>
+	/// Orders and saves every sample of every class of root under outputRoot.
+	/// </summary>
+	/// <returns>throughput of every class, in ListClasses order.</returns>
+	vector<ClassThroughput> Run(const std::string& root, const std::string& outputRoot);
+
+	static void Report(ostream& out, const vector<ClassThroughput>& classes);
+
+private:
+	bool Process(const std::string& sample, const std::string& outputDir, Semaphore& io) const;
+
+	ClassRunOptions options_;
+	ThreadPool& pool_;
+};
+#endif
@@ -15,7 +15,8 @@ string Common::GeneratePatchName(const Coordinate& c)
 	/*
 	 * A Patch name is its (x0,y0)_(x1,y1)
 	 */
-	return GeneratePatchName(c.Start()[0], c.Start()[1], c.End()[0], c.End()[1]);
+	const auto rect = c.ToRect();
+	return GeneratePatchName(rect.start.x, rect.start.y, rect.end.x, rect.end.y);
 }
 
 bool Common::IsSquareImage(const Mat& mat)
@@ -347,6 +348,32 @@ void Common::SaveImage(const Mat& mat, const string& filename, const string& for
 	imwrite(outputFile, mat);
 }
 
+bool Common::ToMeasureType(const string& measure, MeasureType& mt)
+{
+	if (measure == "l1Norm" || measure == "l1norm") mt = MeasureType::l1Norm;
+	else if (measure == "l2norm" || measure == "l2Norm") mt = MeasureType::l2Norm;
+	else if (measure == "hamming" || measure == "hamming") mt = MeasureType::hammingNorm;
+	else if (measure == "c0e" || measure == "channel0_entropy") mt = MeasureType::channel0Entropy;
+	else if (measure == "c1e" || measure == "channel1_entropy") mt = MeasureType::channel1Entropy;
+	else if (measure == "c2e" || measure == "channel2_entropy") mt = MeasureType::channel2Entropy;
+	else if (measure == "ae" || measure == "average_entropy") mt = MeasureType::averageEntropy;
+	else if (measure == "psnr" || measure == "Psnr") mt = MeasureType::psnr;
+	else if (measure == "ssim" || measure == "ssim_average") mt = MeasureType::ssimAverage;
+	else if (measure == "ssim0" || measure == "channel0_ssim") mt = MeasureType::ssim0;
+	else if (measure == "ssim1" || measure == "channel1_ssim") mt = MeasureType::ssim1;
+	else if (measure == "ssim2" || measure == "channel2_ssim") mt = MeasureType::ssim2;
+	else if (measure == "mi" || measure == "mutual_information") mt = MeasureType::mi;
+	else if (measure == "je" || measure == "joint_entropy") mt = MeasureType::je;
+	else if (measure == "ce" || measure == "conditional_entropy") mt = MeasureType::ce;
+	else if (measure == "kl" || measure == "k-l") mt = MeasureType::kl;
+	else if (measure == "ge" || measure == "gradient_energy") mt = MeasureType::gradientEnergy;
+	else if (measure == "oh" || measure == "orientation_histogram") mt = MeasureType::orientationHistogram;
+	else if (measure == "do" || measure == "dominant_orientation") mt = MeasureType::dominantOrientation;
+	else return false;
+
+	return true;
+}
+
 SemiRandomSortType Common::ToCustomType(const MeasureType &mt)
 {
 	const string message = "Measure type contains no custom sort order\n";
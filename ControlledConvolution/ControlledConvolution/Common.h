@@ -39,6 +39,7 @@ public:
 	static bool GreaterThan(const float u, const float v) { return u > v; }
 	static bool GreaterThan(const int u, const int v) { return u > v; }
 	static SemiRandomSortType ToCustomType(const MeasureType &mt);
+	static bool ToMeasureType(const std::string& measure, MeasureType& mt);
 
 	static inline vector<string> GetSampleSet(const std::string dirPath)
 	{
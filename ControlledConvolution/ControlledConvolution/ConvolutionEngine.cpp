@@ -0,0 +1,1213 @@
+#include "stdafx.h"
+#include "ConvolutionEngine.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <limits>
+#include <type_traits>
+#include <vector>
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CONVOLUTION_X86 1
+#ifdef _MSC_VER
+#include <intrin.h>
+#define AVX2_TARGET
+#else
+#define AVX2_TARGET __attribute__((target("avx2")))
+#endif
+#endif
+
+// half the int32 range, room for the rounding and the bias correction of the fixed point sums
+static const double FIXED_POINT_BUDGET = 1073741824.0;
+static const int FIXED_POINT_MAX_SHIFT = 30;
+// largest int16 horizontal sum of the separable fixed point convolution
+static const int INTERMEDIATE_MAX = 32767;
+
+namespace
+{
+	// output conversion, one overload per policy
+	template <typename T, typename Acc>
+	inline T Convert(const Acc sum, AbsRound)
+	{
+		const auto v = static_cast<Acc>(fabs(sum)) + static_cast<Acc>(0.5);
+		return v >= static_cast<Acc>((std::numeric_limits<T>::max)()) ? (std::numeric_limits<T>::max)() : static_cast<T>(v);
+	}
+
+	template <typename T, typename Acc>
+	inline T Convert(const Acc sum, Round)
+	{
+		const auto v = sum >= 0 ? sum + static_cast<Acc>(0.5) : sum - static_cast<Acc>(0.5);
+		if (v >= static_cast<Acc>((std::numeric_limits<T>::max)())) return (std::numeric_limits<T>::max)();
+		if (v <= static_cast<Acc>((std::numeric_limits<T>::min)())) return (std::numeric_limits<T>::min)();
+		return static_cast<T>(v);
+	}
+
+	template <typename T, typename Acc>
+	inline T Convert(const Acc sum, NoSaturation)
+	{
+		return static_cast<T>(sum);
+	}
+
+	// pixels of a row into the accumulator type
+	template <typename T, typename Acc>
+	inline void Load(const T* src, Acc* dst, const int n)
+	{
+		for (auto x = 0; x < n; ++x) dst[x] = static_cast<Acc>(src[x]);
+	}
+
+	template <typename Acc>
+	inline void Load(const Acc* src, Acc* dst, const int n)
+	{
+		std::copy(src, src + n, dst);
+	}
+
+	// signature of the routines convolving the values [x0, x1) of one output row, rows points
+	// at the padded band row the kernel's first row reads. Channels are interleaved, so
+	// neighbouring taps are channels values apart and every value is an output of its own.
+	template <typename T, typename Acc>
+	using RowRoutine = void(*)(const Acc* rows, int stride, const Acc* taps, int kSizeX, int kSizeY, int channels,
+		int x0, int x1, T* out);
+
+	// y[0..n) += x[0..n) * w
+	template <typename Acc>
+	using AxpyRoutine = void(*)(Acc* y, const Acc* x, Acc w, int n);
+
+	template <typename T, typename Acc, typename Policy>
+	void Row2DScalar(const Acc* rows, const int stride, const Acc* taps, const int kSizeX, const int kSizeY,
+		const int channels, const int x0, const int x1, T* out)
+	{
+		for (auto x = x0; x < x1; ++x)
+		{
+			Acc sum = 0;
+			for (auto m = 0; m < kSizeY; ++m)
+			{
+				const auto r = rows + m * stride + x;
+				const auto w = taps + m * kSizeX;
+				for (auto n = 0; n < kSizeX; ++n)
+					sum += r[n * channels] * w[n];
+			}
+			out[x] = Convert<T>(sum, Policy());
+		}
+	}
+
+	template <typename Acc>
+	void AxpyScalar(Acc* y, const Acc* x, const Acc w, const int n)
+	{
+		for (auto j = 0; j < n; ++j)
+			y[j] += x[j] * w;
+	}
+
+#ifdef CONVOLUTION_X86
+	// the AVX2 registers of an accumulator type, multiply and add stay two instructions
+	template <typename Acc> struct Simd;
+
+	template <> struct Simd<float>
+	{
+		typedef __m256 V;
+		static const int WIDTH = 8;
+		static AVX2_TARGET V Zero() { return _mm256_setzero_ps(); }
+		static AVX2_TARGET V Set(const float* p) { return _mm256_broadcast_ss(p); }
+		static AVX2_TARGET V Load(const float* p) { return _mm256_loadu_ps(p); }
+		static AVX2_TARGET void Store(float* p, const V v) { _mm256_storeu_ps(p, v); }
+		static AVX2_TARGET V MulAdd(const V sum, const V a, const V b) { return _mm256_add_ps(sum, _mm256_mul_ps(a, b)); }
+	};
+
+	template <> struct Simd<double>
+	{
+		typedef __m256d V;
+		static const int WIDTH = 4;
+		static AVX2_TARGET V Zero() { return _mm256_setzero_pd(); }
+		static AVX2_TARGET V Set(const double* p) { return _mm256_broadcast_sd(p); }
+		static AVX2_TARGET V Load(const double* p) { return _mm256_loadu_pd(p); }
+		static AVX2_TARGET void Store(double* p, const V v) { _mm256_storeu_pd(p, v); }
+		static AVX2_TARGET V MulAdd(const V sum, const V a, const V b) { return _mm256_add_pd(sum, _mm256_mul_pd(a, b)); }
+	};
+
+	// converts and stores the lanes of a sum, specialized where a direct conversion exists
+	template <typename T, typename Acc, typename Policy>
+	struct LaneStore
+	{
+		static AVX2_TARGET void Store(const typename Simd<Acc>::V sum, T* out)
+		{
+			Acc lanes[Simd<Acc>::WIDTH];
+			Simd<Acc>::Store(lanes, sum);
+			for (auto i = 0; i < Simd<Acc>::WIDTH; ++i) out[i] = Convert<T>(lanes[i], Policy());
+		}
+	};
+
+	template <typename Acc>
+	struct LaneStore<Acc, Acc, NoSaturation>
+	{
+		static AVX2_TARGET void Store(const typename Simd<Acc>::V sum, Acc* out)
+		{
+			Simd<Acc>::Store(out, sum);
+		}
+	};
+
+	template <>
+	struct LaneStore<unsigned char, float, AbsRound>
+	{
+		static AVX2_TARGET void Store(const __m256 sum, unsigned char* out)
+		{
+			const auto magnitude = _mm256_andnot_ps(_mm256_set1_ps(-0.0f), sum);
+			const auto rounded = _mm256_min_ps(_mm256_add_ps(magnitude, _mm256_set1_ps(0.5f)), _mm256_set1_ps(255.0f));
+			const auto i32 = _mm256_cvttps_epi32(rounded);
+			const auto i16 = _mm_packus_epi32(_mm256_castsi256_si128(i32), _mm256_extracti128_si256(i32, 1));
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(out), _mm_packus_epi16(i16, i16));
+		}
+	};
+
+	// K > 0 is a KxK kernel with the taps broadcast once per row, K = 0 any size
+	template <int K, typename T, typename Acc, typename Policy>
+	AVX2_TARGET void Row2DAvx2(const Acc* rows, const int stride, const Acc* taps, const int kSizeX, const int kSizeY,
+		const int channels, const int x0, const int x1, T* out)
+	{
+		typedef Simd<Acc> S;
+		const auto sizeX = K > 0 ? K : kSizeX;
+		const auto sizeY = K > 0 ? K : kSizeY;
+		typename S::V weights[K > 0 ? K * K : 1];
+		if (K > 0)
+		{
+			for (auto t = 0; t < K * K; ++t) weights[t] = S::Set(taps + t);
+		}
+
+		auto x = x0;
+		for (; x + S::WIDTH <= x1; x += S::WIDTH)
+		{
+			auto sum = S::Zero();
+			for (auto m = 0; m < sizeY; ++m)
+			{
+				const auto r = rows + m * stride + x;
+				for (auto n = 0; n < sizeX; ++n)
+				{
+					const auto w = K > 0 ? weights[m * sizeX + n] : S::Set(taps + m * sizeX + n);
+					sum = S::MulAdd(sum, S::Load(r + n * channels), w);
+				}
+			}
+			LaneStore<T, Acc, Policy>::Store(sum, out + x);
+		}
+
+		Row2DScalar<T, Acc, Policy>(rows, stride, taps, kSizeX, kSizeY, channels, x, x1, out);
+	}
+
+	template <typename Acc>
+	AVX2_TARGET void AxpyAvx2(Acc* y, const Acc* x, const Acc w, const int n)
+	{
+		typedef Simd<Acc> S;
+		const auto weight = S::Set(&w);
+
+		auto j = 0;
+		for (; j + S::WIDTH <= n; j += S::WIDTH)
+			S::Store(y + j, S::MulAdd(S::Load(y + j), S::Load(x + j), weight));
+
+		AxpyScalar(y + j, x + j, w, n - j);
+	}
+#endif
+
+	template <typename T, typename Acc, typename Policy>
+	RowRoutine<T, Acc> SelectRow(const int kSizeX, const int kSizeY)
+	{
+#ifdef CONVOLUTION_X86
+		if (ConvolutionEngine::HasAvx2())
+		{
+			if (kSizeX == kSizeY)
+			{
+				switch (kSizeX)
+				{
+				case 3: return Row2DAvx2<3, T, Acc, Policy>;
+				case 5: return Row2DAvx2<5, T, Acc, Policy>;
+				case 7: return Row2DAvx2<7, T, Acc, Policy>;
+				default: break;
+				}
+			}
+			return Row2DAvx2<0, T, Acc, Policy>;
+		}
+#endif
+		return Row2DScalar<T, Acc, Policy>;
+	}
+
+	template <typename Acc>
+	AxpyRoutine<Acc> SelectAxpy()
+	{
+#ifdef CONVOLUTION_X86
+		if (ConvolutionEngine::HasAvx2()) return AxpyAvx2<Acc>;
+#endif
+		return AxpyScalar<Acc>;
+	}
+
+	// the runs of row y of the patch reordered image, copy(src, at, n) for each run of n values that
+	// goes to value at of the row; without a permutation the row is the image row
+	template <typename T>
+	struct PatchGather
+	{
+		const T* in;
+		int width;
+		int run;
+		int cellsX;
+		int patchSizeY;
+		const int* permutation;
+
+		template <typename Copy>
+		void operator()(const int y, const Copy& copy) const
+		{
+			if (!permutation)
+			{
+				copy(in + static_cast<size_t>(y) * width, 0, width);
+				return;
+			}
+
+			// a reordered row crosses one grid row of cells, one run per cell read from its source cell
+			const auto gridRow = y / patchSizeY;
+			const auto cellRow = y % patchSizeY;
+
+			for (auto c = 0; c < cellsX; ++c)
+			{
+				const auto source = permutation[gridRow * cellsX + c];
+				const auto src = in + static_cast<size_t>((source / cellsX) * patchSizeY + cellRow) * width
+					+ (source % cellsX) * run;
+
+				copy(src, c * run, run);
+			}
+		}
+	};
+
+	bool ValidPatches(const int sizeX, const int sizeY, const int patchSizeX, const int patchSizeY, const int* permutation)
+	{
+		if (patchSizeX <= 0 || patchSizeY <= 0 || sizeX % patchSizeX != 0 || sizeY % patchSizeY != 0) return false;
+
+		const auto cells = (sizeX / patchSizeX) * (sizeY / patchSizeY);
+		if (permutation)
+		{
+			for (auto i = 0; i < cells; ++i)
+				if (permutation[i] < 0 || permutation[i] >= cells) return false;
+		}
+
+		return true;
+	}
+
+	// separable convolution of the image gather reads, output rows [y0, y1)
+	template <typename T, typename Acc, typename Policy, typename Gather>
+	void SeparableBand(const Gather& gather, T* out, const int sizeX, const int sizeY, const int channels, const int y0,
+		const int y1, const Acc* xKernel, const int kSizeX, const Acc* yKernel, const int kSizeY, const AxpyRoutine<Acc> axpy)
+	{
+		// out[x] = sum of kernel[k] * in[x + kAfter - k] with kAfter = kSize - 1 - kCenter, so x reads
+		// kCenter pixels before it and kAfter pixels after it, as in Convolve2DSlow
+		const auto kCenterX = kSizeX >> 1;
+		const auto kCenterY = kSizeY >> 1;
+		const auto kAfterX = kSizeX - 1 - kCenterX;
+		const auto kAfterY = kSizeY - 1 - kCenterY;
+
+		// one row with a zero margin on both sides, the ring of filtered rows and the output row,
+		// all of them width values wide with the channels interleaved
+		const auto width = sizeX * channels;
+		thread_local std::vector<Acc> line, ring, sum;
+		line.assign((static_cast<size_t>(sizeX) + kSizeX - 1) * channels, Acc(0));
+		ring.resize(static_cast<size_t>(kSizeY) * width);
+		sum.resize(width);
+		const auto slot = [&](const int y) { return &ring[static_cast<size_t>(y % kSizeY) * width]; };
+
+		auto next = (std::max)(0, y0 - kCenterY);   // first row output row y0 reads
+		for (auto i = y0; i < y1; ++i)
+		{
+			// filter the rows output row i needs, up to i + kAfterY
+			for (; next < sizeY && next <= i + kAfterY; ++next)
+			{
+				gather(next, [&](const T* src, const int at, const int n) { Load(src, &line[kCenterX * channels + at], n); });
+
+				const auto center = &line[(kCenterX + kAfterX) * channels];
+				const auto filtered = slot(next);
+				std::fill(filtered, filtered + width, Acc(0));
+
+				for (auto k = kSizeX - 1; k >= 0; --k)
+					axpy(filtered, center - k * channels, xKernel[k], width);
+			}
+
+			// vertical, rows outside of the image don't contribute
+			std::fill(sum.begin(), sum.end(), Acc(0));
+			for (auto k = kSizeY - 1; k >= 0; --k)
+			{
+				const auto y = i + kAfterY - k;
+				if (y < 0 || y >= sizeY) continue;
+
+				axpy(sum.data(), slot(y), yKernel[k], width);
+			}
+
+			const auto outRow = out + static_cast<size_t>(i) * width;
+			for (auto j = 0; j < width; ++j) outRow[j] = Convert<T>(sum[j], Policy());
+		}
+	}
+
+	// a grid row of cells of the per patch convolution laid out as a block, the cells side by side
+	// in every block row, each in a segment with its border margins
+	struct PatchBlock
+	{
+		PatchBlock(const int sizeX, const int patchSizeX, const int patchSizeY, const int kSizeX, const int kSizeY,
+			const PatchBorder border, const int channels) : channels(channels), patchSizeX(patchSizeX),
+			patchSizeY(patchSizeY), cellsX(sizeX / patchSizeX), width(sizeX * channels)
+		{
+			const auto clamp = border == PatchBorder::clamp;
+			left = clamp ? kSizeX >> 1 : 0;
+			top = clamp ? kSizeY >> 1 : 0;
+			segment = (patchSizeX + (clamp ? kSizeX - 1 : 0)) * channels;
+			stride = cellsX * segment;
+			rows = patchSizeY + (clamp ? kSizeY - 1 : 0);
+			outX = ConvolutionEngine::PatchOutputSize(patchSizeX, kSizeX, border);
+			outY = ConvolutionEngine::PatchOutputSize(patchSizeY, kSizeY, border);
+			span = (cellsX - 1) * segment + outX * channels;
+		}
+
+		// the block of grid row gridRow, clamped margins repeat the cell's edge pixels
+		template <typename T, typename Acc>
+		void Gather(const T* in, Acc* block, const int gridRow) const
+		{
+			const auto run = patchSizeX * channels;
+			const auto right = segment - left * channels - run;
+
+			for (auto b = 0; b < rows; ++b)
+			{
+				const auto r = (std::min)(patchSizeY - 1, (std::max)(0, b - top));
+				const auto src = in + static_cast<size_t>(gridRow * patchSizeY + r) * width;
+				auto dst = block + static_cast<size_t>(b) * stride;
+
+				for (auto c = 0; c < cellsX; ++c, dst += segment)
+				{
+					const auto first = dst + left * channels;
+					const auto last = first + run - channels;
+					Load(src + c * run, first, run);
+
+					for (auto v = 0; v < left * channels; ++v) dst[v] = first[v % channels];
+					for (auto v = 0; v < right; ++v) last[channels + v] = last[v % channels];
+				}
+			}
+		}
+
+		// the cell responses of one block row into their places in the output row
+		template <typename T>
+		void Scatter(const T* response, T* out) const
+		{
+			for (auto c = 0; c < cellsX; ++c)
+				std::copy(response + c * segment, response + c * segment + outX * channels, out + c * outX * channels);
+		}
+
+		int channels;
+		int patchSizeX;
+		int patchSizeY;
+		int cellsX;
+		// values of an input row
+		int width;
+		// margins before a cell's first column and row
+		int left;
+		int top;
+		// values of a cell in a block row, and of a block row
+		int segment;
+		int stride;
+		int rows;
+		// response size of a cell
+		int outX;
+		int outY;
+		// values of a block row the row loops compute, up to the end of the last cell's response
+		int span;
+	};
+
+	// pixels of a row into int16, less the bias
+	template <typename T>
+	inline void LoadFixed(const T* src, int16_t* dst, const int n)
+	{
+		for (auto x = 0; x < n; ++x) dst[x] = static_cast<int16_t>(static_cast<int>(src[x]) - FixedPointTraits<T>::BIAS);
+	}
+
+	// two taps in the int32 lane of a 16 bit multiply-add, the first one low
+	inline int32_t TapPair(const int16_t first, const int16_t second)
+	{
+		return static_cast<int32_t>(static_cast<uint16_t>(first) | static_cast<uint32_t>(static_cast<uint16_t>(second)) << 16);
+	}
+
+	std::vector<int32_t> TapPairs(const std::vector<int16_t>& taps)
+	{
+		std::vector<int32_t> pairs(taps.size() / 2);
+		for (size_t p = 0; p < pairs.size(); p++) pairs[p] = TapPair(taps[2 * p], taps[2 * p + 1]);
+		return pairs;
+	}
+
+	// taps reversed and padded with a zero to an even count
+	std::vector<int16_t> Flip(const std::vector<int16_t>& taps)
+	{
+		std::vector<int16_t> flipped(taps.size() + (taps.size() & 1), 0);
+		std::reverse_copy(taps.begin(), taps.end(), flipped.begin());
+		return flipped;
+	}
+
+	double AbsSum(const FixedPointKernel& kernel)
+	{
+		double sum = 0;
+		for (const auto t : kernel.taps) sum += std::abs(static_cast<int>(t));
+		return sum;
+	}
+
+	// a horizontal sum rounded to int16, halves up, saturated
+	inline int16_t Narrow(const int32_t sum, const int shift)
+	{
+		const auto half = shift > 0 ? 1 << (shift - 1) : 0;
+		return static_cast<int16_t>((std::min)(32767, (std::max)(-32768, (sum + half) >> shift)));
+	}
+
+	// sum of taps[s] * sources[s][x] over count sources
+	inline int32_t FixedSum(const int16_t* const* sources, const int16_t* taps, const int count, const int x)
+	{
+		int32_t sum = 0;
+		for (auto s = 0; s < count; ++s) sum += sources[s][x] * taps[s];
+		return sum;
+	}
+
+	// signatures of the routines summing values [x0, x1) of count sources, count is even and pairs
+	// holds the taps packed by TapPair. Store routines convert (correction + sum) * scale, narrow
+	// routines round the sum to int16.
+	template <typename T>
+	using FixedStoreRoutine = void(*)(const int16_t* const* sources, const int16_t* taps, const int32_t* pairs,
+		int count, int32_t correction, float scale, int x0, int x1, T* out);
+
+	using FixedNarrowRoutine = void(*)(const int16_t* const* sources, const int16_t* taps, const int32_t* pairs,
+		int count, int shift, int x0, int x1, int16_t* out);
+
+	template <typename T, typename Policy>
+	void StoreFixedScalar(const int16_t* const* sources, const int16_t* taps, const int32_t*, const int count,
+		const int32_t correction, const float scale, const int x0, const int x1, T* out)
+	{
+		for (auto x = x0; x < x1; ++x)
+			out[x] = Convert<T>(static_cast<float>(correction + FixedSum(sources, taps, count, x)) * scale, Policy());
+	}
+
+	void NarrowFixedScalar(const int16_t* const* sources, const int16_t* taps, const int32_t*, const int count,
+		const int shift, const int x0, const int x1, int16_t* out)
+	{
+		for (auto x = x0; x < x1; ++x) out[x] = Narrow(FixedSum(sources, taps, count, x), shift);
+	}
+
+#ifdef CONVOLUTION_X86
+	// int32 sums of values [x, x + 16) from correction, one multiply-add per pair of sources; the
+	// pairs are interleaved within lanes, so lo gets values 0-3 and 8-11, hi values 4-7 and 12-15
+	AVX2_TARGET inline void FixedSum16(const int16_t* const* sources, const int32_t* pairs, const int count,
+		const int32_t correction, const int x, __m256i& lo, __m256i& hi)
+	{
+		lo = _mm256_set1_epi32(correction);
+		hi = lo;
+		for (auto p = 0; p < count / 2; ++p)
+		{
+			const auto a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(sources[2 * p] + x));
+			const auto b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(sources[2 * p + 1] + x));
+			const auto w = _mm256_set1_epi32(pairs[p]);
+			lo = _mm256_add_epi32(lo, _mm256_madd_epi16(_mm256_unpacklo_epi16(a, b), w));
+			hi = _mm256_add_epi32(hi, _mm256_madd_epi16(_mm256_unpackhi_epi16(a, b), w));
+		}
+	}
+
+	template <typename T, typename Policy>
+	AVX2_TARGET void StoreFixedAvx2(const int16_t* const* sources, const int16_t* taps, const int32_t* pairs,
+		const int count, const int32_t correction, const float scale, const int x0, const int x1, T* out)
+	{
+		const auto factor = _mm256_set1_ps(scale);
+
+		auto x = x0;
+		for (; x + 16 <= x1; x += 16)
+		{
+			__m256i lo, hi;
+			FixedSum16(sources, pairs, count, correction, x, lo, hi);
+			const auto low = _mm256_mul_ps(_mm256_cvtepi32_ps(lo), factor);
+			const auto high = _mm256_mul_ps(_mm256_cvtepi32_ps(hi), factor);
+			LaneStore<T, float, Policy>::Store(_mm256_permute2f128_ps(low, high, 0x20), out + x);
+			LaneStore<T, float, Policy>::Store(_mm256_permute2f128_ps(low, high, 0x31), out + x + 8);
+		}
+
+		StoreFixedScalar<T, Policy>(sources, taps, pairs, count, correction, scale, x, x1, out);
+	}
+
+	AVX2_TARGET void NarrowFixedAvx2(const int16_t* const* sources, const int16_t* taps, const int32_t* pairs,
+		const int count, const int shift, const int x0, const int x1, int16_t* out)
+	{
+		const auto half = _mm256_set1_epi32(shift > 0 ? 1 << (shift - 1) : 0);
+		const auto bits = _mm_cvtsi32_si128(shift);
+
+		auto x = x0;
+		for (; x + 16 <= x1; x += 16)
+		{
+			__m256i lo, hi;
+			FixedSum16(sources, pairs, count, 0, x, lo, hi);
+			lo = _mm256_sra_epi32(_mm256_add_epi32(lo, half), bits);
+			hi = _mm256_sra_epi32(_mm256_add_epi32(hi, half), bits);
+			// saturates as Narrow does, and packing within lanes undoes the interleaving
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + x), _mm256_packs_epi32(lo, hi));
+		}
+
+		NarrowFixedScalar(sources, taps, pairs, count, shift, x, x1, out);
+	}
+#endif
+
+	template <typename T, typename Policy>
+	FixedStoreRoutine<T> SelectFixedStore()
+	{
+#ifdef CONVOLUTION_X86
+		if (ConvolutionEngine::HasAvx2()) return StoreFixedAvx2<T, Policy>;
+#endif
+		return StoreFixedScalar<T, Policy>;
+	}
+
+	FixedNarrowRoutine SelectFixedNarrow()
+	{
+#ifdef CONVOLUTION_X86
+		if (ConvolutionEngine::HasAvx2()) return NarrowFixedAvx2;
+#endif
+		return NarrowFixedScalar;
+	}
+
+	// separable fixed point taps, flipped and padded to an even count
+	struct SeparableTaps
+	{
+		std::vector<int16_t> xTaps;
+		std::vector<int16_t> yTaps;
+		std::vector<int32_t> xPairs;
+		std::vector<int32_t> yPairs;
+		int kSizeX;
+		int kSizeY;
+		// right shift of the horizontal sums
+		int shift;
+		// horizontal sum of a row outside of the image, a row of pixels at -bias
+		int16_t outside;
+		// brings the vertical sums of rows less outside back to the sums of the pixels
+		int32_t correction;
+		float scale;
+	};
+
+	// SeparableBand on int16 rows: the horizontal sums are narrowed into the ring, the vertical
+	// sums stored
+	template <typename T, typename Gather>
+	void SeparableFixedBand(const Gather& gather, T* out, const int sizeX, const int sizeY, const int channels,
+		const int y0, const int y1, const SeparableTaps& k, const FixedNarrowRoutine narrow, const FixedStoreRoutine<T> store)
+	{
+		const auto kCenterX = k.kSizeX >> 1;
+		const auto kCenterY = k.kSizeY >> 1;
+		const auto kAfterY = k.kSizeY - 1 - kCenterY;
+		const auto xCount = static_cast<int>(k.xTaps.size());
+		const auto yCount = static_cast<int>(k.yTaps.size());
+
+		const auto width = sizeX * channels;
+		thread_local std::vector<int16_t> line, ring, outside;
+		thread_local std::vector<const int16_t*> sources;
+		line.assign((static_cast<size_t>(sizeX) + xCount - 1) * channels, static_cast<int16_t>(-FixedPointTraits<T>::BIAS));
+		ring.resize(static_cast<size_t>(k.kSizeY) * width);
+		outside.assign(width, k.outside);
+		sources.resize((std::max)(xCount, yCount));
+		const auto slot = [&](const int y) { return &ring[static_cast<size_t>(y % k.kSizeY) * width]; };
+
+		auto next = (std::max)(0, y0 - kCenterY);
+		for (auto i = y0; i < y1; ++i)
+		{
+			for (; next < sizeY && next <= i + kAfterY; ++next)
+			{
+				gather(next, [&](const T* src, const int at, const int n) { LoadFixed(src, &line[kCenterX * channels + at], n); });
+
+				for (auto n = 0; n < xCount; ++n) sources[n] = &line[static_cast<size_t>(n) * channels];
+				narrow(sources.data(), k.xTaps.data(), k.xPairs.data(), xCount, k.shift, 0, width, slot(next));
+			}
+
+			for (auto m = 0; m < yCount; ++m)
+			{
+				const auto y = i - kCenterY + m;
+				sources[m] = m < k.kSizeY && y >= 0 && y < sizeY ? slot(y) : outside.data();
+			}
+
+			store(sources.data(), k.yTaps.data(), k.yPairs.data(), yCount, k.correction, k.scale, 0, width,
+				out + static_cast<size_t>(i) * width);
+		}
+	}
+
+	// the float kernel routines in fixed point mode, for the pixel types that have it
+	template <typename T, typename Acc, typename Policy>
+	bool QuantizedConvolve2D(const ConvolutionEngine& engine, const T* in, T* out, const int sizeX, const int sizeY,
+		const Acc* kernel, const int kSizeX, const int kSizeY, const int channels, std::true_type)
+	{
+		return engine.Convolve2DFixed<T, Policy>(in, out, sizeX, sizeY,
+			FixedPointKernel::Quantize(kernel, kSizeX, kSizeY, FixedPointTraits<T>::MAX_ABS), channels);
+	}
+
+	template <typename T, typename Acc, typename Policy>
+	bool QuantizedConvolve2D(const ConvolutionEngine&, const T*, T*, int, int, const Acc*, int, int, int, std::false_type)
+	{
+		return false;
+	}
+
+	template <typename T, typename Acc, typename Policy>
+	bool QuantizedSeparable(const ConvolutionEngine& engine, const T* in, T* out, const int sizeX, const int sizeY,
+		const int patchSizeX, const int patchSizeY, const int* permutation, const Acc* xKernel, const int kSizeX,
+		const Acc* yKernel, const int kSizeY, const int channels, std::true_type)
+	{
+		// the vertical pass sums int16 horizontal sums
+		return engine.ControlledConvolve2DSeparableFixed<T, Policy>(in, out, sizeX, sizeY, patchSizeX, patchSizeY, permutation,
+			FixedPointKernel::Quantize(xKernel, kSizeX, 1, FixedPointTraits<T>::MAX_ABS),
+			FixedPointKernel::Quantize(yKernel, 1, kSizeY, ConvolutionEngine::INTERMEDIATE_MAX_ABS), channels);
+	}
+
+	template <typename T, typename Acc, typename Policy>
+	bool QuantizedSeparable(const ConvolutionEngine&, const T*, T*, int, int, int, int, const int*, const Acc*, int,
+		const Acc*, int, int, std::false_type)
+	{
+		return false;
+	}
+}
+
+namespace
+{
+	template <typename K>
+	FixedPointKernel QuantizeKernel(const K* kernel, const int kSizeX, const int kSizeY, const double maxInput)
+	{
+		FixedPointKernel fixed;
+		fixed.kSizeX = kSizeX;
+		fixed.kSizeY = kSizeY;
+		if (!kernel || kSizeX <= 0 || kSizeY <= 0) return fixed;
+
+		const auto count = static_cast<size_t>(kSizeX) * kSizeY;
+		const auto fits = [&](const int shift)
+		{
+			double sum = 0;
+			for (size_t i = 0; i < count; i++)
+			{
+				const auto q = std::round(std::ldexp(static_cast<double>(kernel[i]), shift));
+				if (fabs(q) > 32767) return false;
+				sum += fabs(q);
+			}
+			return maxInput * sum <= FIXED_POINT_BUDGET;
+		};
+
+		// the finest step that fits
+		auto shift = FIXED_POINT_MAX_SHIFT;
+		while (shift > -FIXED_POINT_MAX_SHIFT && !fits(shift)) --shift;
+
+		fixed.scale = static_cast<float>(std::ldexp(1.0, -shift));
+		fixed.taps.resize(count);
+		for (size_t i = 0; i < count; i++)
+		{
+			const auto q = (std::min)(32767.0, (std::max)(-32767.0, std::round(std::ldexp(static_cast<double>(kernel[i]), shift))));
+			fixed.taps[i] = static_cast<int16_t>(q);
+			fixed.quantizationError += fabs(kernel[i] - q * fixed.scale);
+		}
+
+		return fixed;
+	}
+}
+
+FixedPointKernel FixedPointKernel::Quantize(const float* kernel, const int kSizeX, const int kSizeY, const double maxInput)
+{
+	return QuantizeKernel(kernel, kSizeX, kSizeY, maxInput);
+}
+
+FixedPointKernel FixedPointKernel::Quantize(const double* kernel, const int kSizeX, const int kSizeY, const double maxInput)
+{
+	return QuantizeKernel(kernel, kSizeX, kSizeY, maxInput);
+}
+
+bool FixedPointKernel::FromIntegers(const int* kernel, const int kSizeX, const int kSizeY, const float scale,
+	const double maxInput, FixedPointKernel& fixed)
+{
+	if (!kernel || kSizeX <= 0 || kSizeY <= 0) return false;
+
+	const auto count = static_cast<size_t>(kSizeX) * kSizeY;
+	double sum = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		if (kernel[i] > 32767 || kernel[i] < -32767) return false;
+		sum += std::abs(kernel[i]);
+	}
+	if (maxInput * sum > FIXED_POINT_BUDGET) return false;
+
+	fixed.taps.resize(count);
+	for (size_t i = 0; i < count; i++) fixed.taps[i] = static_cast<int16_t>(kernel[i]);
+	fixed.kSizeX = kSizeX;
+	fixed.kSizeY = kSizeY;
+	fixed.scale = scale;
+	fixed.quantizationError = 0;
+	return true;
+}
+
+ConvolutionEngine::ConvolutionEngine(ThreadPool* pool, const int bandRows, const bool fixedPoint) : pool_(pool),
+	bandRows_(bandRows), fixedPoint_(fixedPoint)
+{
+}
+
+bool ConvolutionEngine::HasAvx2()
+{
+#ifdef CONVOLUTION_X86
+#ifdef _MSC_VER
+	static const auto avx2 = []
+	{
+		int info[4];
+		__cpuid(info, 1);
+		// the OS has to save the ymm registers too
+		const auto osAvx = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (_xgetbv(0) & 6) == 6;
+		__cpuidex(info, 7, 0);
+		return osAvx && (info[1] & (1 << 5)) != 0;
+	}();
+#else
+	static const auto avx2 = __builtin_cpu_supports("avx2") != 0;
+#endif
+	return avx2;
+#else
+	return false;
+#endif
+}
+
+int ConvolutionEngine::BandRows(const int rowBytes, const int halo, const int sizeY) const
+{
+	auto bandRows = bandRows_;
+	if (bandRows <= 0) bandRows = (std::max)(8, L2_BUDGET / rowBytes - halo);
+
+	return (std::min)(bandRows, sizeY);
+}
+
+int ConvolutionEngine::SeparableBandRows(const int kSizeY, const int sizeY) const
+{
+	// the working set is the ring of kSizeY rows whatever the band height, so bands only split the
+	// rows between the workers; each band filters the kSizeY - 1 rows above it again
+	auto bandRows = bandRows_ > 0 ? bandRows_ : sizeY;
+	if (bandRows_ <= 0 && pool_) bandRows = (std::max)(4 * kSizeY, (sizeY + 2 * static_cast<int>(pool_->Size()) - 1) / (2 * static_cast<int>(pool_->Size())));
+
+	return (std::min)(bandRows, sizeY);
+}
+
+int ConvolutionEngine::IntermediateShift(const FixedPointKernel& xKernel, const double maxInput)
+{
+	const auto largest = maxInput * AbsSum(xKernel);
+
+	auto shift = 0;
+	while (shift < FIXED_POINT_MAX_SHIFT && std::ldexp(largest, -shift) + 0.5 > INTERMEDIATE_MAX) ++shift;
+
+	return shift;
+}
+
+double ConvolutionEngine::FixedPointErrorBound(const FixedPointKernel& kernel, const double maxInput)
+{
+	// the quantized taps, and the float conversion and scaling of the sum, half an ulp each
+	return maxInput * (kernel.quantizationError + AbsSum(kernel) * kernel.scale * FLT_EPSILON);
+}
+
+double ConvolutionEngine::FixedPointErrorBound(const FixedPointKernel& xKernel, const FixedPointKernel& yKernel,
+	const double maxInput)
+{
+	const auto sumX = AbsSum(xKernel) * xKernel.scale;
+	const auto sumY = AbsSum(yKernel) * yKernel.scale;
+
+	// a horizontal sum is rounded to half a step, and the bias correction is another half
+	const auto step = std::ldexp(static_cast<double>(xKernel.scale), IntermediateShift(xKernel, maxInput));
+
+	return (maxInput * xKernel.quantizationError + step) * sumY
+		+ maxInput * (sumX + xKernel.quantizationError) * yKernel.quantizationError
+		+ maxInput * sumX * sumY * FLT_EPSILON;
+}
+
+template <typename T, typename Acc, typename Policy>
+bool ConvolutionEngine::Convolve2D(const T* in, T* out, const int sizeX, const int sizeY, const Acc* kernel,
+	const int kSizeX, const int kSizeY, const int channels) const
+{
+	// check validity of params
+	if (!in || !out || !kernel) return false;
+	if (sizeX <= 0 || sizeY <= 0 || kSizeX <= 0 || kSizeY <= 0 || channels <= 0) return false;
+
+	if (fixedPoint_ && FixedPointTraits<T>::SUPPORTED)
+	{
+		return QuantizedConvolve2D<T, Acc, Policy>(*this, in, out, sizeX, sizeY, kernel, kSizeX, kSizeY, channels,
+			std::integral_constant<bool, FixedPointTraits<T>::SUPPORTED>());
+	}
+
+	const auto kCenterX = kSizeX >> 1;
+	const auto kCenterY = kSizeY >> 1;
+
+	// flipped kernel, taps[m][n] weighs the pixel at (m - kCenterY, n - kCenterX)
+	std::vector<Acc> taps(static_cast<size_t>(kSizeX) * kSizeY);
+	for (auto m = 0; m < kSizeY; ++m)
+		for (auto n = 0; n < kSizeX; ++n)
+			taps[m * kSizeX + n] = kernel[kSizeX * (kSizeY - 1 - m) + (kSizeX - 1 - n)];
+
+	// rows are width values, padded rows stride values, with the channels interleaved
+	const auto width = sizeX * channels;
+	const auto stride = (sizeX + kSizeX - 1) * channels;
+	const auto bandRows = BandRows(static_cast<int>(stride * sizeof(Acc)), kSizeY - 1, sizeY);
+	const auto bands = static_cast<size_t>((sizeY + bandRows - 1) / bandRows);
+	const auto row = SelectRow<T, Acc, Policy>(kSizeX, kSizeY);
+
+	const auto band = [&](const size_t b)
+	{
+		const auto y0 = static_cast<int>(b) * bandRows;
+		const auto y1 = (std::min)(sizeY, y0 + bandRows);
+		const auto rows = y1 - y0 + kSizeY - 1;
+
+		// the band with its zero border, reused by the thread for every band
+		thread_local std::vector<Acc> padded;
+		padded.resize(static_cast<size_t>(rows) * stride);
+
+		for (auto r = 0; r < rows; ++r)
+		{
+			const auto dst = &padded[static_cast<size_t>(r) * stride];
+			const auto y = y0 - kCenterY + r;
+
+			if (y < 0 || y >= sizeY)
+			{
+				std::fill(dst, dst + stride, Acc(0));
+				continue;
+			}
+
+			const auto left = kCenterX * channels;
+			std::fill(dst, dst + left, Acc(0));
+			Load(in + static_cast<size_t>(y) * width, dst + left, width);
+			std::fill(dst + left + width, dst + stride, Acc(0));
+		}
+
+		// column tiles, the kernel's rows of a tile stay in L1 while the tile is swept down
+		for (auto x0 = 0; x0 < width; x0 += TILE_COLUMNS)
+		{
+			const auto x1 = (std::min)(width, x0 + TILE_COLUMNS);
+			for (auto y = y0; y < y1; ++y)
+			{
+				row(&padded[static_cast<size_t>(y - y0) * stride], stride, taps.data(), kSizeX, kSizeY, channels, x0, x1,
+					out + static_cast<size_t>(y) * width);
+			}
+		}
+	};
+
+	if (pool_ && bands > 1) pool_->ParallelFor(0, bands, band);
+	else for (size_t b = 0; b < bands; b++) band(b);
+
+	return true;
+}
+
+template <typename T, typename Acc, typename Policy>
+bool ConvolutionEngine::Convolve2DSeparable(const T* in, T* out, const int sizeX, const int sizeY, const Acc* xKernel,
+	const int kSizeX, const Acc* yKernel, const int kSizeY, const int channels) const
+{
+	return ControlledConvolve2DSeparable<T, Acc, Policy>(in, out, sizeX, sizeY, sizeX, sizeY, nullptr, xKernel, kSizeX,
+		yKernel, kSizeY, channels);
+}
+
+template <typename T, typename Acc, typename Policy>
+bool ConvolutionEngine::ControlledConvolve2DSeparable(const T* in, T* out, const int sizeX, const int sizeY,
+	const int patchSizeX, const int patchSizeY, const int* permutation, const Acc* xKernel, const int kSizeX,
+	const Acc* yKernel, const int kSizeY, const int channels) const
+{
+	// check validity of params
+	if (!in || !out || !xKernel || !yKernel) return false;
+	if (sizeX <= 0 || sizeY <= 0 || kSizeX <= 0 || kSizeY <= 0 || channels <= 0) return false;
+	if (!ValidPatches(sizeX, sizeY, patchSizeX, patchSizeY, permutation)) return false;
+
+	if (fixedPoint_ && FixedPointTraits<T>::SUPPORTED)
+	{
+		return QuantizedSeparable<T, Acc, Policy>(*this, in, out, sizeX, sizeY, patchSizeX, patchSizeY, permutation, xKernel, kSizeX,
+			yKernel, kSizeY, channels, std::integral_constant<bool, FixedPointTraits<T>::SUPPORTED>());
+	}
+
+	const PatchGather<T> gather = { in, sizeX * channels, patchSizeX * channels, sizeX / patchSizeX, patchSizeY, permutation };
+	const auto bandRows = SeparableBandRows(kSizeY, sizeY);
+	const auto bands = static_cast<size_t>((sizeY + bandRows - 1) / bandRows);
+	const auto axpy = SelectAxpy<Acc>();
+
+	const auto band = [&](const size_t b)
+	{
+		const auto y0 = static_cast<int>(b) * bandRows;
+		const auto y1 = (std::min)(sizeY, y0 + bandRows);
+		SeparableBand<T, Acc, Policy>(gather, out, sizeX, sizeY, channels, y0, y1, xKernel, kSizeX, yKernel, kSizeY, axpy);
+	};
+
+	if (pool_ && bands > 1) pool_->ParallelFor(0, bands, band);
+	else for (size_t b = 0; b < bands; b++) band(b);
+
+	return true;
+}
+
+template <typename T, typename Acc, typename Policy>
+bool ConvolutionEngine::Convolve2DPatches(const T* in, T* out, const int sizeX, const int sizeY, const int patchSizeX,
+	const int patchSizeY, const Acc* kernel, const int kSizeX, const int kSizeY, const PatchBorder border,
+	const int channels) const
+{
+	// check validity of params
+	if (!in || !out || !kernel) return false;
+	if (sizeX <= 0 || sizeY <= 0 || kSizeX <= 0 || kSizeY <= 0 || channels <= 0) return false;
+	if (!ValidPatches(sizeX, sizeY, patchSizeX, patchSizeY, nullptr)) return false;
+	if (PatchOutputSize(patchSizeX, kSizeX, border) <= 0 || PatchOutputSize(patchSizeY, kSizeY, border) <= 0) return false;
+
+	// flipped kernel as in Convolve2D
+	std::vector<Acc> taps(static_cast<size_t>(kSizeX) * kSizeY);
+	for (auto m = 0; m < kSizeY; ++m)
+		for (auto n = 0; n < kSizeX; ++n)
+			taps[m * kSizeX + n] = kernel[kSizeX * (kSizeY - 1 - m) + (kSizeX - 1 - n)];
+
+	const PatchBlock block(sizeX, patchSizeX, patchSizeY, kSizeX, kSizeY, border, channels);
+	const auto outWidth = block.cellsX * block.outX * channels;
+	const auto row = SelectRow<T, Acc, Policy>(kSizeX, kSizeY);
+
+	const auto gridRow = [&](const size_t g)
+	{
+		thread_local std::vector<Acc> values;
+		thread_local std::vector<T> response;
+		values.resize(static_cast<size_t>(block.rows) * block.stride);
+		response.resize(block.stride);
+		block.Gather(in, values.data(), static_cast<int>(g));
+
+		for (auto o = 0; o < block.outY; ++o)
+		{
+			row(&values[static_cast<size_t>(o) * block.stride], block.stride, taps.data(), kSizeX, kSizeY, channels, 0,
+				block.span, response.data());
+			block.Scatter(response.data(), out + (g * block.outY + o) * outWidth);
+		}
+	};
+
+	const auto cellsY = static_cast<size_t>(sizeY / patchSizeY);
+	if (pool_ && cellsY > 1) pool_->ParallelFor(0, cellsY, gridRow);
+	else for (size_t g = 0; g < cellsY; g++) gridRow(g);
+
+	return true;
+}
+
+template <typename T, typename Acc, typename Policy>
+bool ConvolutionEngine::Convolve2DSeparablePatches(const T* in, T* out, const int sizeX, const int sizeY,
+	const int patchSizeX, const int patchSizeY, const Acc* xKernel, const int kSizeX, const Acc* yKernel,
+	const int kSizeY, const PatchBorder border, const int channels) const
+{
+	// check validity of params
+	if (!in || !out || !xKernel || !yKernel) return false;
+	if (sizeX <= 0 || sizeY <= 0 || kSizeX <= 0 || kSizeY <= 0 || channels <= 0) return false;
+	if (!ValidPatches(sizeX, sizeY, patchSizeX, patchSizeY, nullptr)) return false;
+	if (PatchOutputSize(patchSizeX, kSizeX, border) <= 0 || PatchOutputSize(patchSizeY, kSizeY, border) <= 0) return false;
+
+	const PatchBlock block(sizeX, patchSizeX, patchSizeY, kSizeX, kSizeY, border, channels);
+	const auto outWidth = block.cellsX * block.outX * channels;
+	const auto axpy = SelectAxpy<Acc>();
+
+	const auto gridRow = [&](const size_t g)
+	{
+		thread_local std::vector<Acc> values, filtered, sum;
+		thread_local std::vector<T> response;
+		values.resize(static_cast<size_t>(block.rows) * block.stride);
+		filtered.assign(static_cast<size_t>(block.rows) * block.span, Acc(0));
+		sum.resize(block.span);
+		response.resize(block.span);
+		block.Gather(in, values.data(), static_cast<int>(g));
+
+		// horizontal pass over every block row, in the order of SeparableBand
+		for (auto b = 0; b < block.rows; ++b)
+		{
+			const auto center = &values[static_cast<size_t>(b) * block.stride + (kSizeX - 1) * channels];
+			for (auto k = kSizeX - 1; k >= 0; --k)
+				axpy(&filtered[static_cast<size_t>(b) * block.span], center - k * channels, xKernel[k], block.span);
+		}
+
+		for (auto o = 0; o < block.outY; ++o)
+		{
+			std::fill(sum.begin(), sum.end(), Acc(0));
+			for (auto k = kSizeY - 1; k >= 0; --k)
+				axpy(sum.data(), &filtered[static_cast<size_t>(o + kSizeY - 1 - k) * block.span], yKernel[k], block.span);
+
+			for (auto j = 0; j < block.span; ++j) response[j] = Convert<T>(sum[j], Policy());
+			block.Scatter(response.data(), out + (g * block.outY + o) * outWidth);
+		}
+	};
+
+	const auto cellsY = static_cast<size_t>(sizeY / patchSizeY);
+	if (pool_ && cellsY > 1) pool_->ParallelFor(0, cellsY, gridRow);
+	else for (size_t g = 0; g < cellsY; g++) gridRow(g);
+
+	return true;
+}
+
+template <typename T, typename Policy>
+bool ConvolutionEngine::Convolve2DFixed(const T* in, T* out, const int sizeX, const int sizeY,
+	const FixedPointKernel& kernel, const int channels) const
+{
+	typedef FixedPointTraits<T> Fixed;
+	const auto kSizeX = kernel.kSizeX;
+	const auto kSizeY = kernel.kSizeY;
+
+	// check validity of params
+	if (!in || !out) return false;
+	if (sizeX <= 0 || sizeY <= 0 || kSizeX <= 0 || kSizeY <= 0 || channels <= 0) return false;
+	if (kernel.taps.size() != static_cast<size_t>(kSizeX) * kSizeY) return false;
+
+	const auto kCenterX = kSizeX >> 1;
+	const auto kCenterY = kSizeY >> 1;
+
+	// flipped kernel as in Convolve2D, its rows padded with a zero tap to an even width for the
+	// pairs; the sums of the pixels less bias are brought back by bias times the sum of the taps
+	const auto kWidth = kSizeX + (kSizeX & 1);
+	std::vector<int16_t> taps(static_cast<size_t>(kWidth) * kSizeY, 0);
+	int32_t correction = 0;
+	for (auto m = 0; m < kSizeY; ++m)
+	{
+		for (auto n = 0; n < kSizeX; ++n)
+		{
+			taps[m * kWidth + n] = kernel.taps[kSizeX * (kSizeY - 1 - m) + (kSizeX - 1 - n)];
+			correction += Fixed::BIAS * taps[m * kWidth + n];
+		}
+	}
+	const auto pairs = TapPairs(taps);
+	const auto count = static_cast<int>(taps.size());
+
+	// zero pixels are -bias in the padded band
+	const auto outside = static_cast<int16_t>(-Fixed::BIAS);
+	const auto width = sizeX * channels;
+	const auto stride = (sizeX + kWidth - 1) * channels;
+	const auto bandRows = BandRows(static_cast<int>(stride * sizeof(int16_t)), kSizeY - 1, sizeY);
+	const auto bands = static_cast<size_t>((sizeY + bandRows - 1) / bandRows);
+	const auto store = SelectFixedStore<T, Policy>();
+
+	const auto band = [&](const size_t b)
+	{
+		const auto y0 = static_cast<int>(b) * bandRows;
+		const auto y1 = (std::min)(sizeY, y0 + bandRows);
+		const auto rows = y1 - y0 + kSizeY - 1;
+
+		thread_local std::vector<int16_t> padded;
+		thread_local std::vector<const int16_t*> sources;
+		padded.resize(static_cast<size_t>(rows) * stride);
+		sources.resize(count);
+
+		for (auto r = 0; r < rows; ++r)
+		{
+			const auto dst = &padded[static_cast<size_t>(r) * stride];
+			const auto y = y0 - kCenterY + r;
+
+			if (y < 0 || y >= sizeY)
+			{
+				std::fill(dst, dst + stride, outside);
+				continue;
+			}
+
+			const auto left = kCenterX * channels;
+			std::fill(dst, dst + left, outside);
+			LoadFixed(in + static_cast<size_t>(y) * width, dst + left, width);
+			std::fill(dst + left + width, dst + stride, outside);
+		}
+
+		for (auto x0 = 0; x0 < width; x0 += TILE_COLUMNS)
+		{
+			const auto x1 = (std::min)(width, x0 + TILE_COLUMNS);
+			for (auto y = y0; y < y1; ++y)
+			{
+				for (auto m = 0; m < kSizeY; ++m)
+				{
+					for (auto n = 0; n < kWidth; ++n)
+						sources[m * kWidth + n] = &padded[static_cast<size_t>(y - y0 + m) * stride + n * channels];
+				}
+
+				store(sources.data(), taps.data(), pairs.data(), count, correction, kernel.scale, x0, x1,
+					out + static_cast<size_t>(y) * width);
+			}
+		}
+	};
+
+	if (pool_ && bands > 1) pool_->ParallelFor(0, bands, band);
+	else for (size_t b = 0; b < bands; b++) band(b);
+
+	return true;
+}
+
+template <typename T, typename Policy>
+bool ConvolutionEngine::Convolve2DSeparableFixed(const T* in, T* out, const int sizeX, const int sizeY,
+	const FixedPointKernel& xKernel, const FixedPointKernel& yKernel, const int channels) const
+{
+	return ControlledConvolve2DSeparableFixed<T, Policy>(in, out, sizeX, sizeY, sizeX, sizeY, nullptr, xKernel, yKernel,
+		channels);
+}
+
+template <typename T, typename Policy>
+bool ConvolutionEngine::ControlledConvolve2DSeparableFixed(const T* in, T* out, const int sizeX, const int sizeY,
+	const int patchSizeX, const int patchSizeY, const int* permutation, const FixedPointKernel& xKernel,
+	const FixedPointKernel& yKernel, const int channels) const
+{
+	typedef FixedPointTraits<T> Fixed;
+	const auto kSizeX = static_cast<int>(xKernel.taps.size());
+	const auto kSizeY = static_cast<int>(yKernel.taps.size());
+
+	// check validity of params
+	if (!in || !out) return false;
+	if (sizeX <= 0 || sizeY <= 0 || kSizeX <= 0 || kSizeY <= 0 || channels <= 0) return false;
+	if (!ValidPatches(sizeX, sizeY, patchSizeX, patchSizeY, permutation)) return false;
+
+	SeparableTaps k;
+	k.xTaps = Flip(xKernel.taps);
+	k.yTaps = Flip(yKernel.taps);
+	k.xPairs = TapPairs(k.xTaps);
+	k.yPairs = TapPairs(k.yTaps);
+	k.kSizeX = kSizeX;
+	k.kSizeY = kSizeY;
+	k.shift = IntermediateShift(xKernel, Fixed::MAX_ABS);
+
+	int32_t outside = 0;
+	for (const auto t : k.xTaps) outside -= Fixed::BIAS * t;
+	k.outside = Narrow(outside, k.shift);
+
+	int32_t ySum = 0;
+	for (const auto t : k.yTaps) ySum += t;
+	k.correction = -k.outside * ySum;
+	k.scale = static_cast<float>(std::ldexp(static_cast<double>(xKernel.scale) * yKernel.scale, k.shift));
+
+	const PatchGather<T> gather = { in, sizeX * channels, patchSizeX * channels, sizeX / patchSizeX, patchSizeY, permutation };
+	const auto bandRows = SeparableBandRows(kSizeY, sizeY);
+	const auto bands = static_cast<size_t>((sizeY + bandRows - 1) / bandRows);
+	const auto narrow = SelectFixedNarrow();
+	const auto store = SelectFixedStore<T, Policy>();
+
+	const auto band = [&](const size_t b)
+	{
+		const auto y0 = static_cast<int>(b) * bandRows;
+		const auto y1 = (std::min)(sizeY, y0 + bandRows);
+		SeparableFixedBand(gather, out, sizeX, sizeY, channels, y0, y1, k, narrow, store);
+	};
+
+	if (pool_ && bands > 1) pool_->ParallelFor(0, bands, band);
+	else for (size_t b = 0; b < bands; b++) band(b);
+
+	return true;
+}
+
+// the templates are defined here, so every pixel type, accumulator and policy callers may
+// name is instantiated below (the accumulators are the ones Simd has)
+#define INSTANTIATE_CONVOLUTION(T, Acc, Policy) \
+	template bool ConvolutionEngine::Convolve2D<T, Acc, Policy>(const T*, T*, int, int, const Acc*, int, int, int) const; \
+	template bool ConvolutionEngine::Convolve2DSeparable<T, Acc, Policy>(const T*, T*, int, int, const Acc*, int, \
+		const Acc*, int, int) const; \
+	template bool ConvolutionEngine::ControlledConvolve2DSeparable<T, Acc, Policy>(const T*, T*, int, int, int, int, \
+		const int*, const Acc*, int, const Acc*, int, int) const; \
+	template bool ConvolutionEngine::Convolve2DPatches<T, Acc, Policy>(const T*, T*, int, int, int, int, const Acc*, int, \
+		int, PatchBorder, int) const; \
+	template bool ConvolutionEngine::Convolve2DSeparablePatches<T, Acc, Policy>(const T*, T*, int, int, int, int, \
+		const Acc*, int, const Acc*, int, PatchBorder, int) const;
+
+// integer pixels saturate or not as the caller asks
+#define INSTANTIATE_INTEGER_CONVOLUTION(T) \
+	INSTANTIATE_CONVOLUTION(T, float, AbsRound) \
+	INSTANTIATE_CONVOLUTION(T, float, Round) \
+	INSTANTIATE_CONVOLUTION(T, float, NoSaturation) \
+	INSTANTIATE_CONVOLUTION(T, double, AbsRound) \
+	INSTANTIATE_CONVOLUTION(T, double, Round) \
+	INSTANTIATE_CONVOLUTION(T, double, NoSaturation)
+
+INSTANTIATE_INTEGER_CONVOLUTION(unsigned char)
+INSTANTIATE_INTEGER_CONVOLUTION(unsigned short)
+INSTANTIATE_INTEGER_CONVOLUTION(int16_t)
+INSTANTIATE_INTEGER_CONVOLUTION(int)
+INSTANTIATE_CONVOLUTION(float, float, NoSaturation)
+INSTANTIATE_CONVOLUTION(float, double, NoSaturation)
+INSTANTIATE_CONVOLUTION(double, double, NoSaturation)
+INSTANTIATE_CONVOLUTION(Float16, float, NoSaturation)
+
+// every pixel type with FixedPointTraits, with every policy
+#define INSTANTIATE_FIXED_POINT(T, Policy) \
+	template bool ConvolutionEngine::Convolve2DFixed<T, Policy>(const T*, T*, int, int, const FixedPointKernel&, int) const; \
+	template bool ConvolutionEngine::Convolve2DSeparableFixed<T, Policy>(const T*, T*, int, int, const FixedPointKernel&, \
+		const FixedPointKernel&, int) const; \
+	template bool ConvolutionEngine::ControlledConvolve2DSeparableFixed<T, Policy>(const T*, T*, int, int, int, int, \
+		const int*, const FixedPointKernel&, const FixedPointKernel&, int) const;
+
+#define INSTANTIATE_INTEGER_FIXED_POINT(T) \
+	INSTANTIATE_FIXED_POINT(T, AbsRound) \
+	INSTANTIATE_FIXED_POINT(T, Round) \
+	INSTANTIATE_FIXED_POINT(T, NoSaturation)
+
+INSTANTIATE_INTEGER_FIXED_POINT(unsigned char)
+INSTANTIATE_INTEGER_FIXED_POINT(unsigned short)
+INSTANTIATE_INTEGER_FIXED_POINT(int16_t)
@@ -0,0 +1,208 @@
+#pragma once
+#ifndef CONVOLUTION_ENGINE_H
+#define CONVOLUTION_ENGINE_H
+#include "ThreadPool.h"
+#include "Float16.h"
+#include <cstdint>
+#include <vector>
+
+/*
+ * Output conversions of the accumulated sum.
+ *   AbsRound     - |sum| rounded, saturated (the historical unsigned versions)
+ *   Round        - nearest, halves away from zero, saturated
+ *   NoSaturation - plain conversion, for floating point outputs
+ */
+struct AbsRound {};
+struct Round {};
+struct NoSaturation {};
+
+/// <summary>
+/// Accumulator (and kernel) type and output conversion of a pixel type. A new pixel type only
+/// needs a specialization here and an instantiation line in ConvolutionEngine.cpp.
+///The routines below are built for these defaults and for the other combinations of
+///ConvolutionEngine.cpp: integer pixels with a float or double accumulator and any policy,
+///floating point pixels with NoSaturation (float pixels with a double accumulator too).
+/// </summary>
+template <typename T> struct ConvolutionTraits;
+template <> struct ConvolutionTraits<unsigned char> { typedef float Accumulator; typedef AbsRound Policy; };
+template <> struct ConvolutionTraits<unsigned short> { typedef float Accumulator; typedef AbsRound Policy; };
+template <> struct ConvolutionTraits<int16_t> { typedef float Accumulator; typedef Round Policy; };
+template <> struct ConvolutionTraits<int> { typedef float Accumulator; typedef Round Policy; };
+template <> struct ConvolutionTraits<float> { typedef float Accumulator; typedef NoSaturation Policy; };
+template <> struct ConvolutionTraits<double> { typedef double Accumulator; typedef NoSaturation Policy; };
+template <> struct ConvolutionTraits<Float16> { typedef float Accumulator; typedef NoSaturation Policy; };
+
+/// <summary>
+/// Pixel types of the fixed point convolution. Pixels are held in int16 less BIAS, MAX_ABS is the
+/// largest |pixel|.
+/// </summary>
+template <typename T> struct FixedPointTraits { static const bool SUPPORTED = false; };
+template <> struct FixedPointTraits<unsigned char> { static const bool SUPPORTED = true; static const int BIAS = 0; static const int MAX_ABS = 255; };
+template <> struct FixedPointTraits<unsigned short> { static const bool SUPPORTED = true; static const int BIAS = 32768; static const int MAX_ABS = 65535; };
+template <> struct FixedPointTraits<int16_t> { static const bool SUPPORTED = true; static const int BIAS = 0; static const int MAX_ABS = 32768; };
+
+/// <summary>
+/// Kernel of the fixed point convolution, int16 taps in the layout of the float kernel and the
+/// scale of their sums: out = scale * sum of taps * pixels.
+/// </summary>
+struct FixedPointKernel
+{
+	std::vector<int16_t> taps;
+	int kSizeX = 0;
+	int kSizeY = 0;
+	float scale = 1;
+	// sum of |kernel - taps * scale|, 0 for an integer kernel
+	double quantizationError = 0;
+
+	/// <summary>
+	/// taps = round(kernel * 2^shift) with the largest shift that keeps the taps in int16 and the
+	/// sums of pixels up to maxInput within half the int32 range.
+	/// </summary>
+	static FixedPointKernel Quantize(const float* kernel, int kSizeX, int kSizeY, double maxInput);
+	static FixedPointKernel Quantize(const double* kernel, int kSizeX, int kSizeY, double maxInput);
+
+	/// <summary>
+	/// Integer kernel with its scale, false when a tap or a sum of pixels up to maxInput doesn't fit.
+	/// </summary>
+	static bool FromIntegers(const int* kernel, int kSizeX, int kSizeY, float scale, double maxInput,
+		FixedPointKernel& fixed);
+};
+
+/// <summary>
+/// Border of the per patch convolution.
+///valid - only the outputs whose kernel lies inside the patch, (width - kSizeX + 1) x (height - kSizeY + 1)
+///clamp - every pixel of the patch, with the patch's edge pixels repeated outside of it
+/// </summary>
+enum class PatchBorder { valid, clamp };
+
+/*
+ * Blocked convolution engine behind every Convolution routine, one implementation for all pixel
+ * types.
+ *
+ * Pixels are converted to the accumulator type band by band, into a buffer with a zero border of
+ * half a kernel, so the inner loops have no bounds checks and every pixel type gets the same
+ * vectorized loops. 2D convolution sweeps a band in column tiles that keep the kernel's rows in
+ * L1, with AVX2 loops unrolled at compile time for 3x3, 5x5 and 7x7 kernels. Separable convolution
+ * filters each row of a band horizontally once, keeps kSizeY filtered rows in a ring and runs the
+ * vertical pass from it. Bands are sized for L2 and run on the pool when one is given.
+ *
+ * Taps are multiplied and added in the order of the reference routines (Convolve2DSlow for 2D,
+ * the historical Convolve2DSeparable for separable kernels), without fused multiply-add, so the
+ * results are bit identical to them. Two exceptions: unsigned outputs saturate where the
+ * historical casts overflowed, and even sized separable kernels are centered as in Convolve2DSlow
+ * everywhere, the historical routines used a different center within half a kernel of the border.
+ *
+ * The fixed point routines run 8 and 16 bit images on int16 bands, two taps per 16 bit
+ * multiply-add (_mm256_madd_epi16) into int32 sums, twice the lanes of the float loops. Their
+ * results are within FixedPointErrorBound of the float ones.
+ */
+class ConvolutionEngine
+{
+public:
+	/// <summary>
+	/// pool runs the bands, none runs them on the calling thread. bandRows 0 sizes bands for L2.
+	/// fixedPoint runs the 8 and 16 bit images of the float kernel routines below through the
+	/// fixed point ones, with their kernels quantized and their outputs converted by the Policy
+	/// the float routine was called with.
+	/// </summary>
+	explicit ConvolutionEngine(ThreadPool* pool = nullptr, int bandRows = 0, bool fixedPoint = false);
+
+	/// <summary>
+	/// Center originated 2D convolution with zero padding. Images hold channels interleaved
+	/// values per pixel (BGR Mats have 3), every channel is convolved with the same kernel.
+	/// </summary>
+	template <typename T, typename Acc = typename ConvolutionTraits<T>::Accumulator,
+		typename Policy = typename ConvolutionTraits<T>::Policy>
+	bool Convolve2D(const T* in, T* out, int sizeX, int sizeY, const Acc* kernel, int kSizeX, int kSizeY,
+		int channels = 1) const;
+
+	/// <summary>
+	/// Separable convolution with an xKernel row and a yKernel column, zero padded.
+	/// </summary>
+	template <typename T, typename Acc = typename ConvolutionTraits<T>::Accumulator,
+		typename Policy = typename ConvolutionTraits<T>::Policy>
+	bool Convolve2DSeparable(const T* in, T* out, int sizeX, int sizeY, const Acc* xKernel, int kSizeX,
+		const Acc* yKernel, int kSizeY, int channels = 1) const;
+
+	/// <summary>
+	/// Separable convolution of the patch reordered image, see Convolution::ControlledConvolve2DSeparable.
+	/// </summary>
+	template <typename T, typename Acc = typename ConvolutionTraits<T>::Accumulator,
+		typename Policy = typename ConvolutionTraits<T>::Policy>
+	bool ControlledConvolve2DSeparable(const T* in, T* out, int sizeX, int sizeY, int patchSizeX, int patchSizeY,
+		const int* permutation, const Acc* xKernel, int kSizeX, const Acc* yKernel, int kSizeY, int channels = 1) const;
+
+	/// <summary>
+	/// Convolution of every patchSizeX x patchSizeY cell of a tiled image on its own, the image
+	/// size a multiple of the patch size. Each grid row of cells is laid out once with the
+	/// cells' borders side by side, and the row loops sweep all of its cells in one pass. out is
+	/// the grid of the cell responses, PatchOutputSize values each way per cell.
+	/// </summary>
+	template <typename T, typename Acc = typename ConvolutionTraits<T>::Accumulator,
+		typename Policy = typename ConvolutionTraits<T>::Policy>
+	bool Convolve2DPatches(const T* in, T* out, int sizeX, int sizeY, int patchSizeX, int patchSizeY, const Acc* kernel,
+		int kSizeX, int kSizeY, PatchBorder border, int channels = 1) const;
+
+	template <typename T, typename Acc = typename ConvolutionTraits<T>::Accumulator,
+		typename Policy = typename ConvolutionTraits<T>::Policy>
+	bool Convolve2DSeparablePatches(const T* in, T* out, int sizeX, int sizeY, int patchSizeX, int patchSizeY,
+		const Acc* xKernel, int kSizeX, const Acc* yKernel, int kSizeY, PatchBorder border, int channels = 1) const;
+
+	/// <summary>
+	/// Width (height) of the response of a patch of patchSize pixels to a kernel of kSize taps,
+	/// not positive if the kernel doesn't fit a valid patch.
+	/// </summary>
+	static int PatchOutputSize(const int patchSize, const int kSize, const PatchBorder border)
+	{
+		return border == PatchBorder::valid ? patchSize - kSize + 1 : patchSize;
+	}
+
+	/// <summary>
+	/// Fixed point 2D convolution of 8 and 16 bit images (see FixedPointTraits): int16 pixels and
+	/// taps, int32 sums of 16 bit multiply-adds, the scaled sum converted by Policy as in Convolve2D.
+	/// </summary>
+	template <typename T, typename Policy = typename ConvolutionTraits<T>::Policy>
+	bool Convolve2DFixed(const T* in, T* out, int sizeX, int sizeY, const FixedPointKernel& kernel, int channels = 1) const;
+
+	/// <summary>
+	/// Fixed point separable convolution. The horizontal sums are rounded back to int16 for the
+	/// vertical multiply-adds, with as many bits as they fit for pixels up to MAX_ABS.
+	/// </summary>
+	template <typename T, typename Policy = typename ConvolutionTraits<T>::Policy>
+	bool Convolve2DSeparableFixed(const T* in, T* out, int sizeX, int sizeY, const FixedPointKernel& xKernel,
+		const FixedPointKernel& yKernel, int channels = 1) const;
+
+	template <typename T, typename Policy = typename ConvolutionTraits<T>::Policy>
+	bool ControlledConvolve2DSeparableFixed(const T* in, T* out, int sizeX, int sizeY, int patchSizeX, int patchSizeY,
+		const int* permutation, const FixedPointKernel& xKernel, const FixedPointKernel& yKernel, int channels = 1) const;
+
+	/// <summary>
+	/// Bound of |fixed point sum - exact sum| for pixels up to maxInput: the quantized taps and
+	/// the float conversion of the int32 sum, plus the int16 rounding of the horizontal sums for
+	/// separable kernels. Outputs differ from the float routines by at most the bound plus one.
+	/// </summary>
+	static double FixedPointErrorBound(const FixedPointKernel& kernel, double maxInput);
+	static double FixedPointErrorBound(const FixedPointKernel& xKernel, const FixedPointKernel& yKernel, double maxInput);
+
+	static bool HasAvx2();
+
+	// per band working set the band height is chosen for
+	static const int L2_BUDGET = 128 * 1024;
+	// widest column tile, in values (pixels times channels), the 2D inner loops sweep before moving down
+	static const int TILE_COLUMNS = 512;
+	// largest |value| of the int16 horizontal sums of separable fixed point convolution, the range
+	// its yKernel is quantized for
+	static const int INTERMEDIATE_MAX_ABS = 32768;
+
+private:
+	int BandRows(int rowBytes, int halo, int sizeY) const;
+	int SeparableBandRows(int kSizeY, int sizeY) const;
+
+	// right shift of the horizontal sums of the separable fixed point convolution
+	static int IntermediateShift(const FixedPointKernel& xKernel, double maxInput);
+
+	ThreadPool* pool_;
+	int bandRows_;
+	bool fixedPoint_;
+};
+#endif
@@ -1,13 +1,54 @@
 #include "stdafx.h"
 #include "Dataset.h"
 #include "ImageMeasure.h"
+#include "PatchTable.h"
+#include <mutex>
 
+const double Dataset::MAX_ENTROPY = log10(256.0);
 
-Dataset::Dataset(): _totalSamples(0), _channel0Entropy(0), _channel1Entropy(0), _channel2Entropy(0), _averageEntropy(0)
+void EntropyMoments::Add(const double x)
 {
+	count++;
+	const auto delta = x - mean;
+	mean += delta / static_cast<double>(count);
+	m2 += delta * (x - mean);
 }
 
-Dataset::Dataset(const std::string & dir): _totalSamples(0), _channel0Entropy(0), _channel1Entropy(0),
+void EntropyMoments::Merge(const EntropyMoments& other)
+{
+	if (other.count == 0) return;
+	if (count == 0)
+	{
+		*this = other;
+		return;
+	}
+
+	const auto total = count + other.count;
+	const auto delta = other.mean - mean;
+	mean += delta * static_cast<double>(other.count) / static_cast<double>(total);
+	m2 += other.m2 + delta * delta * static_cast<double>(count) * static_cast<double>(other.count) / static_cast<double>(total);
+	count = total;
+}
+
+namespace
+{
+	// reduction of one chunk of samples
+	struct Partial
+	{
+		EntropyMoments channels[3];
+		EntropyMoments average;
+		vector<uint64_t> distribution;
+		uint64_t histogram[3][256] = {};
+		int failed = 0;
+	};
+}
+
+Dataset::Dataset(): _totalSamples(0), _failedSamples(0), _channel0Entropy(0), _channel1Entropy(0), _channel2Entropy(0),
+					_averageEntropy(0)
+{
+}
+
+Dataset::Dataset(const std::string & dir): _totalSamples(0), _failedSamples(0), _channel0Entropy(0), _channel1Entropy(0),
 										   _channel2Entropy(0), _averageEntropy(0)
 {
 	_directory = dir;
@@ -21,38 +62,116 @@ Dataset::~Dataset()
 
 void Dataset::CalcualteEntropy()
 {
-	auto counter = 0;
+	ThreadPool pool;
+	CalcualteEntropy(pool);
+}
+
+void Dataset::CalcualteEntropy(ThreadPool& pool, const int bins)
+{
+	// a few chunks per worker keeps them busy when decode times vary
+	const auto chunks = (std::min)(_sampleSet.size(), pool.Size() * 8);
+	vector<Partial> partials(chunks);
+	std::mutex progress;
 
 	cout << "[";
-	for(const auto& sample : _sampleSet)
+	pool.ParallelFor(0, chunks, [&](const size_t chunk)
 	{
-		const auto image = cv::imread(sample, IMREAD_COLOR);
-		ImageMeasure m(image);
-		m.CalculateEntropy();
+		auto& partial = partials[chunk];
+		partial.distribution.assign(bins, 0);
+
+		for (auto i = chunk; i < _sampleSet.size(); i += chunks)
+		{
+			const auto image = cv::imread(_sampleSet[i], IMREAD_COLOR);
+			if (image.empty())
+			{
+				partial.failed++;
+				continue;
+			}
+
+			const auto histogram = PatchTable::ComputeHistogram(image);
+			const auto e = PatchTable::ComputeEntropy(histogram, static_cast<int>(image.total()));
+			const auto average = (e[0] + e[1] + e[2]) / 3.0;
+
+			for (auto c = 0; c < 3; c++)
+			{
+				partial.channels[c].Add(e[c]);
+				const auto counts = histogram.ptr<float>(c);
+				for (auto b = 0; b < 256; b++) partial.histogram[c][b] += static_cast<uint64_t>(counts[b]);
+			}
+			partial.average.Add(average);
+
+			const auto bin = static_cast<int>(average / MAX_ENTROPY * bins);
+			partial.distribution[(std::max)(0, (std::min)(bins - 1, bin))]++;
+		}
+
+		std::lock_guard<std::mutex> lock(progress);
 		cout << "#";
+	});
+
+	//merge in chunk order, the result doesn't depend on scheduling
+	uint64_t histogram[3][256] = {};
+	for (auto& c : _channelMoments) c = EntropyMoments();
+	_averageMoments = EntropyMoments();
+	_entropyDistribution.assign(bins, 0);
+	_failedSamples = 0;
+
+	for (const auto& partial : partials)
+	{
+		for (auto c = 0; c < 3; c++)
+		{
+			_channelMoments[c].Merge(partial.channels[c]);
+			for (auto b = 0; b < 256; b++) histogram[c][b] += partial.histogram[c][b];
+		}
+		_averageMoments.Merge(partial.average);
+		for (auto b = 0; b < bins; b++) _entropyDistribution[b] += partial.distribution[b];
+		_failedSamples += partial.failed;
+	}
+
+	_totalSamples = static_cast<int>(_averageMoments.count);
+	cout << "] " << _totalSamples << endl;
+
+	_channel0Entropy = _channelMoments[0].mean;
+	_channel1Entropy = _channelMoments[1].mean;
+	_channel2Entropy = _channelMoments[2].mean;
+	_averageEntropy = _averageMoments.mean;
+
+	_pooledEntropy = cv::Scalar(0, 0, 0);
+	for (auto c = 0; c < 3; c++)
+	{
+		uint64_t total = 0;
+		for (auto b = 0; b < 256; b++) total += histogram[c][b];
 
-		_channel0Entropy += m.Channel0Entropy();
-		_channel1Entropy += m.Channel1Entropy();
-		_channel2Entropy += m.Channel2Entropy();
-		_averageEntropy += m.AverageEntropy();
-		counter += 1;
+		for (auto b = 0; b < 256 && total > 0; b++)
+		{
+			if (histogram[c][b] == 0) continue;
+			const auto p = static_cast<double>(histogram[c][b]) / static_cast<double>(total);
+			_pooledEntropy.val[c] += -p * log10(p);
+		}
 	}
-	cout << counter;
-	_channel0Entropy = _channel0Entropy / counter;
-	_channel1Entropy = _channel1Entropy / counter;
-	_channel2Entropy = _channel2Entropy / counter;
-	_averageEntropy = _averageEntropy / counter;
 }
 
 ostream & operator<<(ostream & out, const Dataset & d)
 {
-	// TODO: insert return statement here
 	out << "Dataset stat:\n";
 	out << "\tDirectory: " << d._directory << endl;
-	out << "\tTotal samples : " << d._totalSamples<< endl;
-	out << "\tBlue Channel Entropy: " << d._channel0Entropy << endl;
-	out << "\tGreen Channel Entropy: " << d._channel1Entropy << endl;
-	out << "\tRed Channel Entropy: " << d._channel2Entropy << endl;
+	out << "\tTotal samples : " << d._totalSamples << endl;
+	if (d._failedSamples > 0) out << "\tUnreadable samples : " << d._failedSamples << endl;
+	out << "\tBlue Channel Entropy: " << d._channel0Entropy << " (variance " << d._channelMoments[0].Variance() << ")" << endl;
+	out << "\tGreen Channel Entropy: " << d._channel1Entropy << " (variance " << d._channelMoments[1].Variance() << ")" << endl;
+	out << "\tRed Channel Entropy: " << d._channel2Entropy << " (variance " << d._channelMoments[2].Variance() << ")" << endl;
+	out << "\tAverage Entropy: " << d._averageEntropy << " (variance " << d._averageMoments.Variance() << ")" << endl;
+	out << "\tPooled Entropy (B,G,R): " << d._pooledEntropy[0] << ", " << d._pooledEntropy[1] << ", " << d._pooledEntropy[2] << endl;
+
+	const auto bins = d._entropyDistribution.size();
+	if (bins > 0)
+	{
+		out << "\tAverage Entropy distribution:\n";
+		for (size_t b = 0; b < bins; b++)
+		{
+			out << "\t\t[" << Dataset::MAX_ENTROPY * b / bins << ", " << Dataset::MAX_ENTROPY * (b + 1) / bins << ") "
+				<< d._entropyDistribution[b] << endl;
+		}
+	}
 
 	return out;
 }
@@ -1,22 +1,66 @@
 #pragma once
+#include <cstdint>
+#include "ThreadPool.h"
+
+/// <summary>
+/// Running mean and variance (Welford). Partial results from different workers are combined with Merge
+/// (Chan et al.), so the reduction stays stable however the samples were split.
+/// </summary>
+struct EntropyMoments
+{
+	uint64_t count = 0;
+	double mean = 0;
+	double m2 = 0;
+
+	void Add(double x);
+	void Merge(const EntropyMoments& other);
+	double Variance() const { return count > 1 ? m2 / static_cast<double>(count - 1) : 0.0; }
+};
+
 class Dataset
 {
 public:
+	// upper bound of the per image entropy (log10 of 256 grey levels), range of the distribution histogram
+	static const double MAX_ENTROPY;
+
 	Dataset();
 	explicit Dataset(const std::string &dir);
 	~Dataset();
 
+	/// <summary>
+	/// Decodes every sample on a pool of all cores and computes the dataset statistics.
+	/// </summary>
 	void CalcualteEntropy();
+	/// <summary>
+	/// Decodes the samples on pool. Every task reduces a chunk of samples into its own partial
+	/// (moments, channel histograms, distribution); the partials are merged in chunk order.
+	/// </summary>
+	/// <param name="pool">workers used for decoding and measuring.</param>
+	/// <param name="bins">bins of the per image entropy distribution over [0, MAX_ENTROPY].</param>
+	void CalcualteEntropy(ThreadPool& pool, int bins = 32);
+
 	std::string GetDir() const { return _directory; }
 	int TotalSamples() const { return _totalSamples; }
+	int FailedSamples() const { return _failedSamples; }
+	const EntropyMoments& ChannelMoments(const int channel) const { return _channelMoments[channel]; }
+	const EntropyMoments& AverageMoments() const { return _averageMoments; }
+	const vector<uint64_t>& EntropyDistribution() const { return _entropyDistribution; }
+	/// <summary>
+	/// Entropy of the pooled histogram of every pixel of the dataset, per channel.
+	/// </summary>
+	cv::Scalar PooledEntropy() const { return _pooledEntropy; }
 	friend ostream& operator <<(ostream& out, const Dataset& d);
 private:
 	std::string _directory;
 	int _totalSamples;
+	int _failedSamples;
 	double _channel0Entropy;
 	double _channel1Entropy;
 	double _channel2Entropy;
 	double _averageEntropy;
+	EntropyMoments _channelMoments[3];
+	EntropyMoments _averageMoments;
+	vector<uint64_t> _entropyDistribution;
+	cv::Scalar _pooledEntropy;
 	vector<std::string> _sampleSet;
 };
-
@@ -0,0 +1,365 @@
+#include "stdafx.h"
+#include "FeatureIndex.h"
+#include "PatchTable.h"
+#include "Arena.h"
+#include <limits>
+#include <sstream>
+
+namespace
+{
+	// files of the columns that aren't FeatureColumn values, in out_ order after the float columns
+	const char* const HISTOGRAM_FILE = "hist.u8";
+	const char* const SAMPLE_FILE = "sample.u32";
+	const char* const CLASS_FILE = "class.u16";
+	const char* const CELL_FILE = "cell.u16";
+	const char* const SAMPLES_FILE = "samples.tsv";
+
+	const size_t HISTOGRAM_ROW = 3 * FeatureIndex::HISTOGRAM_BINS;
+
+	std::string Join(const std::string& dir, const std::string& file)
+	{
+		return (fs::path(dir) / file).string();
+	}
+
+	// columns are trimmed to the rows of the listed samples, which removes a torn append
+	void Trim(const std::string& file, const size_t bytes)
+	{
+		const fs::path p(file);
+		if (!fs::exists(p))
+		{
+			ofstream create(file, ios::binary);
+			return;
+		}
+
+		if (fs::file_size(p) < bytes) throw runtime_error("Feature index column " + file + " is shorter than its samples");
+		if (fs::file_size(p) > bytes) fs::resize_file(p, bytes);
+	}
+}
+
+std::string FeatureIndex::ColumnName(const FeatureColumn column)
+{
+	static const char* const names[FLOAT_COLUMNS] = { "entropy0", "entropy1", "entropy2", "averageEntropy", "mean0", "mean1", "mean2" };
+
+	return names[static_cast<int>(column)];
+}
+
+std::string FeatureIndex::ClassName(const std::string& samplePath)
+{
+	return fs::path(samplePath).parent_path().filename().string();
+}
+
+int FeatureIndex::ClassId(const std::string& name) const
+{
+	const auto it = classIds_.find(name);
+
+	return it == classIds_.end() ? -1 : it->second;
+}
+
+void FeatureIndex::ReadSamples()
+{
+	samplePaths_.clear();
+	sampleIds_.clear();
+	sampleClasses_.clear();
+	classes_.clear();
+	classIds_.clear();
+	rows_ = 0;
+
+	ifstream in(Join(dir_, SAMPLES_FILE), ios::binary);
+	std::string content((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+
+	// only newline terminated lines were completely written
+	size_t begin = 0, end;
+	while ((end = content.find('\n', begin)) != std::string::npos)
+	{
+		std::istringstream line(content.substr(begin, end - begin));
+		begin = end + 1;
+
+		uint32_t id;
+		std::string className, path;
+		size_t patches;
+		if (!(line >> id) || line.get() != '\t' || !std::getline(line, className, '\t') || !(line >> patches)
+			|| line.get() != '\t' || !std::getline(line, path) || id != samplePaths_.size())
+		{
+			throw runtime_error("Malformed line in " + Join(dir_, SAMPLES_FILE));
+		}
+
+		if (!classIds_.count(className))
+		{
+			classIds_[className] = static_cast<int>(classes_.size());
+			classes_.push_back(className);
+		}
+
+		sampleIds_[path] = id;
+		samplePaths_.push_back(path);
+		sampleClasses_.push_back(static_cast<uint16_t>(classIds_[className]));
+		rows_ += patches;
+	}
+}
+
+FeatureIndex FeatureIndex::Append(const std::string& dir)
+{
+	FeatureIndex index;
+	index.dir_ = dir;
+	fs::create_directories(fs::path(dir));
+	index.ReadSamples();
+
+	//rewrite the sample list without a torn last line, then trim every column to its rows
+	{
+		const auto temp = Join(dir, std::string(SAMPLES_FILE) + ".tmp");
+		{
+			ofstream out(temp, ios::binary | ios::trunc);
+			ifstream in(Join(dir, SAMPLES_FILE), ios::binary);
+			std::string line;
+			for (size_t i = 0; i < index.samplePaths_.size() && std::getline(in, line); i++) out << line << '\n';
+		}
+		fs::rename(fs::path(temp), fs::path(Join(dir, SAMPLES_FILE)));
+	}
+
+	std::vector<std::pair<std::string, size_t>> files;
+	for (auto c = 0; c < FLOAT_COLUMNS; c++) files.emplace_back(ColumnName(static_cast<FeatureColumn>(c)) + ".f32", sizeof(float));
+	files.emplace_back(HISTOGRAM_FILE, HISTOGRAM_ROW);
+	files.emplace_back(SAMPLE_FILE, sizeof(uint32_t));
+	files.emplace_back(CLASS_FILE, sizeof(uint16_t));
+	files.emplace_back(CELL_FILE, sizeof(uint16_t));
+
+	for (size_t f = 0; f < files.size(); f++)
+	{
+		const auto file = Join(dir, files[f].first);
+		Trim(file, index.rows_ * files[f].second);
+		index.out_[f].reset(new ofstream(file, ios::binary | ios::app));
+	}
+	index.samplesOut_.reset(new ofstream(Join(dir, SAMPLES_FILE), ios::binary | ios::app));
+
+	return index;
+}
+
+FeatureIndex FeatureIndex::Open(const std::string& dir)
+{
+	FeatureIndex index;
+	index.dir_ = dir;
+	index.ReadSamples();
+
+	for (auto c = 0; c < FLOAT_COLUMNS; c++)
+	{
+		index.columns_[c] = MappedFile(Join(dir, ColumnName(static_cast<FeatureColumn>(c)) + ".f32"));
+		if (index.columns_[c].Size() < index.rows_ * sizeof(float)) throw runtime_error("Feature index column is shorter than its samples");
+	}
+
+	index.histogram_ = MappedFile(Join(dir, HISTOGRAM_FILE));
+	index.sample_ = MappedFile(Join(dir, SAMPLE_FILE));
+	index.class_ = MappedFile(Join(dir, CLASS_FILE));
+	index.cell_ = MappedFile(Join(dir, CELL_FILE));
+
+	if (index.histogram_.Size() < index.rows_ * HISTOGRAM_ROW || index.sample_.Size() < index.rows_ * sizeof(uint32_t)
+		|| index.class_.Size() < index.rows_ * sizeof(uint16_t) || index.cell_.Size() < index.rows_ * sizeof(uint16_t))
+	{
+		throw runtime_error("Feature index column is shorter than its samples");
+	}
+
+	return index;
+}
+
+vector<FeatureIndex::Row> FeatureIndex::Measure(Sample& s, const cv::Size& patchSize)
+{
+	s.DetermineMinimumNumberOfPatchZones(patchSize.height, patchSize.width);
+	s.GeneratePatchProposals(patchSize);
+
+	const auto& coordinates = s.PatchesCoordinates();
+	vector<Row> rows(coordinates.size());
+	cv::Mat img;
+
+	for (size_t i = 0; i < coordinates.size(); i++)
+	{
+		s.ExtractPatch(img, coordinates[i]);
+		const auto pixels = static_cast<int>(img.total());
+		const auto histogram = PatchTable::ComputeHistogram(img);
+		const auto e = PatchTable::ComputeEntropy(histogram, pixels);
+		auto& row = rows[i];
+
+		for (auto c = 0; c < 3; c++)
+		{
+			const auto counts = histogram.ptr<float>(c);
+			double sum = 0;
+			for (auto b = 0; b < 256; b++) sum += counts[b] * b;
+
+			row.values[c] = static_cast<float>(e[c]);
+			row.values[static_cast<int>(FeatureColumn::mean0) + c] = pixels > 0 ? static_cast<float>(sum / pixels) : 0.0f;
+
+			//256 levels folded into HISTOGRAM_BINS bins, stored as the share of the patch
+			const auto width = 256 / HISTOGRAM_BINS;
+			for (auto q = 0; q < HISTOGRAM_BINS; q++)
+			{
+				float bin = 0;
+				for (auto b = q * width; b < (q + 1) * width; b++) bin += counts[b];
+				row.histogram[c * HISTOGRAM_BINS + q] = static_cast<uint8_t>(pixels > 0 ? cvRound(bin * 255.0 / pixels) : 0);
+			}
+		}
+
+		row.values[static_cast<int>(FeatureColumn::averageEntropy)] = static_cast<float>((e[0] + e[1] + e[2]) / 3.0);
+		row.cell = static_cast<uint16_t>(i);
+		img.release();
+	}
+
+	return rows;
+}
+
+void FeatureIndex::AppendSample(const std::string& path, const vector<Row>& rows)
+{
+	if (!samplesOut_) throw runtime_error("Feature index wasn't opened for appending");
+
+	const auto className = ClassName(path);
+	if (!classIds_.count(className))
+	{
+		classIds_[className] = static_cast<int>(classes_.size());
+		classes_.push_back(className);
+	}
+	const auto classId = static_cast<uint16_t>(classIds_[className]);
+	const auto id = static_cast<uint32_t>(samplePaths_.size());
+
+	//column at a time, each file gets one contiguous write
+	vector<float> floats(rows.size());
+	for (auto c = 0; c < FLOAT_COLUMNS; c++)
+	{
+		for (size_t r = 0; r < rows.size(); r++) floats[r] = rows[r].values[c];
+		out_[c]->write(reinterpret_cast<const char*>(floats.data()), floats.size() * sizeof(float));
+	}
+
+	for (const auto& row : rows) out_[FLOAT_COLUMNS]->write(reinterpret_cast<const char*>(row.histogram), HISTOGRAM_ROW);
+
+	const vector<uint32_t> samples(rows.size(), id);
+	const vector<uint16_t> classes(rows.size(), classId);
+	vector<uint16_t> cells(rows.size());
+	for (size_t r = 0; r < rows.size(); r++) cells[r] = rows[r].cell;
+
+	out_[FLOAT_COLUMNS + 1]->write(reinterpret_cast<const char*>(samples.data()), samples.size() * sizeof(uint32_t));
+	out_[FLOAT_COLUMNS + 2]->write(reinterpret_cast<const char*>(classes.data()), classes.size() * sizeof(uint16_t));
+	out_[FLOAT_COLUMNS + 3]->write(reinterpret_cast<const char*>(cells.data()), cells.size() * sizeof(uint16_t));
+
+	for (auto& out : out_)
+	{
+		out->flush();
+		if (!*out) throw runtime_error("Unable to append to the feature index " + dir_);
+	}
+
+	//the sample line goes last, rows without it are ignored and trimmed by the next Append
+	*samplesOut_ << id << '\t' << className << '\t' << rows.size() << '\t' << path << '\n';
+	samplesOut_->flush();
+
+	sampleIds_[path] = id;
+	samplePaths_.push_back(path);
+	sampleClasses_.push_back(classId);
+	rows_ += rows.size();
+}
+
+size_t FeatureIndex::Build(const std::string& dir, const vector<std::string>& samples, const cv::Size& inputSize,
+	const bool roundUp, const cv::Size& patchSize, ThreadPool& pool)
+{
+	auto index = Append(dir);
+
+	vector<std::string> pending;
+	for (const auto& sample : samples)
+	{
+		if (!index.Contains(sample)) pending.push_back(sample);
+	}
+
+	// bounded batches: features are computed in parallel, appended in sample order
+	const auto batch = (std::max)(static_cast<size_t>(1), pool.Size() * 4);
+	size_t appended = 0;
+
+	for (size_t begin = 0; begin < pending.size(); begin += batch)
+	{
+		const auto end = (std::min)(begin + batch, pending.size());
+		vector<vector<Row>> rows(end - begin);
+		vector<char> ok(end - begin, 0);
+
+		pool.ParallelFor(begin, end, [&](const size_t i)
+		{
+			const auto image = cv::imread(pending[i], IMREAD_COLOR);
+			if (image.empty()) return;
+
+			ArenaScope arena;
+			Sample s(pending[i]);
+			s.FromMat(image, inputSize, roundUp);
+			rows[i - begin] = Measure(s, patchSize);
+			ok[i - begin] = 1;
+		});
+
+		for (auto i = begin; i < end; i++)
+		{
+			if (!ok[i - begin])
+			{
+				cerr << "Skipping unreadable sample " << pending[i] << endl;
+				continue;
+			}
+
+			index.AppendSample(pending[i], rows[i - begin]);
+			appended++;
+		}
+
+		cout << "Indexed " << begin + (end - begin) << "/" << pending.size() << " samples\n";
+	}
+
+	return appended;
+}
+
+vector<float> FeatureIndex::Gather(const FeatureColumn column, const int classId) const
+{
+	const auto values = columns_[static_cast<int>(column)].As<float>();
+	if (classId < 0) return vector<float>(values, values + rows_);
+
+	const auto classes = class_.As<uint16_t>();
+	vector<float> gathered;
+	for (size_t r = 0; r < rows_; r++)
+	{
+		if (classes[r] == classId) gathered.push_back(values[r]);
+	}
+
+	return gathered;
+}
+
+float FeatureIndex::Percentile(const FeatureColumn column, const double q, const int classId) const
+{
+	return Percentiles(column, { q }, classId)[0];
+}
+
+vector<float> FeatureIndex::Percentiles(const FeatureColumn column, const vector<double>& q, const int classId) const
+{
+	auto values = Gather(column, classId);
+	vector<float> result(q.size(), std::numeric_limits<float>::quiet_NaN());
+	if (values.empty()) return result;
+
+	//nearest rank, ranks are visited in increasing order so every nth_element works on what is left
+	vector<size_t> order(q.size());
+	for (size_t i = 0; i < q.size(); i++) order[i] = i;
+	std::sort(order.begin(), order.end(), [&](const size_t a, const size_t b) { return q[a] < q[b]; });
+
+	auto first = values.begin();
+	for (const auto i : order)
+	{
+		const auto clamped = (std::max)(0.0, (std::min)(100.0, q[i]));
+		const auto rank = static_cast<size_t>(ceil(clamped / 100.0 * values.size()));
+		const auto nth = values.begin() + (rank == 0 ? 0 : rank - 1);
+
+		std::nth_element(first, nth, values.end());
+		result[i] = *nth;
+		first = nth;
+	}
+
+	return result;
+}
+
+double FeatureIndex::PercentileRank(const FeatureColumn column, const float value, const int classId) const
+{
+	const auto values = columns_[static_cast<int>(column)].As<float>();
+	const auto classes = class_.As<uint16_t>();
+	size_t below = 0, total = 0;
+
+	for (size_t r = 0; r < rows_; r++)
+	{
+		if (classId >= 0 && classes[r] != classId) continue;
+		total++;
+		if (values[r] < value) below++;
+	}
+
+	return total > 0 ? static_cast<double>(below) / static_cast<double>(total) : 0.0;
+}
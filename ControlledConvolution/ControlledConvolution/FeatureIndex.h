@@ -0,0 +1,121 @@
+#pragma once
+#ifndef FEATURE_INDEX_H
+#define FEATURE_INDEX_H
+#include "stdafx.h"
+#include "MappedFile.h"
+#include "sample.h"
+#include "ThreadPool.h"
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <memory>
+
+/// <summary>
+/// Float columns of the index, one value per patch.
+/// </summary>
+enum class FeatureColumn { entropy0, entropy1, entropy2, averageEntropy, mean0, mean1, mean2 };
+
+/*
+ * Dataset wide, columnar index of per patch features.
+ *
+ * An index directory holds one raw little endian file per column, all with one row per patch:
+ *   <column>.f32 - FeatureColumn values
+ *   hist.u8      - HISTOGRAM_BINS bins per channel (B, G, R), each the share of the patch in 1/255
+ *   sample.u32   - row in samples.tsv the patch belongs to
+ *   class.u16    - class of that sample (its parent directory)
+ *   cell.u16     - grid index of the patch (proposal order)
+ * and samples.tsv (id, class, patches, path) with a line per sample, written after its rows.
+ *
+ * Samples are appended as they complete, so an index can be built in several runs. Readers map
+ * the columns and only trust the rows of samples listed in samples.tsv, which drops a torn append.
+ */
+class FeatureIndex
+{
+public:
+	static const int HISTOGRAM_BINS = 16;
+	static const int FLOAT_COLUMNS = 7;
+
+	/// <summary>
+	/// Features of one patch.
+	/// </summary>
+	struct Row
+	{
+		float values[FLOAT_COLUMNS];
+		uint8_t histogram[3 * HISTOGRAM_BINS];
+		uint16_t cell;
+	};
+
+	/// <summary>
+	/// Opens (or creates) the index in dir for appending.
+	/// </summary>
+	static FeatureIndex Append(const std::string& dir);
+	/// <summary>
+	/// Maps an existing index for queries.
+	/// </summary>
+	static FeatureIndex Open(const std::string& dir);
+
+	/// <summary>
+	/// Splits every sample into patchSize patches, computes the features on pool and appends them
+	/// in sample order. Samples already in the index are skipped.
+	/// </summary>
+	/// <returns>number of samples appended.</returns>
+	static size_t Build(const std::string& dir, const vector<std::string>& samples, const cv::Size& inputSize,
+		bool roundUp, const cv::Size& patchSize, ThreadPool& pool);
+
+	static vector<Row> Measure(Sample& s, const cv::Size& patchSize);
+
+	void AppendSample(const std::string& path, const vector<Row>& rows);
+	bool Contains(const std::string& path) const { return sampleIds_.count(path) != 0; }
+
+	size_t Rows() const { return rows_; }
+	size_t Samples() const { return samplePaths_.size(); }
+	const vector<std::string>& Classes() const { return classes_; }
+	int ClassId(const std::string& name) const;
+
+	float Value(FeatureColumn column, size_t row) const { return columns_[static_cast<int>(column)].As<float>()[row]; }
+	const uint8_t* Histogram(size_t row) const { return histogram_.As<uint8_t>() + row * 3 * HISTOGRAM_BINS; }
+	uint32_t SampleOf(size_t row) const { return sample_.As<uint32_t>()[row]; }
+	uint16_t ClassOf(size_t row) const { return class_.As<uint16_t>()[row]; }
+	uint16_t CellOf(size_t row) const { return cell_.As<uint16_t>()[row]; }
+
+	/// <summary>
+	/// q-th percentile (0..100, nearest rank) of a column, over every patch or over the patches of one class.
+	/// </summary>
+	float Percentile(FeatureColumn column, double q, int classId = -1) const;
+	/// <summary>
+	/// Percentiles of several q at once, the column is gathered and partially sorted once.
+	/// </summary>
+	vector<float> Percentiles(FeatureColumn column, const vector<double>& q, int classId = -1) const;
+	/// <summary>
+	/// Share (0..1) of the patches (of a class) whose value is below value.
+	/// </summary>
+	double PercentileRank(FeatureColumn column, float value, int classId = -1) const;
+
+	static std::string ColumnName(FeatureColumn column);
+	static std::string ClassName(const std::string& samplePath);
+
+private:
+	FeatureIndex() = default;
+	void ReadSamples();
+	vector<float> Gather(FeatureColumn column, int classId) const;
+
+	std::string dir_;
+	size_t rows_ = 0;
+	vector<std::string> samplePaths_;
+	vector<std::string> classes_;
+	std::map<std::string, int> classIds_;
+	std::map<std::string, uint32_t> sampleIds_;
+	vector<uint16_t> sampleClasses_;
+
+	// query side
+	MappedFile columns_[FLOAT_COLUMNS];
+	MappedFile histogram_;
+	MappedFile sample_;
+	MappedFile class_;
+	MappedFile cell_;
+
+	// append side
+	std::unique_ptr<std::ofstream> out_[FLOAT_COLUMNS + 4];
+	std::unique_ptr<std::ofstream> samplesOut_;
+};
+#endif
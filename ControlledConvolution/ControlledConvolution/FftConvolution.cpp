@@ -0,0 +1,128 @@
+#include "stdafx.h"
+#include "FftConvolution.h"
+#include <cmath>
+
+// direct taps one complex multiply-add of a transform costs, per log2 of the padded area
+static const double FFT_TAPS_PER_LOG2 = 3.0;
+static const uint64_t FNV_OFFSET_BASIS = 14695981039346656037ULL;
+static const uint64_t FNV_PRIME = 1099511628211ULL;
+
+static inline uint64_t Fnv1a(uint64_t hash, const void* data, const size_t size)
+{
+	const auto bytes = static_cast<const unsigned char*>(data);
+
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= FNV_PRIME;
+	}
+
+	return hash;
+}
+
+FftConvolution::FftConvolution(const size_t cacheEntries) : capacity_((std::max)(size_t(1), cacheEntries)), hits_(0),
+	misses_(0)
+{
+}
+
+FftConvolution& FftConvolution::Shared()
+{
+	static FftConvolution shared;
+	return shared;
+}
+
+cv::Size FftConvolution::PaddedSize(const cv::Size& image, const cv::Size& kernel)
+{
+	return cv::Size(cv::getOptimalDFTSize(image.width + kernel.width - 1),
+		cv::getOptimalDFTSize(image.height + kernel.height - 1));
+}
+
+double FftConvolution::Cost(const cv::Size& image, const cv::Size& kernel)
+{
+	// a forward and an inverse transform of the padded image and the spectrum product,
+	// shared by the pixels of the image
+	const auto padded = static_cast<double>(PaddedSize(image, kernel).area());
+	return FFT_TAPS_PER_LOG2 * std::log2(padded) * padded / image.area();
+}
+
+cv::Mat FftConvolution::Spectrum(const cv::Mat& kernel, const cv::Size& padded)
+{
+	auto key = FNV_OFFSET_BASIS;
+	const int header[] = { kernel.rows, kernel.cols, kernel.type(), padded.height, padded.width };
+	key = Fnv1a(key, header, sizeof(header));
+	key = Fnv1a(key, kernel.data, kernel.total() * kernel.elemSize());
+
+	const auto same = [&](const Entry& e)
+	{
+		return e.key == key && e.kernel.size() == kernel.size() && e.kernel.type() == kernel.type()
+			&& e.spectrum.size() == padded
+			&& std::equal(kernel.data, kernel.data + kernel.total() * kernel.elemSize(), e.kernel.data);
+	};
+
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		for (auto e = entries_.begin(); e != entries_.end(); ++e)
+		{
+			if (!same(*e)) continue;
+
+			hits_++;
+			entries_.splice(entries_.begin(), entries_, e);
+			return entries_.front().spectrum;
+		}
+	}
+
+	// transformed outside of the lock, a kernel missed by two threads at once is transformed twice
+	misses_++;
+	cv::Mat spectrum = cv::Mat::zeros(padded, kernel.type());
+	kernel.copyTo(spectrum(cv::Rect(0, 0, kernel.cols, kernel.rows)));
+	cv::dft(spectrum, spectrum, 0, kernel.rows);
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	entries_.push_front(Entry{ key, kernel.clone(), spectrum });
+	if (entries_.size() > capacity_) entries_.pop_back();
+
+	return spectrum;
+}
+
+bool FftConvolution::Convolve2D(const cv::Mat& in, cv::Mat& out, const cv::Mat& kernel)
+{
+	// check validity of params
+	if (in.empty() || kernel.empty() || kernel.channels() != 1) return false;
+
+	const auto depth = in.depth();
+	if (depth != CV_8U && depth != CV_16U && depth != CV_16S && depth != CV_32S && depth != CV_32F && depth != CV_64F)
+		return false;
+
+	const auto work = depth == CV_64F ? CV_64F : CV_32F;
+	const auto padded = PaddedSize(in.size(), kernel.size());
+
+	cv::Mat k;
+	kernel.convertTo(k, work);
+	const auto spectrum = Spectrum(k, padded);
+
+	// out(i, j) is the linear convolution at (i + kSizeY - 1 - kCenterY, j + kSizeX - 1 - kCenterX)
+	const cv::Rect window(kernel.cols - 1 - kernel.cols / 2, kernel.rows - 1 - kernel.rows / 2, in.cols, in.rows);
+
+	vector<cv::Mat> planes;
+	cv::split(in, planes);
+
+	cv::Mat buffer(padded, work), product, response;
+	for (auto& plane : planes)
+	{
+		buffer.setTo(0);
+		auto image = buffer(cv::Rect(0, 0, in.cols, in.rows));
+		plane.convertTo(image, work);
+
+		// only the image rows are non zero going in, only the window rows are needed coming out
+		cv::dft(buffer, buffer, 0, in.rows);
+		cv::mulSpectrums(buffer, spectrum, product, 0);
+		cv::dft(product, response, cv::DFT_INVERSE | cv::DFT_SCALE | cv::DFT_REAL_OUTPUT, window.y + in.rows);
+
+		cv::Mat result = response(window);
+		if (depth == CV_8U || depth == CV_16U) result = cv::abs(result);
+		result.convertTo(plane, depth);
+	}
+
+	cv::merge(planes, out);
+	return true;
+}
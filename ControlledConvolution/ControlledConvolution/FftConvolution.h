@@ -0,0 +1,71 @@
+#pragma once
+#ifndef FFT_CONVOLUTION_H
+#define FFT_CONVOLUTION_H
+#include "stdafx.h"
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <mutex>
+
+/*
+ * FFT convolution for kernels too large for the direct loops.
+ *
+ * Every channel is zero padded to an optimal DFT size of at least image + kernel - 1, so the
+ * circular convolution of the spectra is the linear one, and the center originated window is
+ * cut out of the inverse transform. The result is the one of Convolution::Convolve2D up to
+ * floating point rounding (an integer output can be one off where the sum is close to .5).
+ *
+ * Kernel spectra depend only on the kernel and the padded size, they are kept in a small LRU
+ * cache so a kernel applied to many images of one size is transformed once.
+ */
+class FftConvolution
+{
+public:
+	explicit FftConvolution(size_t cacheEntries = 16);
+
+	/// <summary>
+	/// Center originated, zero padded 2D convolution of every channel of in with the single
+	/// channel kernel. out gets the size and type of in, unsigned outputs keep |sum| as
+	/// Convolve2D does. Depths CV_8U, CV_16U, CV_16S, CV_32S, CV_32F and CV_64F; double images
+	/// are transformed in double, all others in float.
+	/// </summary>
+	bool Convolve2D(const cv::Mat& in, cv::Mat& out, const cv::Mat& kernel);
+
+	/// <summary>
+	/// Cost per output pixel, in kernel taps of the direct loops, of convolving an image with
+	/// a kernel of the given size by FFT. Convolution::Select compares it to the direct
+	/// (width * height taps) and separable (width + height taps) costs.
+	/// </summary>
+	static double Cost(const cv::Size& image, const cv::Size& kernel);
+
+	/// <summary>
+	/// DFT size an image is padded to for a kernel.
+	/// </summary>
+	static cv::Size PaddedSize(const cv::Size& image, const cv::Size& kernel);
+
+	/// <summary>
+	/// Instance behind the automatic selection of the Convolution Mat routines.
+	/// </summary>
+	static FftConvolution& Shared();
+
+	size_t Hits() const { return hits_; }
+	size_t Misses() const { return misses_; }
+
+private:
+	struct Entry
+	{
+		uint64_t key;
+		cv::Mat kernel;
+		cv::Mat spectrum;
+	};
+
+	cv::Mat Spectrum(const cv::Mat& kernel, const cv::Size& padded);
+
+	// most recently used first
+	std::list<Entry> entries_;
+	size_t capacity_;
+	std::atomic<size_t> hits_;
+	std::atomic<size_t> misses_;
+	std::mutex mutex_;
+};
+#endif
@@ -1,12 +1,256 @@
 #include "stdafx.h"
-#include "filter.h"
+#include "Filter.h"
+#include <cmath>
+#include <random>
 
+// Winograd F(2x2, 3x3): a 4x4 input tile d and 3x3 kernel g give the 2x2 outputs
+// A^T [(G g G^T) .* (B^T d B)] A
+static const int WINOGRAD_TILE = 4;
+static const int WINOGRAD_OUTPUT = 2;
+static const float WINOGRAD_G[4][3] = { { 1.0f, 0.0f, 0.0f }, { 0.5f, 0.5f, 0.5f }, { 0.5f, -0.5f, 0.5f }, { 0.0f, 0.0f, 1.0f } };
 
-Filter::Filter()
+namespace
 {
+	// B^T d B of a 4x4 tile, in place
+	void InputTransform(float d[4][4])
+	{
+		float t[4][4];
+		for (auto j = 0; j < 4; j++)
+		{
+			t[0][j] = d[0][j] - d[2][j];
+			t[1][j] = d[1][j] + d[2][j];
+			t[2][j] = d[2][j] - d[1][j];
+			t[3][j] = d[1][j] - d[3][j];
+		}
+		for (auto i = 0; i < 4; i++)
+		{
+			d[i][0] = t[i][0] - t[i][2];
+			d[i][1] = t[i][1] + t[i][2];
+			d[i][2] = t[i][2] - t[i][1];
+			d[i][3] = t[i][1] - t[i][3];
+		}
+	}
+
+	// A^T m A of a 4x4 product tile
+	void OutputTransform(const float m[4][4], float y[2][2])
+	{
+		float t[2][4];
+		for (auto j = 0; j < 4; j++)
+		{
+			t[0][j] = m[0][j] + m[1][j] + m[2][j];
+			t[1][j] = m[1][j] - m[2][j] - m[3][j];
+		}
+		for (auto i = 0; i < 2; i++)
+		{
+			y[i][0] = t[i][0] + t[i][1] + t[i][2];
+			y[i][1] = t[i][1] - t[i][2] - t[i][3];
+		}
+	}
+
+	inline float Activate(const float value, const bool relu)
+	{
+		return relu && value < 0.0f ? 0.0f : value;
+	}
+}
+
+Filter::Filter() : outChannels_(0), inChannels_(0), kSizeY_(0), kSizeX_(0), stride_(1), padding_(0)
+{
+}
+
+Filter::Filter(const int outChannels, const int inChannels, const int kSizeY, const int kSizeX,
+	const vector<float>& weights, const vector<float>& bias, const int stride, const int padding)
+	: outChannels_(0), inChannels_(0), kSizeY_(0), kSizeX_(0), stride_(1), padding_(0)
+{
+	// check validity of params, an invalid bank stays empty
+	if (outChannels <= 0 || inChannels <= 0 || kSizeY <= 0 || kSizeX <= 0 || stride <= 0 || padding < 0) return;
+
+	const auto fanIn = inChannels * kSizeY * kSizeX;
+	if (weights.size() != static_cast<size_t>(outChannels) * fanIn) return;
+	if (!bias.empty() && bias.size() != static_cast<size_t>(outChannels)) return;
+
+	outChannels_ = outChannels;
+	inChannels_ = inChannels;
+	kSizeY_ = kSizeY;
+	kSizeX_ = kSizeX;
+	stride_ = stride;
+	padding_ = padding;
+	weights_ = cv::Mat(outChannels, fanIn, CV_32F, const_cast<float*>(weights.data())).clone();
+	bias_ = bias.empty() ? vector<float>(outChannels, 0.0f) : bias;
+
+	if (!SupportsWinograd()) return;
+
+	// G g G^T, 4x4 values per kernel and input channel, gathered by tile position
+	winogradWeights_.assign(WINOGRAD_TILE * WINOGRAD_TILE, cv::Mat());
+	for (auto& m : winogradWeights_) m = cv::Mat(outChannels, inChannels, CV_32F);
+
+	for (auto o = 0; o < outChannels; o++)
+	{
+		for (auto c = 0; c < inChannels; c++)
+		{
+			const auto g = weights_.ptr<float>(o) + c * 9;
+			float gt[4][3];
+			for (auto i = 0; i < 4; i++)
+				for (auto j = 0; j < 3; j++)
+					gt[i][j] = WINOGRAD_G[i][0] * g[j] + WINOGRAD_G[i][1] * g[3 + j] + WINOGRAD_G[i][2] * g[6 + j];
+
+			for (auto i = 0; i < 4; i++)
+				for (auto j = 0; j < 4; j++)
+				{
+					const auto u = gt[i][0] * WINOGRAD_G[j][0] + gt[i][1] * WINOGRAD_G[j][1] + gt[i][2] * WINOGRAD_G[j][2];
+					winogradWeights_[i * WINOGRAD_TILE + j].at<float>(o, c) = u;
+				}
+		}
+	}
 }
 
+Filter Filter::Random(const int outChannels, const int inChannels, const int kSize, const unsigned seed,
+	const int stride)
+{
+	// check validity of params, an even kernel has no center to pad around
+	if (outChannels <= 0 || inChannels <= 0 || kSize <= 0 || kSize % 2 == 0) return Filter();
+
+	std::mt19937 generator(seed);
+	std::normal_distribution<float> normal(0.0f, std::sqrt(2.0f / (inChannels * kSize * kSize)));
+
+	vector<float> weights(static_cast<size_t>(outChannels) * inChannels * kSize * kSize);
+	for (auto& w : weights) w = normal(generator);
 
-Filter::~Filter()
+	return Filter(outChannels, inChannels, kSize, kSize, weights, vector<float>(), stride, kSize / 2);
+}
+
+cv::Size Filter::OutputSize(const cv::Size& input) const
 {
+	if (Empty()) return cv::Size();
+
+	return cv::Size((input.width + 2 * padding_ - kSizeX_) / stride_ + 1,
+		(input.height + 2 * padding_ - kSizeY_) / stride_ + 1);
+}
+
+bool Filter::Forward(const FeatureMap& in, FeatureMap& out, const bool relu, const FilterAlgorithm algorithm,
+	ThreadPool* pool) const
+{
+	// check validity of params
+	if (Empty() || in.Empty() || in.Channels() != inChannels_) return false;
+	if (in.Width() + 2 * padding_ < kSizeX_ || in.Height() + 2 * padding_ < kSizeY_) return false;
+	if (algorithm == FilterAlgorithm::winograd && !SupportsWinograd()) return false;
+
+	const auto winograd = algorithm == FilterAlgorithm::winograd
+		|| (algorithm == FilterAlgorithm::automatic && SupportsWinograd());
+	const auto size = OutputSize(cv::Size(in.Width(), in.Height()));
+	out = FeatureMap(in.Images(), outChannels_, size.height, size.width, in.Layout());
+
+	const auto image = [&](const size_t n)
+	{
+		if (winograd) ForwardWinograd(in, out, static_cast<int>(n), relu);
+		else ForwardIm2Col(in, out, static_cast<int>(n), relu);
+	};
+
+	const auto images = static_cast<size_t>(in.Images());
+	if (pool && images > 1) pool->ParallelFor(0, images, image);
+	else for (size_t n = 0; n < images; n++) image(n);
+
+	return true;
+}
+
+void Filter::ForwardIm2Col(const FeatureMap& in, FeatureMap& out, const int n, const bool relu) const
+{
+	const auto pixels = out.Height() * out.Width();
+	const auto fanIn = weights_.cols;
+
+	// row (c, m, k) holds the input every output pixel weighs with tap (m, k) of channel c
+	thread_local cv::Mat columns;
+	columns.create(fanIn, pixels, CV_32F);
+	for (auto c = 0; c < inChannels_; c++)
+	{
+		for (auto m = 0; m < kSizeY_; m++)
+		{
+			for (auto k = 0; k < kSizeX_; k++)
+			{
+				auto row = columns.ptr<float>((c * kSizeY_ + m) * kSizeX_ + k);
+				for (auto oy = 0; oy < out.Height(); oy++)
+				{
+					const auto y = oy * stride_ + m - padding_;
+					for (auto ox = 0; ox < out.Width(); ox++, row++)
+					{
+						const auto x = ox * stride_ + k - padding_;
+						*row = y < 0 || y >= in.Height() || x < 0 || x >= in.Width() ? 0.0f : in.At(n, c, y, x);
+					}
+				}
+			}
+		}
+	}
+
+	// nchw is outChannels x pixels, nhwc its transpose, both written in place
+	const auto dst = out.Data() + n * out.ImageStride();
+	if (out.Layout() == FeatureLayout::nchw)
+	{
+		cv::Mat result(outChannels_, pixels, CV_32F, dst);
+		cv::gemm(weights_, columns, 1.0, cv::noArray(), 0.0, result);
+	}
+	else
+	{
+		cv::Mat result(pixels, outChannels_, CV_32F, dst);
+		cv::gemm(columns, weights_, 1.0, cv::noArray(), 0.0, result, cv::GEMM_1_T | cv::GEMM_2_T);
+	}
+
+	for (auto o = 0; o < outChannels_; o++)
+	{
+		auto value = dst + o * out.ChannelStride();
+		for (auto p = 0; p < pixels; p++, value += out.ColumnStride())
+			*value = Activate(*value + bias_[o], relu);
+	}
+}
+
+void Filter::ForwardWinograd(const FeatureMap& in, FeatureMap& out, const int n, const bool relu) const
+{
+	const auto tilesY = (out.Height() + WINOGRAD_OUTPUT - 1) / WINOGRAD_OUTPUT;
+	const auto tilesX = (out.Width() + WINOGRAD_OUTPUT - 1) / WINOGRAD_OUTPUT;
+	const auto tiles = tilesY * tilesX;
+	const auto positions = WINOGRAD_TILE * WINOGRAD_TILE;
+
+	// B^T d B of every tile, one inChannels x tiles matrix per tile position
+	thread_local vector<cv::Mat> inputs, products;
+	inputs.resize(positions);
+	products.resize(positions);
+	for (auto& m : inputs) m.create(inChannels_, tiles, CV_32F);
+
+	for (auto c = 0; c < inChannels_; c++)
+	{
+		for (auto t = 0; t < tiles; t++)
+		{
+			const auto y0 = t / tilesX * WINOGRAD_OUTPUT - padding_;
+			const auto x0 = t % tilesX * WINOGRAD_OUTPUT - padding_;
+
+			float d[4][4];
+			for (auto i = 0; i < 4; i++)
+				for (auto j = 0; j < 4; j++)
+				{
+					const auto y = y0 + i, x = x0 + j;
+					d[i][j] = y < 0 || y >= in.Height() || x < 0 || x >= in.Width() ? 0.0f : in.At(n, c, y, x);
+				}
+
+			InputTransform(d);
+			for (auto p = 0; p < positions; p++) inputs[p].at<float>(c, t) = d[p / WINOGRAD_TILE][p % WINOGRAD_TILE];
+		}
+	}
+
+	// the channel sum of every tile position is a GEMM
+	for (auto p = 0; p < positions; p++)
+		cv::gemm(winogradWeights_[p], inputs[p], 1.0, cv::noArray(), 0.0, products[p]);
+
+	for (auto o = 0; o < outChannels_; o++)
+	{
+		for (auto t = 0; t < tiles; t++)
+		{
+			float m[4][4], y[2][2];
+			for (auto p = 0; p < positions; p++) m[p / WINOGRAD_TILE][p % WINOGRAD_TILE] = products[p].at<float>(o, t);
+			OutputTransform(m, y);
+
+			const auto oy = t / tilesX * WINOGRAD_OUTPUT;
+			const auto ox = t % tilesX * WINOGRAD_OUTPUT;
+			for (auto i = 0; i < WINOGRAD_OUTPUT && oy + i < out.Height(); i++)
+				for (auto j = 0; j < WINOGRAD_OUTPUT && ox + j < out.Width(); j++)
+					out.At(n, o, oy + i, ox + j) = Activate(y[i][j] + bias_[o], relu);
+		}
+	}
 }
@@ -1,11 +1,77 @@
 #pragma once
+#ifndef FILTER_H
+#define FILTER_H
+#include "feature_map.h"
+#include "ThreadPool.h"
+
+/// <summary>
+/// How Filter::Forward computes a layer.
+///automatic - winograd where it applies, im2col otherwise
+///im2col - the receptive fields unrolled into a matrix, one GEMM per image
+///winograd - F(2x2, 3x3), 16 multiplies per 2x2 outputs instead of 36; 3x3 kernels at stride 1 only
+/// </summary>
+enum class FilterAlgorithm { automatic, im2col, winograd };
+
+/*
+ * Filter bank of a convolution layer: outChannels stacked kernels of inChannels x kSizeY x kSizeX
+ * weights, and a bias per kernel.
+ *
+ * The layer is the cross correlation deep learning frameworks compute (weights in their
+ * out, in, row, column order load as is), not the flipped kernel of Convolution::Convolve2D.
+ * Inputs are zero padded by padding pixels on every side, outputs are taken every stride pixels.
+ * Winograd results match im2col up to floating point rounding.
+ */
 class Filter
 {
 public:
 	Filter();
-	~Filter();
+	Filter(int outChannels, int inChannels, int kSizeY, int kSizeX, const vector<float>& weights,
+		const vector<float>& bias = vector<float>(), int stride = 1, int padding = 0);
+
+	/// <summary>
+	/// Square kernels with He normal weights (standard deviation sqrt(2 / fan in)) and zero bias,
+	/// the same for a seed. kSize is odd, padding kSize / 2 keeps the size at stride 1.
+	/// </summary>
+	/// <returns>an empty filter for a non-positive size or an even kSize.</returns>
+	static Filter Random(int outChannels, int inChannels, int kSize, unsigned seed, int stride = 1);
+
+	/// <summary>
+	/// Forward pass of every image of in, out gets the layout of in and OutputSize. relu clamps
+	/// the outputs at 0. pool, if given, runs the images.
+	/// </summary>
+	/// <returns>false for an empty filter, an input with other than InChannels channels or too
+	///small for the kernel, and for winograd with a kernel or stride it doesn't apply to.</returns>
+	bool Forward(const FeatureMap& in, FeatureMap& out, bool relu = false,
+		FilterAlgorithm algorithm = FilterAlgorithm::automatic, ThreadPool* pool = nullptr) const;
+
+	/// <summary>
+	/// Output height and width of an input size, not positive if the kernel doesn't fit.
+	/// </summary>
+	cv::Size OutputSize(const cv::Size& input) const;
+
+	bool Empty() const { return weights_.empty(); }
+	bool SupportsWinograd() const { return kSizeX_ == 3 && kSizeY_ == 3 && stride_ == 1; }
+	int OutChannels() const { return outChannels_; }
+	int InChannels() const { return inChannels_; }
+	int KSizeX() const { return kSizeX_; }
+	int KSizeY() const { return kSizeY_; }
+	int Stride() const { return stride_; }
+	int Padding() const { return padding_; }
 
 private:
-	int width_;
-};
+	void ForwardIm2Col(const FeatureMap& in, FeatureMap& out, int n, bool relu) const;
+	void ForwardWinograd(const FeatureMap& in, FeatureMap& out, int n, bool relu) const;
 
+	int outChannels_;
+	int inChannels_;
+	int kSizeY_;
+	int kSizeX_;
+	int stride_;
+	int padding_;
+	// outChannels x (inChannels * kSizeY * kSizeX) CV_32F
+	cv::Mat weights_;
+	vector<float> bias_;
+	// G g G^T of every kernel and input channel, 16 outChannels x inChannels CV_32F, empty without winograd
+	vector<cv::Mat> winogradWeights_;
+};
+#endif
@@ -0,0 +1,99 @@
+#pragma once
+#ifndef FLOAT16_H
+#define FLOAT16_H
+#include <cstdint>
+#include <cstring>
+
+/*
+ * IEEE 754 half precision storage type. Arithmetic happens in float: values convert to float
+ * on read and back, rounded to nearest even, on assignment.
+ */
+struct Float16
+{
+	uint16_t bits;
+
+	Float16() : bits(0)
+	{
+	}
+
+	Float16(const float value) : bits(FromFloat(value))
+	{
+	}
+
+	operator float() const
+	{
+		return ToFloat(bits);
+	}
+
+	static uint16_t FromFloat(const float value)
+	{
+		uint32_t f;
+		std::memcpy(&f, &value, sizeof(f));
+
+		const auto sign = static_cast<uint16_t>((f >> 16) & 0x8000u);
+		const auto exponent = static_cast<int>((f >> 23) & 0xffu) - 127 + 15;
+		auto mantissa = f & 0x7fffffu;
+
+		// inf and nan, nan keeps a mantissa bit
+		if (((f >> 23) & 0xffu) == 0xffu) return static_cast<uint16_t>(sign | 0x7c00u | (mantissa ? 0x200u : 0u));
+		if (exponent >= 31) return static_cast<uint16_t>(sign | 0x7c00u);
+
+		if (exponent <= 0)
+		{
+			// subnormal or zero
+			if (exponent < -10) return sign;
+			mantissa |= 0x800000u;
+			const auto shift = static_cast<uint32_t>(14 - exponent);
+			auto half = mantissa >> shift;
+			const auto rest = mantissa & ((1u << shift) - 1);
+			const auto midway = 1u << (shift - 1);
+			if (rest > midway || (rest == midway && (half & 1u))) half++;
+
+			return static_cast<uint16_t>(sign | half);
+		}
+
+		auto half = static_cast<uint32_t>(exponent << 10) | (mantissa >> 13);
+		const auto rest = mantissa & 0x1fffu;
+		// a carry into the exponent is the correct rounding, up to inf
+		if (rest > 0x1000u || (rest == 0x1000u && (half & 1u))) half++;
+
+		return static_cast<uint16_t>(sign | half);
+	}
+
+	static float ToFloat(const uint16_t h)
+	{
+		const auto sign = static_cast<uint32_t>(h & 0x8000u) << 16;
+		const auto exponent = (h >> 10) & 0x1fu;
+		auto mantissa = static_cast<uint32_t>(h & 0x3ffu);
+		uint32_t f;
+
+		if (exponent == 0x1fu)
+		{
+			f = sign | 0x7f800000u | (mantissa << 13);
+		}
+		else if (exponent != 0)
+		{
+			f = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+		}
+		else if (mantissa == 0)
+		{
+			f = sign;
+		}
+		else
+		{
+			// subnormal, normalize
+			auto e = 127 - 15 + 1;
+			while (!(mantissa & 0x400u))
+			{
+				mantissa <<= 1;
+				e--;
+			}
+			f = sign | (static_cast<uint32_t>(e) << 23) | ((mantissa & 0x3ffu) << 13);
+		}
+
+		float value;
+		std::memcpy(&value, &f, sizeof(value));
+		return value;
+	}
+};
+#endif
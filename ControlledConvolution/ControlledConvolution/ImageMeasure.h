@@ -11,7 +11,7 @@ public:
 	double Channel0Entropy() { return _entropy[0]; }
 	double Channel1Entropy() { return _entropy[1]; }
 	double Channel2Entropy() { return _entropy[2]; }
-	double AverageEntropy() { return (_entropy[0] + _entropy[1] + _entropy[3]) / 3.0; }
+	double AverageEntropy() { return (_entropy[0] + _entropy[1] + _entropy[2]) / 3.0; }
 private:
 	cv::Mat _image;
 	cv::Scalar _entropy;
@@ -1,6 +1,7 @@
 #include "stdafx.h"
 #include "ImageRegister.h"
 #include "Common.h"
+#include "Arena.h"
 #undef max
 
 
@@ -107,22 +108,22 @@ Mat ImageRegister::ComputeJointHistogram(Mat image_1, Mat image_2)
 	 * > Verify this calculation
 	 * > Search a better method to do this.
 	 */
-	Mat jpdf;
+	// Pixels are 8 bit, so only the first 256x256 bins of a histSize x histSize histogram can be hit;
+	// the empty bins add nothing to the entropy. 256 KB from the sample arena instead of 16 MB per call.
+	const auto bins = 256;
 	Size image_size = image_1.size();
-	jpdf = Mat::zeros(histSize, histSize, CV_32FC1);
+	Mat jpdf = ScratchMat(bins, bins, CV_32FC1);
+	jpdf.setTo(Scalar::all(0));
 
 	assert(image_size.height == image_2.size().height, "The two images have different sizes!!");
 
 	for (int i = 0; i < image_size.height; i++)
 	{
+		const auto row_1 = image_1.ptr<uchar>(i);
+		const auto row_2 = image_2.ptr<uchar>(i);
 		for (int j = 0; j < image_size.width; j++)
 		{
-			try {
-				jpdf.at<float>(image_1.at<uchar>(i, j), image_2.at<uchar>(i, j)) = (float)(jpdf.at<float>(image_1.at<uchar>(i, j), image_2.at<uchar>(i, j)) + 1);
-			}
-			catch (...) {
-				continue;
-			}
+			jpdf.at<float>(row_1[j], row_2[j]) += 1.0f;
 		}
 	}
 
@@ -156,13 +157,25 @@ float ImageRegister::ComputeJointEntropy(Mat image_1, Mat image_2)
 	/* TODO
 	 * > Verify this calculation
 	 */
-	float je;
-	Mat jpdf = ComputeJointHistogram(image_1, image_2);
-	jpdf = jpdf / (sum(jpdf).val[0]); // Normalized Joint Histogram       
-	Mat logJP = calLog2(jpdf);
-	je = -1 * sum(jpdf.mul(logJP)).val[0];
+	// the joint histogram is rewound on return, ComputeMutualInformation and the pairwise sorts
+	// call this for every pair of patches
+	ArenaScope scope;
+	const Mat jpdf = ComputeJointHistogram(image_1, image_2);
+	const auto total = sum(jpdf).val[0]; // Normalized Joint Histogram
+	double je = 0;
+
+	for (int i = 0; i < jpdf.rows; i++)
+	{
+		const auto row = jpdf.ptr<float>(i);
+		for (int j = 0; j < jpdf.cols; j++)
+		{
+			if (row[j] == 0) continue;
+			const auto p = row[j] / total;
+			je -= p * log2(p);
+		}
+	}
 
-	return je;
+	return static_cast<float>(je);
 }
 
 float ImageRegister::ComputeMutualInformation(Mat image_1, Mat image_2)
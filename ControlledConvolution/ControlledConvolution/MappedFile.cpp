@@ -0,0 +1,98 @@
+#include "stdafx.h"
+#include "MappedFile.h"
+#include <stdexcept>
+#include <utility>
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const std::string& file)
+{
+#ifdef _WIN32
+	const auto handle = CreateFileA(file.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (handle == INVALID_HANDLE_VALUE) throw std::runtime_error("Unable to open " + file);
+	file_ = handle;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(handle, &size))
+	{
+		Close();
+		throw std::runtime_error("Unable to read the size of " + file);
+	}
+	size_ = static_cast<size_t>(size.QuadPart);
+	if (size_ == 0) return;
+
+	mapping_ = CreateFileMappingA(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	data_ = mapping_ ? MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0) : nullptr;
+#else
+	file_ = open(file.c_str(), O_RDONLY);
+	if (file_ < 0) throw std::runtime_error("Unable to open " + file);
+
+	struct stat info {};
+	if (fstat(file_, &info) != 0)
+	{
+		Close();
+		throw std::runtime_error("Unable to read the size of " + file);
+	}
+	size_ = static_cast<size_t>(info.st_size);
+	if (size_ == 0) return;
+
+	data_ = mmap(nullptr, size_, PROT_READ, MAP_SHARED, file_, 0);
+	if (data_ == MAP_FAILED) data_ = nullptr;
+#endif
+
+	if (!data_)
+	{
+		Close();
+		throw std::runtime_error("Unable to map " + file);
+	}
+}
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+{
+	*this = std::move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+	if (this != &other)
+	{
+		Close();
+		std::swap(data_, other.data_);
+		std::swap(size_, other.size_);
+		std::swap(file_, other.file_);
+#ifdef _WIN32
+		std::swap(mapping_, other.mapping_);
+#endif
+	}
+
+	return *this;
+}
+
+void MappedFile::Close()
+{
+#ifdef _WIN32
+	if (data_) UnmapViewOfFile(data_);
+	if (mapping_) CloseHandle(mapping_);
+	if (file_) CloseHandle(file_);
+	mapping_ = nullptr;
+	file_ = nullptr;
+#else
+	if (data_) munmap(data_, size_);
+	if (file_ >= 0) close(file_);
+	file_ = -1;
+#endif
+	data_ = nullptr;
+	size_ = 0;
+}
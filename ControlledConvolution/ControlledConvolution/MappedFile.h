@@ -0,0 +1,40 @@
+#pragma once
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+#include <cstddef>
+#include <string>
+
+/*
+ * Read only memory mapping of a whole file. An empty file maps to a null view of size 0.
+ */
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	explicit MappedFile(const std::string& file);
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	MappedFile(MappedFile&& other) noexcept;
+	MappedFile& operator=(MappedFile&& other) noexcept;
+
+	const void* Data() const { return data_; }
+	size_t Size() const { return size_; }
+
+	template <typename T>
+	const T* As() const { return static_cast<const T*>(data_); }
+
+private:
+	void Close();
+
+	void* data_ = nullptr;
+	size_t size_ = 0;
+#ifdef _WIN32
+	void* file_ = nullptr;
+	void* mapping_ = nullptr;
+#else
+	int file_ = -1;
+#endif
+};
+#endif
@@ -0,0 +1,67 @@
+#include "stdafx.h"
+#include "PatchShuffleLoader.h"
+
+PatchShuffleLoader::PatchShuffleLoader(const std::string& permutationFile): file_(permutationFile)
+{
+	patch_size_ = cv::Size(file_.Grid().patchWidth, file_.Grid().patchHeight);
+}
+
+cv::Mat PatchShuffleLoader::Decode(const size_t i) const
+{
+	const auto& grid = file_.Grid();
+
+	// Sample::ToCvMat exits on an unreadable image, the loader runs inside its host's process
+	const auto path = SamplePath(i);
+	const auto image = cv::imread(path);
+	if (image.empty()) throw std::runtime_error("PatchShuffleLoader: unable to read sample " + path);
+
+	// decode exactly the way the ordering was computed
+	Sample s(path);
+	s.FromMat(image, cv::Size(grid.inputWidth, grid.inputHeight), grid.roundUp);
+
+	return s.Mat();
+}
+
+cv::Mat PatchShuffleLoader::Load(const size_t i) const
+{
+	cv::Mat output;
+	Shuffle(Decode(i), output, patch_size_, file_.Records()[i].permutation);
+
+	return output;
+}
+
+std::vector<cv::Mat> PatchShuffleLoader::LoadPatches(const size_t i) const
+{
+	const auto mat = Decode(i);
+	const auto& permutation = file_.Records()[i].permutation;
+
+	std::vector<cv::Mat> patches;
+	patches.reserve(permutation.size());
+
+	for (const auto index : permutation)
+	{
+		patches.push_back(mat(GridCell(index, mat.size(), patch_size_)).clone());
+	}
+
+	return patches;
+}
+
+cv::Rect PatchShuffleLoader::GridCell(const int index, const cv::Size& image, const cv::Size& patch)
+{
+	// Sample::ExtractPatch reads the first proposal coordinate (stepping over the width) as the row
+	const auto patchesPerColumn = (image.height + patch.height - 1) / patch.height;
+	const auto startRow = (index / patchesPerColumn) * patch.width;
+	const auto startColumn = (index % patchesPerColumn) * patch.height;
+
+	return cv::Rect(startColumn, startRow, patch.height, patch.width);
+}
+
+void PatchShuffleLoader::Shuffle(const cv::Mat& input, cv::Mat& output, const cv::Size& patch, const std::vector<uint16_t>& permutation)
+{
+	output.create(input.size(), input.type());
+
+	for (size_t i = 0; i < permutation.size(); i++)
+	{
+		input(GridCell(permutation[i], input.size(), patch)).copyTo(output(GridCell(static_cast<int>(i), input.size(), patch)));
+	}
+}
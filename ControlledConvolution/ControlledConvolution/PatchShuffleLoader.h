@@ -0,0 +1,42 @@
+#pragma once
+#ifndef PATCH_SHUFFLE_LOADER_H
+#define PATCH_SHUFFLE_LOADER_H
+#include "stdafx.h"
+#include "PermutationFile.h"
+
+/*
+ * Lazily applies a dataset ordering while decoding the original samples.
+ *
+ * Reads a permutation file written by `ccMain --permutation_only` and produces, per sample,
+ * either the reordered image (patch at position i of the ordering placed in grid cell i) or
+ * the ordered list of patches, without a materialized copy of the reordered dataset.
+ */
+class PatchShuffleLoader
+{
+public:
+	explicit PatchShuffleLoader(const std::string& permutationFile);
+
+	size_t Size() const { return file_.Size(); }
+	std::string SamplePath(const size_t i) const { return file_.Records()[i].sample; }
+	const PermutationGrid& Grid() const { return file_.Grid(); }
+
+	/// <summary>
+	/// Reordered image (Load) or ordered patches (LoadPatches) of sample i.
+	/// Throws std::runtime_error if the sample can't be read.
+	/// </summary>
+	cv::Mat Load(size_t i) const;
+	std::vector<cv::Mat> LoadPatches(size_t i) const;
+
+	/// <summary>
+	/// Cell of the patch grid with the given index, in the order used by Sample::GeneratePatchProposals.
+	/// </summary>
+	static cv::Rect GridCell(int index, const cv::Size& image, const cv::Size& patch);
+	static void Shuffle(const cv::Mat& input, cv::Mat& output, const cv::Size& patch, const std::vector<uint16_t>& permutation);
+
+private:
+	cv::Mat Decode(size_t i) const;
+
+	PermutationFile file_;
+	cv::Size patch_size_;
+};
+#endif
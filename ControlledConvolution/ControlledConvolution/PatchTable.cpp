@@ -0,0 +1,429 @@
+#include "stdafx.h"
+#include "PatchTable.h"
+#include "Arena.h"
+#include "convolution.h"
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <tuple>
+
+// Sobel factors, the derivative along one axis (flipped by the convolution, next less previous
+// pixel) and the smoothing along the other
+static const float SOBEL_DERIVATIVE[] = { 1.0f, 0.0f, -1.0f };
+static const float SOBEL_SMOOTHING[] = { 1.0f, 2.0f, 1.0f };
+static const double DEGREES_PER_RADIAN = 180.0 / CV_PI;
+
+namespace
+{
+	// Sobel derivatives of every patch, visit(i, gx, gy) gets the CV_32F responses of patches[i].
+	// Patches of one size and channel count are tiled into one grid and convolved together.
+	template <typename F>
+	void SobelGradients(const vector<cv::Mat>& patches, const F& visit)
+	{
+		std::map<std::tuple<int, int, int>, vector<int>> groups;
+		for (size_t i = 0; i < patches.size(); i++)
+		{
+			if (patches[i].empty()) continue;
+			groups[std::make_tuple(patches[i].rows, patches[i].cols, patches[i].channels())].push_back(static_cast<int>(i));
+		}
+
+		const cv::Mat derivative(1, 3, CV_32F, const_cast<float*>(SOBEL_DERIVATIVE));
+		const cv::Mat smoothing(1, 3, CV_32F, const_cast<float*>(SOBEL_SMOOTHING));
+		Convolution convolution;
+
+		for (const auto& group : groups)
+		{
+			const auto& members = group.second;
+			vector<cv::Mat> cells(members.size());
+			for (size_t j = 0; j < members.size(); j++) patches[members[j]].convertTo(cells[j], CV_32F);
+
+			const auto columns = static_cast<int>(std::ceil(std::sqrt(static_cast<double>(cells.size()))));
+			const auto grid = Convolution::TilePatches(cells, columns);
+			const cv::Size patch(cells[0].cols, cells[0].rows);
+
+			cv::Mat gx, gy;
+			if (!convolution.Convolve2DSeparablePatches(grid, gx, patch, derivative, smoothing, PatchBorder::clamp)
+				|| !convolution.Convolve2DSeparablePatches(grid, gy, patch, smoothing, derivative, PatchBorder::clamp))
+				continue;
+
+			for (size_t j = 0; j < members.size(); j++)
+			{
+				const auto cell = static_cast<int>(j);
+				const cv::Rect r(cell % columns * patch.width, cell / columns * patch.height, patch.width, patch.height);
+				visit(members[j], gx(r), gy(r));
+			}
+		}
+	}
+}
+
+PatchTable::PatchTable(const vector<Patch>& patches)
+{
+	Reserve(patches.size());
+
+	for (const auto& p : patches)
+	{
+		Add(p.GetMat(), p.GetPatchCoordinates());
+	}
+}
+
+void PatchTable::Reserve(const size_t count)
+{
+	records_.reserve(count);
+	pixels_.reserve(count);
+	histograms_.reserve(count);
+	for (auto& column : entropy_) column.reserve(count);
+	gradientEnergy_.reserve(count);
+	orientation_.reserve(count * ORIENTATION_BINS);
+	dominantOrientation_.reserve(count);
+}
+
+int PatchTable::Add(const cv::Mat& pixels, const Coordinate& c)
+{
+	const auto index = static_cast<int>(records_.size());
+	const auto start = c.Start();
+	const PatchRecord record = { index, static_cast<int16_t>(start.x), static_cast<int16_t>(start.y),
+		static_cast<uint16_t>(pixels.rows), static_cast<uint16_t>(pixels.cols), 0.0f };
+
+	records_.push_back(record);
+	pixels_.push_back(pixels);
+	histograms_.emplace_back();
+	for (auto& column : entropy_) column.push_back(std::numeric_limits<float>::quiet_NaN());
+	gradientEnergy_.push_back(std::numeric_limits<float>::quiet_NaN());
+	orientation_.insert(orientation_.end(), ORIENTATION_BINS, 0.0f);
+	dominantOrientation_.push_back(std::numeric_limits<float>::quiet_NaN());
+
+	return index;
+}
+
+const cv::Mat& PatchTable::Histogram(const int index)
+{
+	if (histograms_[index].empty()) histograms_[index] = ComputeHistogram(pixels_[index]);
+
+	return histograms_[index];
+}
+
+cv::Scalar PatchTable::Entropy(const int index)
+{
+	if (std::isnan(entropy_[0][index]))
+	{
+		const auto e = ComputeEntropy(Histogram(index), static_cast<int>(pixels_[index].total()));
+		for (auto c = 0; c < 3; c++) entropy_[c][index] = static_cast<float>(e[c]);
+	}
+
+	return cv::Scalar(entropy_[0][index], entropy_[1][index], entropy_[2][index]);
+}
+
+float PatchTable::GradientEnergy(const int index)
+{
+	if (std::isnan(gradientEnergy_[index])) gradientEnergy_[index] = ComputeGradientEnergy({ pixels_[index] })[0];
+
+	return gradientEnergy_[index];
+}
+
+const float* PatchTable::OrientationHistogram(const int index)
+{
+	if (std::isnan(dominantOrientation_[index])) FillOrientation(vector<int>{ index });
+
+	return &orientation_[static_cast<size_t>(index) * ORIENTATION_BINS];
+}
+
+float PatchTable::DominantOrientation(const int index)
+{
+	if (std::isnan(dominantOrientation_[index])) FillOrientation(vector<int>{ index });
+
+	return dominantOrientation_[index];
+}
+
+bool PatchTable::IsScalarMeasure(const MeasureType t)
+{
+	return t == MeasureType::averageEntropy || t == MeasureType::channel0Entropy
+		|| t == MeasureType::channel1Entropy || t == MeasureType::channel2Entropy
+		|| t == MeasureType::gradientEnergy || t == MeasureType::dominantOrientation;
+}
+
+bool PatchTable::IsDescriptorMeasure(const MeasureType t)
+{
+	return t == MeasureType::orientationHistogram;
+}
+
+bool PatchTable::Rank(const MeasureType t, const Order& order)
+{
+	if (IsDescriptorMeasure(t))
+	{
+		FillOrientation(Missing(dominantOrientation_));
+		ChainRecords();
+		if (order == Order::decreasing) std::reverse(records_.begin(), records_.end());
+
+		return true;
+	}
+
+	if (!IsScalarMeasure(t)) return false;
+
+	if (t == MeasureType::gradientEnergy)
+	{
+		const auto missing = Missing(gradientEnergy_);
+		vector<cv::Mat> pixels;
+		for (const auto i : missing) pixels.push_back(pixels_[i]);
+
+		const auto energy = ComputeGradientEnergy(pixels);
+		for (size_t i = 0; i < missing.size(); i++) gradientEnergy_[missing[i]] = energy[i];
+
+		for (auto& record : records_) record.key = gradientEnergy_[record.index];
+	}
+	else if (t == MeasureType::dominantOrientation)
+	{
+		FillOrientation(Missing(dominantOrientation_));
+		for (auto& record : records_) record.key = dominantOrientation_[record.index];
+	}
+	else for (auto& record : records_)
+	{
+		const auto e = Entropy(record.index);
+		double value;
+		switch (t)
+		{
+		case MeasureType::channel0Entropy: value = e[0]; break;
+		case MeasureType::channel1Entropy: value = e[1]; break;
+		case MeasureType::channel2Entropy: value = e[2]; break;
+		default: value = (e[0] + e[1] + e[2]) / 3.0; break;
+		}
+		record.key = static_cast<float>(value);
+	}
+
+	vector<PatchRecord> scratch(records_.size());
+	SortRecords(records_, scratch, order != Order::increasing);
+
+	return true;
+}
+
+vector<int> PatchTable::Missing(const vector<float>& column)
+{
+	vector<int> missing;
+	for (size_t i = 0; i < column.size(); i++)
+	{
+		if (std::isnan(column[i])) missing.push_back(static_cast<int>(i));
+	}
+
+	return missing;
+}
+
+void PatchTable::FillOrientation(const vector<int>& indices)
+{
+	if (indices.empty()) return;
+
+	vector<cv::Mat> pixels;
+	pixels.reserve(indices.size());
+	for (const auto i : indices) pixels.push_back(pixels_[i]);
+
+	cv::Mat histograms;
+	vector<float> dominant;
+	ComputeOrientation(pixels, histograms, dominant);
+
+	for (size_t j = 0; j < indices.size(); j++)
+	{
+		const auto row = histograms.ptr<float>(static_cast<int>(j));
+		std::copy(row, row + ORIENTATION_BINS, &orientation_[static_cast<size_t>(indices[j]) * ORIENTATION_BINS]);
+		dominantOrientation_[indices[j]] = dominant[j];
+	}
+}
+
+void PatchTable::ChainRecords()
+{
+	const auto n = records_.size();
+	if (n == 0) return;
+
+	records_[0].key = 0.0f;
+	for (size_t i = 0; i + 1 < n; i++)
+	{
+		const auto current = &orientation_[static_cast<size_t>(records_[i].index) * ORIENTATION_BINS];
+		auto best = i + 1;
+		auto bestDistance = std::numeric_limits<float>::max();
+
+		for (auto j = i + 1; j < n; j++)
+		{
+			const auto other = &orientation_[static_cast<size_t>(records_[j].index) * ORIENTATION_BINS];
+			auto distance = 0.0f;
+			for (auto b = 0; b < ORIENTATION_BINS; b++) distance += (current[b] - other[b]) * (current[b] - other[b]);
+
+			if (distance < bestDistance)
+			{
+				best = j;
+				bestDistance = distance;
+			}
+		}
+
+		//rotated rather than swapped, the remaining records keep their order and ties go to the earlier one
+		std::rotate(records_.begin() + i + 1, records_.begin() + best, records_.begin() + best + 1);
+		records_[i + 1].key = std::sqrt(bestDistance);
+	}
+}
+
+vector<int> PatchTable::Indices() const
+{
+	vector<int> indices;
+	indices.reserve(records_.size());
+	for (const auto& record : records_) indices.push_back(record.index);
+
+	return indices;
+}
+
+void PatchTable::SortRecords(vector<PatchRecord>& records, vector<PatchRecord>& scratch, const bool decreasing)
+{
+	const auto n = records.size();
+	if (n < 2) return;
+
+	//Non negative floats order like their bits, -0 and rounding noise below zero map to 0
+	vector<uint32_t> keys(n), keysScratch(n);
+	for (size_t i = 0; i < n; i++)
+	{
+		const auto value = records[i].key > 0.0f ? records[i].key : 0.0f;
+		uint32_t bits;
+		memcpy(&bits, &value, sizeof bits);
+		keys[i] = decreasing ? ~bits : bits;
+	}
+
+	//LSD radix sort, every pass is a stable counting sort on one byte
+	for (auto shift = 0; shift < 32; shift += 8)
+	{
+		size_t counts[257] = {};
+		for (size_t i = 0; i < n; i++) counts[((keys[i] >> shift) & 0xFF) + 1]++;
+
+		//all keys share this byte, the pass wouldn't move anything
+		if (counts[((keys[0] >> shift) & 0xFF) + 1] == n) continue;
+
+		for (auto b = 0; b < 256; b++) counts[b + 1] += counts[b];
+		for (size_t i = 0; i < n; i++)
+		{
+			const auto to = counts[(keys[i] >> shift) & 0xFF]++;
+			scratch[to] = records[i];
+			keysScratch[to] = keys[i];
+		}
+		records.swap(scratch);
+		keys.swap(keysScratch);
+	}
+}
+
+cv::Mat PatchTable::ComputeHistogram(const cv::Mat& mat)
+{
+	cv::Mat bgr = mat;
+	if (mat.type() != CV_8UC3)
+	{
+		if (mat.channels() == 1) cvtColor(mat, bgr, COLOR_GRAY2BGR);
+		else mat.convertTo(bgr, CV_8UC3);
+	}
+
+	int counts[3][256] = {};
+	for (auto r = 0; r < bgr.rows; r++)
+	{
+		const auto row = bgr.ptr<uchar>(r);
+		for (auto c = 0; c < bgr.cols * 3; c += 3)
+		{
+			counts[0][row[c]]++;
+			counts[1][row[c + 1]]++;
+			counts[2][row[c + 2]]++;
+		}
+	}
+
+	auto histogram = ScratchMat(3, 256, CV_32F);
+	for (auto ch = 0; ch < 3; ch++)
+	{
+		auto out = histogram.ptr<float>(ch);
+		for (auto i = 0; i < 256; i++) out[i] = static_cast<float>(counts[ch][i]);
+	}
+
+	return histogram;
+}
+
+vector<float> PatchTable::ComputeGradientEnergy(const vector<cv::Mat>& patches)
+{
+	vector<float> energy(patches.size(), 0.0f);
+
+	SobelGradients(patches, [&](const int i, const cv::Mat& gx, const cv::Mat& gy)
+	{
+		const auto values = static_cast<double>(gx.total()) * gx.channels();
+		energy[i] = static_cast<float>((gx.dot(gx) + gy.dot(gy)) / values);
+	});
+
+	return energy;
+}
+
+void PatchTable::ComputeOrientation(const vector<cv::Mat>& patches, cv::Mat& histograms, vector<float>& dominant)
+{
+	histograms = cv::Mat::zeros(static_cast<int>(patches.size()), ORIENTATION_BINS, CV_32F);
+	dominant.assign(patches.size(), 0.0f);
+
+	const auto binWidth = 180.0 / ORIENTATION_BINS;
+	SobelGradients(patches, [&](const int i, const cv::Mat& gx, const cv::Mat& gy)
+	{
+		const auto channels = gx.channels();
+		auto histogram = histograms.ptr<float>(i);
+		double sxx = 0, syy = 0, sxy = 0;
+
+		for (auto r = 0; r < gx.rows; r++)
+		{
+			const auto dx = gx.ptr<float>(r);
+			const auto dy = gy.ptr<float>(r);
+			for (auto c = 0; c < gx.cols * channels; c += channels)
+			{
+				//the channel with the strongest gradient, as HOG does for color
+				auto x = dx[c], y = dy[c];
+				for (auto ch = 1; ch < channels; ch++)
+				{
+					if (dx[c + ch] * dx[c + ch] + dy[c + ch] * dy[c + ch] > x * x + y * y)
+					{
+						x = dx[c + ch];
+						y = dy[c + ch];
+					}
+				}
+
+				const auto magnitude = std::sqrt(static_cast<double>(x) * x + static_cast<double>(y) * y);
+				if (magnitude == 0) continue;
+
+				sxx += static_cast<double>(x) * x;
+				syy += static_cast<double>(y) * y;
+				sxy += static_cast<double>(x) * y;
+
+				//unsigned orientation split between the two nearest bin centers
+				auto angle = std::atan2(y, x) * DEGREES_PER_RADIAN;
+				if (angle < 0) angle += 180.0;
+				const auto position = angle / binWidth - 0.5;
+				const auto lower = static_cast<int>(std::floor(position));
+				const auto fraction = position - lower;
+				histogram[(lower + ORIENTATION_BINS) % ORIENTATION_BINS] += static_cast<float>(magnitude * (1.0 - fraction));
+				histogram[(lower + 1) % ORIENTATION_BINS] += static_cast<float>(magnitude * fraction);
+			}
+		}
+
+		auto norm = 0.0;
+		for (auto b = 0; b < ORIENTATION_BINS; b++) norm += static_cast<double>(histogram[b]) * histogram[b];
+		norm = std::sqrt(norm);
+		if (norm > 0)
+		{
+			for (auto b = 0; b < ORIENTATION_BINS; b++) histogram[b] = static_cast<float>(histogram[b] / norm);
+		}
+
+		//orientation of the structure tensor's major axis, 0 for a flat or isotropic patch
+		auto angle = 0.5 * std::atan2(2.0 * sxy, sxx - syy) * DEGREES_PER_RADIAN;
+		if (angle < 0) angle += 180.0;
+		dominant[i] = static_cast<float>(angle >= 180.0 ? 0.0 : angle);
+	});
+}
+
+cv::Scalar PatchTable::ComputeEntropy(const cv::Mat& histogram, const int pixels)
+{
+	cv::Scalar e(0, 0, 0);
+	if (pixels <= 0) return e;
+
+	for (auto ch = 0; ch < 3; ch++)
+	{
+		const auto bins = histogram.ptr<float>(ch);
+		for (auto i = 0; i < histogram.cols; i++)
+		{
+			if (bins[i] == 0) continue;
+			const auto p = bins[i] / pixels;
+			e.val[ch] += -p * log10(p);
+		}
+	}
+
+	return e;
+}
@@ -0,0 +1,108 @@
+#pragma once
+#ifndef PATCH_TABLE_H
+#define PATCH_TABLE_H
+#include "stdafx.h"
+#include "Patch.h"
+#include "Reconstructor.h"
+#include <cstdint>
+
+/// <summary>
+/// Slim, trivially copyable patch record. Sorting shuffles these 16 byte records only,
+/// pixels, histograms and features stay in the side tables of the PatchTable, keyed by index.
+/// </summary>
+struct PatchRecord
+{
+	int32_t index;		// position in the side tables (proposal order)
+	int16_t row;		// start row
+	int16_t column;		// start column
+	uint16_t rows;
+	uint16_t columns;
+	float key;			// scalar feature of the current ordering
+};
+
+static_assert(sizeof(PatchRecord) == 16, "PatchRecord must stay 16 bytes");
+
+/*
+ * Patches of one sample in structure of arrays form.
+ *
+ * records_ - PatchRecord per patch, the only array reordered by Rank
+ * pixels_ - patch pixels (views into the sample, not copies)
+ * histograms_ - 3x256 CV_32F per patch (B, G, R), computed on first use
+ * entropy_ - one column per channel, NaN until computed
+ * gradientEnergy_ - mean squared Sobel gradient magnitude, NaN until computed
+ * orientation_ - ORIENTATION_BINS values per patch, valid once dominantOrientation_ isn't NaN
+ * dominantOrientation_ - degrees, NaN until computed
+ */
+class PatchTable
+{
+public:
+	static const int ORIENTATION_BINS = 9;
+
+	PatchTable() = default;
+	explicit PatchTable(const vector<Patch>& patches);
+
+	void Reserve(size_t count);
+	int Add(const cv::Mat& pixels, const Coordinate& c);
+	size_t Size() const { return records_.size(); }
+
+	const vector<PatchRecord>& Records() const { return records_; }
+	const cv::Mat& Pixels(const int index) const { return pixels_[index]; }
+	const cv::Mat& Histogram(int index);
+	cv::Scalar Entropy(int index);
+	float GradientEnergy(int index);
+	const float* OrientationHistogram(int index);
+	float DominantOrientation(int index);
+
+	/// <summary>
+	/// Orders the records by a per patch measure. Scalars (averageEntropy, channel0/1/2Entropy,
+	///gradientEnergy, dominantOrientation) are computed once and the records radix sorted (stable)
+	///on the float bits of the key. Descriptors (orientationHistogram) are computed once and the
+	///records chained from the first one, each followed by the nearest remaining one (L2), key the
+	///distance to its predecessor; order decreasing reverses the chain.
+	///Gradient features of all patches still missing them are computed in one batch.
+	/// </summary>
+	/// <returns>false if the measure isn't a per patch scalar or descriptor.</returns>
+	bool Rank(MeasureType t, const Order& order);
+
+	/// <summary>
+	/// Index of the record at every position.
+	/// </summary>
+	vector<int> Indices() const;
+
+	static bool IsScalarMeasure(MeasureType t);
+	static bool IsDescriptorMeasure(MeasureType t);
+	static cv::Mat ComputeHistogram(const cv::Mat& mat);
+	static cv::Scalar ComputeEntropy(const cv::Mat& histogram, int pixels);
+
+	/// <summary>
+	/// Gradient energy of every patch: the mean, over pixels and channels, of gx^2 + gy^2 with the
+	///3x3 Sobel derivatives, the patch's edge pixels repeated outside of it. Patches of one size and
+	///channel count are tiled into one grid and convolved together (Convolution::Convolve2DSeparablePatches).
+	/// </summary>
+	/// <returns>entry i is the energy of patches[i], 0 for an empty patch.</returns>
+	static vector<float> ComputeGradientEnergy(const vector<cv::Mat>& patches);
+
+	/// <summary>
+	/// HOG like orientation features of every patch from the batched Sobel gradients of ComputeGradientEnergy.
+	///At every pixel the channel with the strongest gradient votes its magnitude into ORIENTATION_BINS
+	///unsigned orientation bins (0 to 180 degrees), split linearly between the two nearest bin centers.
+	/// </summary>
+	/// <param name="histograms">patches.size() x ORIENTATION_BINS CV_32F, rows L2 normalized (zero for a flat patch).</param>
+	/// <param name="dominant">orientation of the structure tensor's major axis in degrees, [0, 180).</param>
+	static void ComputeOrientation(const vector<cv::Mat>& patches, cv::Mat& histograms, vector<float>& dominant);
+
+private:
+	static void SortRecords(vector<PatchRecord>& records, vector<PatchRecord>& scratch, bool decreasing);
+	static vector<int> Missing(const vector<float>& column);
+	void FillOrientation(const vector<int>& indices);
+	void ChainRecords();
+
+	vector<PatchRecord> records_;
+	vector<cv::Mat> pixels_;
+	vector<cv::Mat> histograms_;
+	vector<float> entropy_[3];
+	vector<float> gradientEnergy_;
+	vector<float> orientation_;
+	vector<float> dominantOrientation_;
+};
+#endif
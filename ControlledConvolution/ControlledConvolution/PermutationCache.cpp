@@ -0,0 +1,123 @@
+#include "stdafx.h"
+#include "PermutationCache.h"
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+static const uint32_t PERMUTATION_MAGIC = 0x4d524550; // "PERM"
+// 2: entropy orderings are radix sorted, ties keep grid order
+// 3: entropy reads the full per channel histogram (it read past a 4x1 mean before)
+static const uint32_t PERMUTATION_VERSION = 3;
+static const uint64_t FNV_OFFSET_BASIS = 14695981039346656037ULL;
+static const uint64_t FNV_PRIME = 1099511628211ULL;
+
+static inline uint64_t Fnv1a(uint64_t hash, const void* data, const size_t size)
+{
+	const auto bytes = static_cast<const unsigned char*>(data);
+
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= FNV_PRIME;
+	}
+
+	return hash;
+}
+
+PermutationCache::PermutationCache(const std::string& dir): hits_(0), misses_(0)
+{
+	dir_ = dir;
+
+	const fs::path p(dir_);
+	if (!fs::exists(p)) fs::create_directories(p);
+}
+
+uint64_t PermutationCache::Hash(const cv::Mat& mat, const cv::Size& patchSize, const std::string& measure, const std::string& ordering)
+{
+	auto hash = FNV_OFFSET_BASIS;
+
+	const int header[] = { static_cast<int>(PERMUTATION_VERSION), mat.rows, mat.cols, mat.type(), patchSize.height, patchSize.width };
+	hash = Fnv1a(hash, header, sizeof(header));
+	hash = Fnv1a(hash, measure.data(), measure.size());
+	hash = Fnv1a(hash, ordering.data(), ordering.size());
+
+	// hash row by row, the decoded sample isn't guaranteed to be continuous
+	const auto rowBytes = static_cast<size_t>(mat.cols) * mat.elemSize();
+	for (auto r = 0; r < mat.rows; r++)
+	{
+		hash = Fnv1a(hash, mat.ptr(r), rowBytes);
+	}
+
+	return hash;
+}
+
+bool PermutationCache::Lookup(const uint64_t key, Permutation& permutation)
+{
+	ifstream file(FileName(key), ios::binary);
+
+	if (!file.is_open())
+	{
+		misses_++;
+		return false;
+	}
+
+	uint32_t magic = 0, version = 0, count = 0;
+	file.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+	file.read(reinterpret_cast<char*>(&version), sizeof(version));
+	file.read(reinterpret_cast<char*>(&count), sizeof(count));
+
+	if (!file || magic != PERMUTATION_MAGIC || version != PERMUTATION_VERSION)
+	{
+		cerr << "Ignoring corrupted cache entry " << FileName(key) << endl;
+		misses_++;
+		return false;
+	}
+
+	permutation.resize(count);
+	file.read(reinterpret_cast<char*>(permutation.data()), count * sizeof(int));
+
+	if (!file)
+	{
+		cerr << "Ignoring truncated cache entry " << FileName(key) << endl;
+		permutation.clear();
+		misses_++;
+		return false;
+	}
+
+	hits_++;
+	return true;
+}
+
+void PermutationCache::Store(const uint64_t key, const Permutation& permutation) const
+{
+	// write to a temporary file first so that an interrupted run never leaves a partial entry behind
+	const auto target = FileName(key);
+	const auto temp = target + ".tmp";
+	{
+		ofstream file(temp, ios::binary | ios::trunc);
+
+		if (!file.is_open())
+		{
+			cerr << "Unable to write cache entry " << target << endl;
+			return;
+		}
+
+		const auto count = static_cast<uint32_t>(permutation.size());
+		file.write(reinterpret_cast<const char*>(&PERMUTATION_MAGIC), sizeof(PERMUTATION_MAGIC));
+		file.write(reinterpret_cast<const char*>(&PERMUTATION_VERSION), sizeof(PERMUTATION_VERSION));
+		file.write(reinterpret_cast<const char*>(&count), sizeof(count));
+		file.write(reinterpret_cast<const char*>(permutation.data()), count * sizeof(int));
+	}
+
+	std::error_code ec;
+	fs::rename(temp, target, ec);
+	if (ec) fs::remove(temp, ec);
+}
+
+std::string PermutationCache::FileName(const uint64_t key) const
+{
+	std::ostringstream oss;
+	oss << std::hex << std::setw(16) << std::setfill('0') << key;
+
+	return (fs::path(dir_) / (oss.str() + ".perm")).string();
+}
@@ -0,0 +1,44 @@
+#pragma once
+#ifndef PERMUTATION_CACHE_H
+#define PERMUTATION_CACHE_H
+#include "stdafx.h"
+#include "sample.h"
+#include <cstdint>
+
+/*
+ * Persistent on-disk cache of patch orderings.
+ *
+ * The ordering of a sample only depends on the decoded, resized pixels and on the
+ * (patch size, measure, order) triple, so a permutation computed once can be reused by
+ * every later run over the same dataset. Each entry is stored in its own file named after
+ * the 64 bit key: <dir>/<key>.perm
+ */
+class PermutationCache
+{
+public:
+	explicit PermutationCache(const std::string& dir);
+
+	/// <summary>
+	/// Computes the cache key of a sample (FNV-1a over the pixel data and the ordering parameters).
+	/// </summary>
+	/// <param name="mat">decoded and resized sample.</param>
+	/// <param name="patchSize">patch size.</param>
+	/// <param name="measure">measure name as given on the command line.</param>
+	/// <param name="ordering">order and custom sort type.</param>
+	/// <returns></returns>
+	static uint64_t Hash(const cv::Mat& mat, const cv::Size& patchSize, const std::string& measure, const std::string& ordering);
+	bool Lookup(uint64_t key, Permutation& permutation);
+	void Store(uint64_t key, const Permutation& permutation) const;
+
+	int Hits() const { return hits_; }
+	int Misses() const { return misses_; }
+	std::string GetDir() const { return dir_; }
+
+private:
+	std::string FileName(uint64_t key) const;
+
+	std::string dir_;
+	int hits_;
+	int misses_;
+};
+#endif
@@ -0,0 +1,217 @@
+#include "stdafx.h"
+#include "PermutationFile.h"
+
+static const uint32_t PERMUTATION_FILE_MAGIC = 0x50524f50; // "PORP"
+static const uint32_t PERMUTATION_FILE_VERSION = 1;
+
+template <typename T>
+static inline void WriteValue(std::ostream& out, const T& value)
+{
+	out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+static inline bool ReadValue(std::istream& in, T& value)
+{
+	return static_cast<bool>(in.read(reinterpret_cast<char*>(&value), sizeof(T)));
+}
+
+static inline void WriteString(std::ostream& out, const std::string& s)
+{
+	const auto length = static_cast<uint16_t>(s.size());
+	WriteValue(out, length);
+	out.write(s.data(), length);
+}
+
+static inline bool ReadString(std::istream& in, std::string& s)
+{
+	uint16_t length = 0;
+	if (!ReadValue(in, length)) return false;
+	s.resize(length);
+
+	return length == 0 || static_cast<bool>(in.read(&s[0], length));
+}
+
+static inline bool SameGrid(const PermutationGrid& a, const PermutationGrid& b)
+{
+	return a.inputHeight == b.inputHeight && a.inputWidth == b.inputWidth && a.patchHeight == b.patchHeight &&
+		a.patchWidth == b.patchWidth && a.roundUp == b.roundUp && a.patches == b.patches &&
+		a.measure == b.measure && a.ordering == b.ordering;
+}
+
+PermutationWriter::PermutationWriter(const std::string& file, const PermutationGrid& grid, const bool append): count_(0)
+{
+	grid_ = grid;
+
+	if (grid_.patches > PermutationFile::MAX_PATCHES)
+	{
+		throw runtime_error("Too many patches per sample for a uint16 permutation: " + to_string(grid_.patches));
+	}
+
+	if (append && fs::exists(fs::path(file)))
+	{
+		// keep the complete records of an interrupted run and drop a torn trailing one
+		std::streamoff validEnd = -1;
+		{
+			ifstream in(file, ios::binary);
+			PermutationGrid existing;
+			std::vector<PermutationRecord> records;
+
+			if (PermutationFile::ReadHeader(in, existing) && SameGrid(existing, grid_))
+			{
+				validEnd = PermutationFile::ReadRecords(in, existing, records);
+				count_ = static_cast<int>(records.size());
+			}
+		}
+
+		if (validEnd > 0)
+		{
+			fs::resize_file(fs::path(file), static_cast<uintmax_t>(validEnd));
+			file_.open(file, ios::binary | ios::app);
+
+			if (!file_.is_open())
+			{
+				throw runtime_error("Unable to open permutation file " + file);
+			}
+
+			return;
+		}
+
+		cerr << "Permutation file " << file << " doesn't match the current grid, starting over\n";
+	}
+
+	file_.open(file, ios::binary | ios::trunc);
+
+	if (!file_.is_open())
+	{
+		throw runtime_error("Unable to open permutation file " + file);
+	}
+
+	PermutationFile::WriteHeader(file_, grid_);
+}
+
+PermutationWriter::~PermutationWriter()
+{
+	Close();
+}
+
+void PermutationWriter::Append(const std::string& sample, const Permutation& permutation)
+{
+	if (static_cast<int>(permutation.size()) != grid_.patches)
+	{
+		throw runtime_error("Permutation of " + sample + " doesn't match the grid, expected " + to_string(grid_.patches) +
+			" patches got " + to_string(permutation.size()));
+	}
+
+	for (const auto index : permutation)
+	{
+		if (index < 0 || index >= grid_.patches)
+		{
+			throw runtime_error("Permutation of " + sample + " has index " + to_string(index) + " outside of the grid");
+		}
+	}
+
+	WriteString(file_, sample);
+
+	std::vector<uint16_t> indices(permutation.begin(), permutation.end());
+	file_.write(reinterpret_cast<const char*>(indices.data()), indices.size() * sizeof(uint16_t));
+	file_.flush();
+	count_++;
+}
+
+void PermutationWriter::Close()
+{
+	if (file_.is_open())
+	{
+		file_.flush();
+		file_.close();
+	}
+}
+
+PermutationFile::PermutationFile(const std::string& file)
+{
+	ifstream in(file, ios::binary);
+
+	if (!in.is_open() || !ReadHeader(in, grid_))
+	{
+		throw runtime_error("Unable to read permutation file " + file);
+	}
+
+	std::vector<PermutationRecord> records;
+	ReadRecords(in, grid_, records);
+
+	// a resumed run may have appended a sample twice, the last record wins
+	std::map<std::string, size_t> index;
+	for (auto& record : records)
+	{
+		const auto found = index.find(record.sample);
+		if (found != index.end())
+		{
+			records_[found->second] = std::move(record);
+			continue;
+		}
+
+		index[record.sample] = records_.size();
+		records_.push_back(std::move(record));
+	}
+}
+
+std::streamoff PermutationFile::ReadRecords(std::istream& in, const PermutationGrid& grid, std::vector<PermutationRecord>& records)
+{
+	auto validEnd = static_cast<std::streamoff>(in.tellg());
+	PermutationRecord record;
+
+	while (ReadString(in, record.sample))
+	{
+		record.permutation.resize(grid.patches);
+		if (!in.read(reinterpret_cast<char*>(record.permutation.data()), grid.patches * sizeof(uint16_t)))
+		{
+			cerr << "Permutation file is truncated after " << records.size() << " records\n";
+			break;
+		}
+
+		records.push_back(record);
+		validEnd = static_cast<std::streamoff>(in.tellg());
+	}
+
+	return validEnd;
+}
+
+void PermutationFile::WriteHeader(std::ostream& out, const PermutationGrid& grid)
+{
+	WriteValue(out, PERMUTATION_FILE_MAGIC);
+	WriteValue(out, PERMUTATION_FILE_VERSION);
+	WriteValue(out, static_cast<int32_t>(grid.inputHeight));
+	WriteValue(out, static_cast<int32_t>(grid.inputWidth));
+	WriteValue(out, static_cast<int32_t>(grid.patchHeight));
+	WriteValue(out, static_cast<int32_t>(grid.patchWidth));
+	WriteValue(out, static_cast<uint8_t>(grid.roundUp ? 1 : 0));
+	WriteValue(out, static_cast<int32_t>(grid.patches));
+	WriteString(out, grid.measure);
+	WriteString(out, grid.ordering);
+}
+
+bool PermutationFile::ReadHeader(std::istream& in, PermutationGrid& grid)
+{
+	uint32_t magic = 0, version = 0;
+	int32_t inputHeight = 0, inputWidth = 0, patchHeight = 0, patchWidth = 0, patches = 0;
+	uint8_t roundUp = 0;
+
+	if (!ReadValue(in, magic) || magic != PERMUTATION_FILE_MAGIC) return false;
+	if (!ReadValue(in, version) || version != PERMUTATION_FILE_VERSION) return false;
+
+	const auto ok = ReadValue(in, inputHeight) && ReadValue(in, inputWidth) && ReadValue(in, patchHeight) &&
+		ReadValue(in, patchWidth) && ReadValue(in, roundUp) && ReadValue(in, patches) &&
+		ReadString(in, grid.measure) && ReadString(in, grid.ordering);
+
+	if (!ok || patches <= 0 || patches > MAX_PATCHES) return false;
+
+	grid.inputHeight = inputHeight;
+	grid.inputWidth = inputWidth;
+	grid.patchHeight = patchHeight;
+	grid.patchWidth = patchWidth;
+	grid.roundUp = roundUp != 0;
+	grid.patches = patches;
+
+	return true;
+}
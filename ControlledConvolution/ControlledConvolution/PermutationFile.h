@@ -0,0 +1,71 @@
+#pragma once
+#ifndef PERMUTATION_FILE_H
+#define PERMUTATION_FILE_H
+#include "stdafx.h"
+#include "sample.h"
+#include <cstdint>
+#include <fstream>
+
+/*
+ * Compact, dataset level ordering file (*.porp).
+ *
+ * Instead of materializing the reordered patches of every sample, only the permutation of
+ * the fixed patch grid is written: a header with the grid metadata followed by one record
+ * per sample
+ *   uint16 length, char[length] sample path, uint16[patches] permutation
+ * The original images and PatchShuffleLoader are enough to reproduce the reordered samples.
+ */
+struct PermutationGrid
+{
+	int inputHeight;
+	int inputWidth;
+	int patchHeight;
+	int patchWidth;
+	bool roundUp;
+	int patches;
+	std::string measure;
+	std::string ordering;
+};
+
+struct PermutationRecord
+{
+	std::string sample;
+	std::vector<uint16_t> permutation;
+};
+
+class PermutationWriter
+{
+public:
+	PermutationWriter(const std::string& file, const PermutationGrid& grid, bool append = false);
+	~PermutationWriter();
+
+	void Append(const std::string& sample, const Permutation& permutation);
+	void Close();
+	int Count() const { return count_; }
+
+private:
+	std::ofstream file_;
+	PermutationGrid grid_;
+	int count_;
+};
+
+class PermutationFile
+{
+public:
+	static const int MAX_PATCHES = 65536;
+
+	explicit PermutationFile(const std::string& file);
+
+	const PermutationGrid& Grid() const { return grid_; }
+	const std::vector<PermutationRecord>& Records() const { return records_; }
+	size_t Size() const { return records_.size(); }
+
+	static void WriteHeader(std::ostream& out, const PermutationGrid& grid);
+	static bool ReadHeader(std::istream& in, PermutationGrid& grid);
+	static std::streamoff ReadRecords(std::istream& in, const PermutationGrid& grid, std::vector<PermutationRecord>& records);
+
+private:
+	PermutationGrid grid_;
+	std::vector<PermutationRecord> records_;
+};
+#endif
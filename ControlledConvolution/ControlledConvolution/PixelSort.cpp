@@ -0,0 +1,151 @@
+#include "stdafx.h"
+#include "PixelSort.h"
+
+namespace
+{
+	// per thread scratch, grown to the largest region seen and reused afterwards
+	struct Scratch
+	{
+		std::vector<cv::Vec3b> pixels;
+		std::vector<cv::Vec3b> region;
+		std::vector<uint16_t> keys;
+		std::vector<int> counts;
+
+		void Reserve(const size_t count, const int range)
+		{
+			if (pixels.size() < count) pixels.resize(count);
+			if (region.size() < count) region.resize(count);
+			if (keys.size() < count) keys.resize(count);
+			if (counts.size() < static_cast<size_t>(range)) counts.resize(range);
+		}
+	};
+
+	thread_local Scratch scratch;
+}
+
+void PixelSort::Sort(cv::Vec3b* pixels, const size_t count, const PixelSortKey key, const Order& order)
+{
+	if (count < 2) return;
+
+	const auto range = KeyRange(key);
+	scratch.Reserve(count, range);
+	auto keys = scratch.keys.data();
+	auto counts = scratch.counts.data();
+	std::fill(counts, counts + range, 0);
+
+	for (size_t i = 0; i < count; i++)
+	{
+		keys[i] = static_cast<uint16_t>(Key(pixels[i].val, key));
+		counts[keys[i]]++;
+	}
+
+	// exclusive prefix sum, walked from the top bucket for decreasing so equal keys keep their order
+	auto offset = 0;
+	if (order == Order::decreasing)
+	{
+		for (auto k = range - 1; k >= 0; k--)
+		{
+			const auto c = counts[k];
+			counts[k] = offset;
+			offset += c;
+		}
+	}
+	else
+	{
+		for (auto k = 0; k < range; k++)
+		{
+			const auto c = counts[k];
+			counts[k] = offset;
+			offset += c;
+		}
+	}
+
+	auto sorted = scratch.pixels.data();
+	for (size_t i = 0; i < count; i++)
+	{
+		sorted[counts[keys[i]]++] = pixels[i];
+	}
+
+	std::copy(sorted, sorted + count, pixels);
+}
+
+void PixelSort::SortRegion(cv::Mat& mat, const PixelSortKey key, const Order& order)
+{
+	CV_Assert(mat.type() == CV_8UC3);
+	if (mat.empty()) return;
+
+	if (mat.isContinuous())
+	{
+		Sort(mat.ptr<cv::Vec3b>(), mat.total(), key, order);
+		return;
+	}
+
+	// ROI of a larger image: gather the rows into the scratch, sort there and scatter them back
+	const auto count = mat.total();
+	scratch.Reserve(count, KeyRange(key));
+	auto region = scratch.region.data();
+	for (auto r = 0; r < mat.rows; r++)
+	{
+		const auto row = mat.ptr<cv::Vec3b>(r);
+		std::copy(row, row + mat.cols, region + static_cast<size_t>(r) * mat.cols);
+	}
+
+	Sort(region, count, key, order);
+
+	for (auto r = 0; r < mat.rows; r++)
+	{
+		const auto src = region + static_cast<size_t>(r) * mat.cols;
+		std::copy(src, src + mat.cols, mat.ptr<cv::Vec3b>(r));
+	}
+}
+
+void PixelSort::SortRows(cv::Mat& mat, const PixelSortKey key, const Order& order)
+{
+	CV_Assert(mat.type() == CV_8UC3);
+
+	for (auto r = 0; r < mat.rows; r++)
+	{
+		Sort(mat.ptr<cv::Vec3b>(r), mat.cols, key, order);
+	}
+}
+
+void PixelSort::SortPatches(cv::Mat& mat, const cv::Size& patch, const PixelSortKey key, const Order& order)
+{
+	CV_Assert(mat.type() == CV_8UC3 && patch.width > 0 && patch.height > 0);
+
+	for (auto y = 0; y < mat.rows; y += patch.height)
+	{
+		for (auto x = 0; x < mat.cols; x += patch.width)
+		{
+			const cv::Rect cell(x, y, (std::min)(patch.width, mat.cols - x), (std::min)(patch.height, mat.rows - y));
+			auto region = mat(cell);
+			SortRegion(region, key, order);
+		}
+	}
+}
+
+bool PixelSort::ToKey(const std::string& name, PixelSortKey& key)
+{
+	if (name == "sum") key = PixelSortKey::sum;
+	else if (name == "luminance" || name == "lum") key = PixelSortKey::luminance;
+	else if (name == "hue") key = PixelSortKey::hue;
+	else if (name == "c0" || name == "b") key = PixelSortKey::channel0;
+	else if (name == "c1" || name == "g") key = PixelSortKey::channel1;
+	else if (name == "c2" || name == "r") key = PixelSortKey::channel2;
+	else return false;
+
+	return true;
+}
+
+int PixelSort::KeyRange(const PixelSortKey key)
+{
+	switch (key)
+	{
+	case PixelSortKey::sum:
+		return 3 * 255 + 1;
+	case PixelSortKey::hue:
+		return 180;
+	default:
+		return 256;
+	}
+}
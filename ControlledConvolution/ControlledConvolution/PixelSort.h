@@ -0,0 +1,98 @@
+#pragma once
+#ifndef PIXEL_SORT_H
+#define PIXEL_SORT_H
+#include "stdafx.h"
+#include "Reconstructor.h"
+
+/// <summary>
+/// Key pixels are sorted by.
+///sum - R+G+B (0..765)
+///luminance - (77R + 150G + 29B) / 256 (0..255)
+///hue - OpenCV 8 bit hue (0..179)
+///channel0/1/2 - B, G or R value (0..255)
+/// </summary>
+enum class PixelSortKey { sum, luminance, hue, channel0, channel1, channel2 };
+
+/*
+ * Pixel sorting of 8 bit BGR images.
+ *
+ * Every key is a small integer, so pixels are ordered with a stable counting sort: one pass
+ * to compute the keys and count them, one pass to scatter. Scratch buffers are per thread and
+ * only grow, so sorting doesn't allocate once they reached the largest region size. A ROI of a
+ * larger image is gathered into them and scattered back, it is sorted in place like any region.
+ */
+class PixelSort
+{
+public:
+	/// <summary>
+	/// Sorts all pixels of the region, written back in row major order.
+	/// </summary>
+	static void SortRegion(cv::Mat& mat, PixelSortKey key, const Order& order);
+	/// <summary>
+	/// Sorts every row of the region independently.
+	/// </summary>
+	static void SortRows(cv::Mat& mat, PixelSortKey key, const Order& order);
+	/// <summary>
+	/// Sorts the pixels of every patch of the grid (patch size p) independently.
+	/// </summary>
+	static void SortPatches(cv::Mat& mat, const cv::Size& patch, PixelSortKey key, const Order& order);
+
+	static bool ToKey(const std::string& name, PixelSortKey& key);
+	static int KeyRange(PixelSortKey key);
+	static inline int Key(const uchar* bgr, PixelSortKey key);
+
+private:
+	static void Sort(cv::Vec3b* pixels, size_t count, PixelSortKey key, const Order& order);
+	static inline int HueDivisor(int delta);
+};
+
+// round((180 << 12) / (6 * delta)), the 12 bit reciprocals cvtColor's 8 bit hue is scaled by
+inline int PixelSort::HueDivisor(const int delta)
+{
+	struct Table
+	{
+		int divisors[256];
+		Table() { for (auto i = 0; i < 256; i++) divisors[i] = i == 0 ? 0 : cvRound((180 << 12) / (6.0 * i)); }
+	};
+	static const Table table;
+
+	return table.divisors[delta];
+}
+
+inline int PixelSort::Key(const uchar* bgr, const PixelSortKey key)
+{
+	const int b = bgr[0], g = bgr[1], r = bgr[2];
+
+	switch (key)
+	{
+	case PixelSortKey::sum:
+		return b + g + r;
+	case PixelSortKey::luminance:
+		return (77 * r + 150 * g + 29 * b) >> 8;
+	case PixelSortKey::hue:
+	{
+		const auto max = r > g ? (r > b ? r : b) : (g > b ? g : b);
+		const auto min = r < g ? (r < b ? r : b) : (g < b ? g : b);
+		const auto delta = max - min;
+		if (delta == 0) return 0;
+
+		// hue in degrees / 2 as cvtColor(COLOR_BGR2HSV) computes it for 8 bit images: the sextant
+		// position in units of delta, times 30 / delta in 12 bit fixed point, rounded with an
+		// arithmetic shift (down for negative hues, which wrap around to 180 + h)
+		int h;
+		if (max == r) h = g - b;
+		else if (max == g) h = b - r + 2 * delta;
+		else h = r - g + 4 * delta;
+		h = (h * HueDivisor(delta) + (1 << 11)) >> 12;
+
+		return h < 0 ? h + 180 : h;
+	}
+	case PixelSortKey::channel0:
+		return b;
+	case PixelSortKey::channel1:
+		return g;
+	default:
+		return r;
+	}
+}
+#endif
@@ -0,0 +1,113 @@
+#pragma once
+#ifndef PIXEL_VIEW_H
+#define PIXEL_VIEW_H
+#include <opencv2/core.hpp>
+#include <cstdint>
+#include <vector>
+
+/// <summary>
+/// Memory order of a pixel view.
+///interleaved - BGRBGR..., row major (the cv::Mat layout)
+///planar - all B, then all G, then all R, each plane row major
+/// </summary>
+enum class PixelLayout { interleaved, planar };
+
+/// <summary>
+/// Read only, typed view of the pixels of a patch. Doesn't own the data, it stays valid as long as the
+/// patch (zero copy views) or the PixelBuffer it was converted into.
+/// </summary>
+template <typename T>
+struct PixelView
+{
+	const T* data;
+	int rows;
+	int cols;
+	int channels;
+	size_t stride;	// elements between two rows (interleaved) or two planes (planar)
+	PixelLayout layout;
+
+	T At(const int r, const int c, const int ch) const
+	{
+		return layout == PixelLayout::interleaved
+			? data[r * stride + static_cast<size_t>(c) * channels + ch]
+			: data[ch * stride + static_cast<size_t>(r) * cols + c];
+	}
+
+	const T* Row(const int r) const { return data + r * stride; }
+	const T* Plane(const int ch) const { return data + ch * stride; }
+	size_t Count() const { return static_cast<size_t>(rows) * cols * channels; }
+};
+
+/*
+ * Storage pixel views are converted into. Grows to the largest request and is reused afterwards,
+ * so converting every patch of a sample allocates once. Only the view from the last conversion is valid.
+ */
+class PixelBuffer
+{
+public:
+	template <typename T>
+	T* Get(const size_t count)
+	{
+		const auto words = (count * sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+		if (storage_.size() < words) storage_.resize(words);
+
+		return reinterpret_cast<T*>(storage_.data());
+	}
+
+private:
+	std::vector<uint64_t> storage_;
+};
+
+template <typename T> struct PixelDepth;
+template <> struct PixelDepth<uint8_t> { static const int value = CV_8U; };
+template <> struct PixelDepth<float> { static const int value = CV_32F; };
+template <> struct PixelDepth<double> { static const int value = CV_64F; };
+
+/// <summary>
+/// Views mat as T in the requested layout. A mat already of that depth and layout is viewed in place,
+/// anything else is converted (uint8 values are kept, not normalized) into buffer.
+/// </summary>
+template <typename T>
+PixelView<T> MakePixelView(const cv::Mat& mat, const PixelLayout layout, PixelBuffer& buffer)
+{
+	const auto channels = mat.channels();
+	const auto depth = PixelDepth<T>::value;
+	const auto rowElements = static_cast<size_t>(mat.cols) * channels;
+
+	if (mat.depth() == depth && layout == PixelLayout::interleaved)
+		return PixelView<T>{ mat.ptr<T>(), mat.rows, mat.cols, channels, mat.step1(), layout };
+	if (mat.depth() == depth && channels == 1 && mat.isContinuous())
+		return PixelView<T>{ mat.ptr<T>(), mat.rows, mat.cols, channels, mat.total(), layout };
+
+	const auto count = rowElements * mat.rows;
+	auto out = buffer.Get<T>(count);
+	const auto planeSize = static_cast<size_t>(mat.rows) * mat.cols;
+
+	if (layout == PixelLayout::interleaved)
+	{
+		cv::Mat converted(mat.rows, mat.cols, CV_MAKETYPE(depth, channels), out);
+		mat.convertTo(converted, depth);
+		return PixelView<T>{ out, mat.rows, mat.cols, channels, rowElements, layout };
+	}
+
+	std::vector<cv::Mat> planes;
+	planes.reserve(channels);
+	for (auto ch = 0; ch < channels; ch++)
+	{
+		planes.emplace_back(mat.rows, mat.cols, CV_MAKETYPE(depth, 1), out + ch * planeSize);
+	}
+
+	if (mat.depth() == depth)
+	{
+		cv::split(mat, planes);
+	}
+	else
+	{
+		std::vector<cv::Mat> source;
+		cv::split(mat, source);
+		for (auto ch = 0; ch < channels; ch++) source[ch].convertTo(planes[ch], depth);
+	}
+
+	return PixelView<T>{ out, mat.rows, mat.cols, channels, planeSize, layout };
+}
+#endif
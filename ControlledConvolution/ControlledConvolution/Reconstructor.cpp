@@ -2,6 +2,9 @@
 #include "Reconstructor.h"
 #include "ImageRegister.h"
 #include "Common.h"
+#include "PixelSort.h"
+#include "PatchTable.h"
+#include "Arena.h"
 #include <iostream>
 #include <opencv2/stitching.hpp>
 
@@ -42,61 +45,11 @@ double Reconstructor::PeakSignalToNoiseRatio(const Patch &p1, const Patch &p2)
 
 cv::Scalar Reconstructor::Entropy(const Patch& p)
 {
+	//the histogram is only needed here, the entropy comparators call this for every pair
+	ArenaScope scope;
 	const auto image = p.GetMat();
 
-	std::vector<cv::Mat> channels;
-
-	cv::split(image, channels);
-
-	auto histSize = 255;
-
-	float range[] = { 0,256 };
-
-	const float* histRange = { range };
-
-	const auto uniform = true;
-	const auto accumulate = false;
-
-	cv::Mat hist0, hist1, hist2;
-
-	//Calculate histogram of each color channel
-	cv::calcHist(&channels[0], 1, nullptr, cv::Mat(), hist0, 1, &histSize, &histRange, uniform, accumulate);
-	cv::calcHist(&channels[1], 1, nullptr, cv::Mat(), hist1, 1, &histSize, &histRange, uniform, accumulate);
-	cv::calcHist(&channels[2], 1, nullptr, cv::Mat(), hist2, 1, &histSize, &histRange, uniform, accumulate);
-
-	hist0 = mean(hist0);
-	hist1 = mean(hist1);
-	hist2 = mean(hist2);
-
-	float f0 = 0, f1 = 0, f2 = 0;
-
-	for (auto i = 0; i < histSize; i++)
-	{
-		f0 += hist0.at<float>(i);
-		f1 += hist1.at<float>(i);
-		f2 += hist2.at<float>(i);
-	}
-
-	cv::Scalar e;
-	e.val[0] = 0;
-	e.val[1] = 0;
-	e.val[2] = 0;
-
-	for (auto i = 0; i < histSize; i++)
-	{
-		const auto p0 = abs(hist0.at<float>(i)) / f0;
-		const auto p1 = abs(hist1.at<float>(i)) / f1;
-		const auto p2 = abs(hist2.at<float>(i)) / f2;
-
-		if (p0 != 0)
-			e.val[0] += -p0*log10(p0);
-		if (p1 != 0)
-			e.val[1] += -p1*log10(p1);
-		if (p2 != 0)
-			e.val[2] += -p2*log10(p2);
-	}
-
-	return e;
+	return PatchTable::ComputeEntropy(PatchTable::ComputeHistogram(image), static_cast<int>(image.total()));
 }
 
 float Reconstructor::JointEntropy(const Patch & p1, const Patch & p2)
@@ -118,45 +71,61 @@ cv::Scalar Reconstructor::StructuralSimilarityIndex(const Patch& p1, const Patch
 	const auto c1 = 6.5025, c2 = 58.5225;
 	/***************************** INITS **********************************/
 	const auto d = CV_32F;
-
-	Mat i1, i2;
-	p1.GetMat().convertTo(i1, d);           // cannot calculate on one byte large values
-	p2.GetMat().convertTo(i2, d);
-
-	const Mat i2Squared = i2.mul(i2);        // I2^2
-	const Mat i1Squared = i1.mul(i1);        // I1^2
-	const Mat i1Timesi2 = i1.mul(i2);        // I1 * I2
+	const auto m1 = p1.GetMat(), m2 = p2.GetMat();
+	const auto rows = m1.rows, cols = m1.cols, type = CV_MAKETYPE(d, m1.channels());
+
+	//All maps are preallocated from the arena, the calls below write into them. The scope rewinds
+	//them on return, the pairwise sorts call this O(n^2) times per sample.
+	ArenaScope scope;
+	auto i1 = ScratchMat(rows, cols, type), i2 = ScratchMat(rows, cols, type);
+	m1.convertTo(i1, d);           // cannot calculate on one byte large values
+	m2.convertTo(i2, d);
+
+	auto i2Squared = ScratchMat(rows, cols, type), i1Squared = ScratchMat(rows, cols, type),
+		i1Timesi2 = ScratchMat(rows, cols, type);
+	multiply(i2, i2, i2Squared);        // I2^2
+	multiply(i1, i1, i1Squared);        // I1^2
+	multiply(i1, i2, i1Timesi2);        // I1 * I2
 
 	/*************************** END INITS **********************************/
 
-	Mat mu1, mu2;   // PRELIMINARY COMPUTING
+	auto mu1 = ScratchMat(rows, cols, type), mu2 = ScratchMat(rows, cols, type);   // PRELIMINARY COMPUTING
 	GaussianBlur(i1, mu1, Size(11, 11), 1.5);
 	GaussianBlur(i2, mu2, Size(11, 11), 1.5);
 
-	const Mat mu1Squared = mu1.mul(mu1);
-	const Mat mu2Squared = mu2.mul(mu2);
-	const Mat mu1TimesMu2 = mu1.mul(mu2);
+	auto mu1Squared = ScratchMat(rows, cols, type), mu2Squared = ScratchMat(rows, cols, type),
+		mu1TimesMu2 = ScratchMat(rows, cols, type);
+	multiply(mu1, mu1, mu1Squared);
+	multiply(mu2, mu2, mu2Squared);
+	multiply(mu1, mu2, mu1TimesMu2);
 
-	Mat sigma1Squared, sigma2Squared, sigma12;
+	auto sigma1Squared = ScratchMat(rows, cols, type), sigma2Squared = ScratchMat(rows, cols, type),
+		sigma12 = ScratchMat(rows, cols, type);
 
 	GaussianBlur(i1Squared, sigma1Squared, Size(11, 11), 1.5);
-	sigma1Squared -= mu1Squared;
+	subtract(sigma1Squared, mu1Squared, sigma1Squared);
 
 	GaussianBlur(i2Squared, sigma2Squared, Size(11, 11), 1.5);
-	sigma2Squared -= mu2Squared;
+	subtract(sigma2Squared, mu2Squared, sigma2Squared);
 
 	GaussianBlur(i1Timesi2, sigma12, Size(11, 11), 1.5);
-	sigma12 -= mu1TimesMu2;
-
-	Mat t1 = 2 * mu1TimesMu2 + c1;
-	Mat t2 = 2 * sigma12 + c2;
-	const Mat t3 = t1.mul(t2);              // t3 = ((2*mu1_mu2 + C1).*(2*sigma12 + C2))
-
-	t1 = mu1Squared + mu2Squared + c1;
-	t2 = sigma1Squared + sigma2Squared + c2;
-	t1 = t1.mul(t2);               // t1 =((mu1_2 + mu2_2 + C1).*(sigma1_2 + sigma2_2 + C2))
-
-	Mat ssimMap;
+	subtract(sigma12, mu1TimesMu2, sigma12);
+
+	//the inputs are no longer needed, their maps are reused for t1..t3
+	auto& t1 = i1;
+	auto& t2 = i2;
+	auto& t3 = i1Squared;
+	mu1TimesMu2.convertTo(t1, d, 2, c1);
+	sigma12.convertTo(t2, d, 2, c2);
+	multiply(t1, t2, t3);              // t3 = ((2*mu1_mu2 + C1).*(2*sigma12 + C2))
+
+	add(mu1Squared, mu2Squared, t1);
+	add(t1, Scalar::all(c1), t1);
+	add(sigma1Squared, sigma2Squared, t2);
+	add(t2, Scalar::all(c2), t2);
+	multiply(t1, t2, t1);               // t1 =((mu1_2 + mu2_2 + C1).*(sigma1_2 + sigma2_2 + C2))
+
+	auto& ssimMap = i2Squared;
 	divide(t3, t1, ssimMap);      // ssim_map =  t3./t1;
 
 	auto mssim = mean(ssimMap); // mssim = average of ssim map
@@ -202,47 +171,16 @@ bool Reconstructor::SortPatches(vector<Patch>& v, const MeasureType t, const Ord
 
 	//cout << "Sorting patches, size = "<<v.size() << endl;
 
-	if (t == MeasureType::averageEntropy)
+	if (PatchTable::IsScalarMeasure(t) || PatchTable::IsDescriptorMeasure(t))
 	{
-		if (order == Order::increasing)
-			std::sort(v.begin(), v.end(), AverageEntropyAscending);
-		else
-			std::sort(v.begin(), v.end(), AverageEntropyDescending);
-		for (auto i = 0; i < v.size(); i++)
-			v[i].SetName(to_string(i));
+		//Single gather, patches are moved once instead of swapped by std::sort
+		const auto indices = FeatureOrder(v, t, order);
+		vector<Patch> sorted;
+		sorted.reserve(v.size());
+		for (const auto i : indices)
+			sorted.push_back(std::move(v[i]));
+		v.swap(sorted);
 
-		return true;
-	}
-	if (t == MeasureType::channel0Entropy)
-	{
-		if (order == Order::increasing)
-			std::sort(v.begin(), v.end(), Channel0EntropyAscending);
-		else
-			std::sort(v.begin(), v.end(), Channel0EntropyDescending);
-		for (auto i = 0; i < v.size(); i++)
-			v[i].SetName(to_string(i));
-
-		return true;
-	}
-
-	if (t == MeasureType::channel1Entropy)
-	{
-		if (order == Order::increasing)
-			std::sort(v.begin(), v.end(), Channel1EntropyAscending);
-		else
-			std::sort(v.begin(), v.end(), Channel1EntropyDescending);
-		for (auto i = 0; i < v.size(); i++)
-			v[i].SetName(to_string(i));
-
-		return true;
-	}
-
-	if (t == MeasureType::channel2Entropy)
-	{
-		if (order == Order::increasing)
-			std::sort(v.begin(), v.end(), Channel2EntropyAscending);
-		else
-			std::sort(v.begin(), v.end(), Channel2EntropyDescending);
 		for (auto i = 0; i < v.size(); i++)
 			v[i].SetName(to_string(i));
 
@@ -521,66 +459,29 @@ bool Reconstructor::SortPatches(vector<Patch>& v, const MeasureType t, const Ord
 
 bool Reconstructor::SortPixels(Patch *in, const Order & order)
 {
-	const auto mat = in->GetMat();
-
-	const auto input = static_cast<unsigned char*>(mat.data);
-	if (!input) {
+	auto mat = in->GetMat();
+	if (mat.empty()) {
 		cerr << "No input data\n";
 		return false;
 	}
 
-	int r, g, b, count = 0;
-
-	//extract rgb pixels
-	for (auto i = 0; i < mat.cols; i++)
-	{
-		for (auto j = 0; j < mat.rows; j++)
-		{
-			b = input[mat.cols*j + i];
-			g = input[mat.cols*j + i + 1];
-			r = input[mat.cols*j + i + 2];
-			count += 1;
-		}
-	}
-	/*sort(b, b+count);
-	sort(g, g+count);
-	sort(r, r+count);*/
-
-	const auto outMat = cv::Mat(mat.rows, mat.cols, r + g + b);
-	in->SetMat(outMat);
+	in->SetMat(SortPixels(mat, order));
 	return true;
 }
 
 cv::Mat Reconstructor::SortPixels(cv::Mat &mat, const Order & order)
 {
 	cv::Mat outMat;
-	const auto input = static_cast<unsigned char*>(mat.data);
-	if (!input) {
+	if (mat.empty()) {
 		cerr << "No input data\n";
 		return outMat;
 	}
 
-	int r, g, b, count = 0;
-
-	//extract rgb pixels
-	for (auto i = 0; i < mat.cols; i++)
-	{
-		for (auto j = 0; j < mat.rows; j++)
-		{
-			b = input[mat.cols*j + i];
-			g = input[mat.cols*j + i + 1];
-			r = input[mat.cols*j + i + 2];
-			count += 1;
-		}
-	}
-	cout << b << endl;
-	cout << g << endl;
-	cout << r << endl;
-	/*sort(b, b+count);
-	sort(g, g+count);
-	sort(r, r+count);*/
+	if (mat.type() == CV_8UC3) outMat = mat.clone();
+	else if (mat.channels() == 1) cvtColor(mat, outMat, COLOR_GRAY2BGR);
+	else mat.convertTo(outMat, CV_8UC3);
 
-	outMat = cv::Mat(mat.rows, mat.cols, r + g + b);
+	PixelSort::SortRegion(outMat, PixelSortKey::sum, order == Order::decreasing ? Order::decreasing : Order::increasing);
 
 	return outMat;
 }
@@ -616,6 +517,14 @@ void Reconstructor::Reconstruct(Sample* s)
 	Common::Show(reconstructedOutput, "");
 }
 
+vector<int> Reconstructor::FeatureOrder(const vector<Patch>& v, const MeasureType t, const Order& order)
+{
+	PatchTable table(v);
+	table.Rank(t, order);
+
+	return table.Indices();
+}
+
 bool Reconstructor::AverageEntropy(const Patch& p1, const Patch& p2, Order& order)
 {
 	auto entropy1 = Entropy(p1);
@@ -727,7 +636,7 @@ void Reconstructor::VisualizePatches(const int& numberToVisualize) const
 {
 	//(void)((!!(howMany <= 12)) || (_wassert(_CRT_WIDE("howMany <= 12"), _CRT_WIDE(__FILE__), static_cast<unsigned>(__LINE__)), 0));
 
-	auto p = sample_->Patches();
+	const auto& p = sample_->Patches();
 	std::string  title;
 
 	switch (numberToVisualize)
@@ -11,6 +11,9 @@
 ///mi - mutual information
 ///ssim - stuctural similarity index
 ///ji - joint entropy
+///ge - gradient energy, mean squared Sobel gradient of the patch
+///oh - orientation histogram, HOG like descriptor of the patch, ordered by descriptor distance
+///do - dominant orientation, angle of the patch's structure tensor
 /// </summary>
 enum class MeasureType
 {
@@ -23,7 +26,10 @@ enum class MeasureType
 	psnr,je,ce, mi, pixel,
 	ssimAverage, ssim0,
 	ssim1, ssim2,
-	custom,kl
+	custom,kl,
+	gradientEnergy,
+	orientationHistogram,
+	dominantOrientation
 };
 
 enum class SemiRandomSortType
@@ -132,6 +138,18 @@ public:
 	static bool Channel2Entropy(const Patch& p1, const Patch& p2, Order& order);
 	static bool Channel2EntropyAscending(const Patch& p1, const Patch& p2);
 	static bool Channel2EntropyDescending(const Patch& p1, const Patch& p2);
+	/// <summary>
+	/// Ranks patches by a per patch measure, computed once per patch (PatchTable::Rank). Scalar
+	///measures (averageEntropy, channel0/1/2Entropy, gradientEnergy, dominantOrientation) are radix
+	///sorted (stable) on their float32 bit pattern, which orders like the value since the measures are
+	///never negative. Descriptors (orientationHistogram) are chained by nearest descriptor distance
+	///from the first patch, a few float operations per pair instead of a pixel pass.
+	/// </summary>
+	/// <param name="v">patches to rank.</param>
+	/// <param name="t">scalar or descriptor measure.</param>
+	/// <param name="order">scalars: increasing, anything else sorts decreasing. Descriptors: decreasing reverses the chain.</param>
+	/// <returns>entry i is the index in v of the patch at position i.</returns>
+	static vector<int> FeatureOrder(const vector<Patch>& v, MeasureType t, const Order& order);
 	static bool GreaterThan(const double i, const double j);
 	static bool GreaterThan(const float i, const float j);
 	static bool LessThan(const double i, const double j) { return (i < j); }
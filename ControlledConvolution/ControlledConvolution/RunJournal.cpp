@@ -0,0 +1,59 @@
+#include "stdafx.h"
+#include "RunJournal.h"
+
+RunJournal::RunJournal(const std::string& file)
+{
+	file_ = file;
+
+	// only newline terminated lines were completely written
+	std::vector<std::string> entries;
+	{
+		ifstream in(file_, ios::binary);
+		std::string content((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+
+		size_t begin = 0, end;
+		while ((end = content.find('\n', begin)) != std::string::npos)
+		{
+			const auto entry = content.substr(begin, end - begin);
+			if (!entry.empty() && done_.insert(entry).second) entries.push_back(entry);
+			begin = end + 1;
+		}
+	}
+
+	const auto temp = file_ + ".tmp";
+	{
+		ofstream out(temp, ios::binary | ios::trunc);
+		for (const auto& entry : entries) out << entry << '\n';
+	}
+	fs::rename(fs::path(temp), fs::path(file_));
+
+	out_.open(file_, ios::binary | ios::app);
+
+	if (!out_.is_open())
+	{
+		throw runtime_error("Unable to open run journal " + file_);
+	}
+}
+
+RunJournal::~RunJournal()
+{
+	if (out_.is_open()) out_.close();
+}
+
+void RunJournal::MarkDone(const std::string& sample)
+{
+	if (!done_.insert(sample).second) return;
+
+	out_ << sample << '\n';
+	out_.flush();
+}
+
+void RunJournal::Commit(const std::string& partial, const std::string& dir)
+{
+	const fs::path p(dir);
+
+	if (fs::exists(p))
+		fs::remove_all(p);
+
+	fs::rename(fs::path(partial), p);
+}
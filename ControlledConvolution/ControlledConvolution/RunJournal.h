@@ -0,0 +1,38 @@
+#pragma once
+#ifndef RUN_JOURNAL_H
+#define RUN_JOURNAL_H
+#include "stdafx.h"
+#include <fstream>
+#include <unordered_set>
+
+/*
+ * Manifest of the samples a run has completed, used to resume an interrupted run.
+ *
+ * Every completed sample is appended as one line and flushed right away. On open the
+ * manifest is compacted into a temporary file and renamed over the old one, which drops a
+ * line torn by a crash, so a sample is either fully recorded or processed again.
+ */
+class RunJournal
+{
+public:
+	explicit RunJournal(const std::string& file);
+	~RunJournal();
+
+	bool Done(const std::string& sample) const { return done_.count(sample) != 0; }
+	void MarkDone(const std::string& sample);
+	size_t Completed() const { return done_.size(); }
+	std::string GetFile() const { return file_; }
+
+	/// <summary>
+	/// Moves a fully written output directory into place, replacing a stale one from an earlier attempt.
+	/// </summary>
+	/// <param name="partial">directory the sample was written to.</param>
+	/// <param name="dir">final output directory.</param>
+	static void Commit(const std::string& partial, const std::string& dir);
+
+private:
+	std::string file_;
+	std::unordered_set<std::string> done_;
+	std::ofstream out_;
+};
+#endif
@@ -0,0 +1,56 @@
+#pragma once
+#ifndef SEMAPHORE_H
+#define SEMAPHORE_H
+#include <condition_variable>
+#include <mutex>
+
+/*
+ * Counting semaphore bounding how many threads are inside a section at once, e.g. how many
+ * workers of a pool read or write the disc concurrently. Slot holds a permit for its scope.
+ */
+class Semaphore
+{
+public:
+	explicit Semaphore(const size_t permits) : permits_(permits == 0 ? 1 : permits)
+	{
+	}
+
+	Semaphore(const Semaphore&) = delete;
+	Semaphore& operator=(const Semaphore&) = delete;
+
+	void Acquire()
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		available_.wait(lock, [this] { return permits_ > 0; });
+		permits_--;
+	}
+
+	void Release()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			permits_++;
+		}
+
+		available_.notify_one();
+	}
+
+	class Slot
+	{
+	public:
+		explicit Slot(Semaphore& semaphore) : semaphore_(semaphore) { semaphore_.Acquire(); }
+		~Slot() { semaphore_.Release(); }
+
+		Slot(const Slot&) = delete;
+		Slot& operator=(const Slot&) = delete;
+
+	private:
+		Semaphore& semaphore_;
+	};
+
+private:
+	size_t permits_;
+	std::mutex mutex_;
+	std::condition_variable available_;
+};
+#endif
@@ -0,0 +1,214 @@
+#include "stdafx.h"
+#include "StreamServer.h"
+#include "PatchShuffleLoader.h"
+#include "por.h"
+#include "PermutationFile.h"
+#include "Arena.h"
+#include <thread>
+
+static const size_t TENSOR_HEADER_SIZE = 3 * sizeof(int32_t);
+static const size_t SKIP_CHUNK_SIZE = 64 * 1024;
+
+static inline bool ReadExact(FILE* in, void* data, const size_t size)
+{
+	return size == 0 || fread(data, 1, size, in) == size;
+}
+
+static inline void ToErrorJob(std::vector<uchar>& payload, const std::string& message)
+{
+	payload.assign(message.begin(), message.end());
+}
+
+StreamServer::StreamServer(const StreamOptions& options): decoded_(options.queueDepth), ordered_(options.queueDepth),
+                                                          served_(0)
+{
+	options_ = options;
+}
+
+int StreamServer::Run(FILE* in, FILE* out)
+{
+	std::thread decoder(&StreamServer::Decode, this, in);
+	std::thread orderer(&StreamServer::Orderer, this);
+
+	// the calling thread owns the output stream
+	Encode(out);
+
+	decoder.join();
+	orderer.join();
+
+	return served_;
+}
+
+bool StreamServer::ReadFrame(FILE* in, FrameKind& kind, std::vector<uchar>& payload, const uint32_t maxLength,
+	bool& oversized)
+{
+	uint32_t header[2];
+
+	if (!ReadExact(in, header, sizeof(header)) || header[1] == 0) return false;
+
+	kind = static_cast<FrameKind>(header[0]);
+	oversized = header[1] > maxLength;
+
+	if (oversized)
+	{
+		// the length comes from the client, drain the payload in chunks to stay in sync with the stream
+		payload.clear();
+		uchar chunk[SKIP_CHUNK_SIZE];
+		for (size_t left = header[1]; left > 0;)
+		{
+			const auto size = (std::min)(left, SKIP_CHUNK_SIZE);
+			if (!ReadExact(in, chunk, size)) return false;
+			left -= size;
+		}
+		return true;
+	}
+
+	payload.resize(header[1]);
+
+	return ReadExact(in, payload.data(), payload.size());
+}
+
+bool StreamServer::WriteFrame(FILE* out, const FrameKind kind, const void* payload, const uint32_t length)
+{
+	const uint32_t header[2] = { static_cast<uint32_t>(kind), length };
+
+	return fwrite(header, 1, sizeof(header), out) == sizeof(header) &&
+		(length == 0 || fwrite(payload, 1, length, out) == length);
+}
+
+void StreamServer::Decode(FILE* in)
+{
+	Job job;
+	bool oversized;
+
+	while (ReadFrame(in, job.kind, job.payload, options_.maxFrameSize, oversized))
+	{
+		job.mat.release();
+
+		if (oversized)
+		{
+			ToErrorJob(job.payload, "Frame exceeds the maximum frame size of " + to_string(options_.maxFrameSize) + " bytes");
+		}
+		else if (job.kind == FrameKind::encodedImage)
+		{
+			job.mat = imdecode(job.payload, IMREAD_COLOR);
+			if (!job.mat.data) ToErrorJob(job.payload, "Unable to decode image frame");
+		}
+		else if (job.kind == FrameKind::tensor && job.payload.size() >= TENSOR_HEADER_SIZE)
+		{
+			int32_t shape[3];
+			memcpy(shape, job.payload.data(), TENSOR_HEADER_SIZE);
+			const auto rows = shape[0], cols = shape[1], channels = shape[2];
+			const auto expected = static_cast<size_t>(rows) * cols * channels + TENSOR_HEADER_SIZE;
+
+			if (rows > 0 && cols > 0 && (channels == 1 || channels == 3) && job.payload.size() == expected)
+			{
+				const cv::Mat view(rows, cols, CV_8UC(channels), job.payload.data() + TENSOR_HEADER_SIZE);
+				if (channels == 1) cvtColor(view, job.mat, COLOR_GRAY2BGR);
+				else job.mat = view.clone();
+			}
+			else ToErrorJob(job.payload, "Malformed tensor frame");
+		}
+		else ToErrorJob(job.payload, "Unsupported frame kind " + to_string(static_cast<uint32_t>(job.kind)));
+
+		if (!job.mat.data) job.kind = FrameKind::error;
+		else job.payload.clear();
+
+		if (!decoded_.Push(std::move(job))) break;
+		job = Job();
+	}
+
+	decoded_.Close();
+}
+
+void StreamServer::Orderer()
+{
+	Job job;
+
+	while (decoded_.Pop(job))
+	{
+		if (job.kind != FrameKind::error)
+		{
+			try
+			{
+				Process(job);
+			}
+			catch (const std::exception& e)
+			{
+				job.kind = FrameKind::error;
+				ToErrorJob(job.payload, e.what());
+			}
+			catch (...)
+			{
+				job.kind = FrameKind::error;
+				ToErrorJob(job.payload, "Unable to order sample");
+			}
+		}
+
+		if (!ordered_.Push(std::move(job))) break;
+		job = Job();
+	}
+
+	ordered_.Close();
+}
+
+void StreamServer::Process(Job& job) const
+{
+	ArenaScope arena;
+	Sample s;
+	s.FromMat(job.mat, options_.inputSize, options_.roundUp);
+
+	// the ordering goes out as uint16 indices, larger grids get an error frame
+	const auto cells = por::GridCells(s.Mat().size(), options_.patchSize);
+	if (cells > PermutationFile::MAX_PATCHES)
+	{
+		throw runtime_error("Too many patches per sample for a uint16 permutation: " + to_string(cells));
+	}
+
+	Permutation permutation;
+	if (!por::OrderSample(s, options_.patchSize, options_.measure, options_.order, options_.sortType, permutation))
+	{
+		throw runtime_error("SortPatches failed");
+	}
+
+	const std::vector<uint16_t> indices(permutation.begin(), permutation.end());
+
+	if (options_.permutationOnly)
+	{
+		job.kind = FrameKind::permutation;
+		job.payload.resize(indices.size() * sizeof(uint16_t));
+		memcpy(job.payload.data(), indices.data(), job.payload.size());
+		return;
+	}
+
+	cv::Mat ordered;
+	PatchShuffleLoader::Shuffle(s.Mat(), ordered, options_.patchSize, indices);
+
+	const int32_t shape[3] = { ordered.rows, ordered.cols, ordered.channels() };
+	const auto bytes = ordered.total() * ordered.elemSize();
+	job.kind = FrameKind::tensor;
+	job.payload.resize(TENSOR_HEADER_SIZE + bytes);
+	memcpy(job.payload.data(), shape, TENSOR_HEADER_SIZE);
+	memcpy(job.payload.data() + TENSOR_HEADER_SIZE, ordered.data, bytes);
+}
+
+void StreamServer::Encode(FILE* out)
+{
+	Job job;
+
+	while (ordered_.Pop(job))
+	{
+		if (!WriteFrame(out, job.kind, job.payload.data(), static_cast<uint32_t>(job.payload.size())) || fflush(out) != 0)
+		{
+			// the reader went away, stop the upstream stages
+			decoded_.Close();
+			ordered_.Close();
+			break;
+		}
+
+		served_++;
+	}
+
+	WriteFrame(out, FrameKind::tensor, nullptr, 0);
+	fflush(out);
+}
@@ -0,0 +1,81 @@
+#pragma once
+#ifndef STREAM_SERVER_H
+#define STREAM_SERVER_H
+#include "stdafx.h"
+#include "Reconstructor.h"
+#include "BlockingQueue.h"
+#include <cstdint>
+#include <cstdio>
+
+/*
+ * Persistent ordering process driven over a pipe (ccMain --stream).
+ *
+ * Every frame, in both directions, is
+ *   uint32 kind, uint32 length, byte[length] payload
+ * Input kinds are an encoded image (any format imdecode understands) or a raw tensor
+ * (int32 rows, int32 cols, int32 channels followed by rows*cols*channels uint8 BGR).
+ * For every input frame exactly one output frame is written, in input order: the reordered
+ * tensor, the uint16 permutation, or an error message. A frame of length 0 ends the stream.
+ * Input frames longer than maxFrameSize are skipped unread and answered with an error frame.
+ *
+ * Decoding, ordering and encoding run on their own threads connected by bounded queues.
+ */
+enum class FrameKind : uint32_t
+{
+	encodedImage = 0,
+	tensor = 1,
+	permutation = 2,
+	error = 255
+};
+
+struct StreamOptions
+{
+	cv::Size inputSize;
+	bool roundUp;
+	cv::Size patchSize;
+	MeasureType measure;
+	Order order;
+	SemiRandomSortType sortType;
+	bool permutationOnly;
+	size_t queueDepth;
+	uint32_t maxFrameSize;
+};
+
+class StreamServer
+{
+public:
+	explicit StreamServer(const StreamOptions& options);
+
+	/// <summary>
+	/// Serves frames from in to out until the end of stream frame or end of file.
+	/// </summary>
+	/// <returns>number of frames served.</returns>
+	int Run(FILE* in, FILE* out);
+
+	/// <summary>
+	/// Reads the next frame. A payload longer than maxLength is skipped without being buffered,
+	///payload is left empty and oversized set.
+	/// </summary>
+	/// <returns>false at the end of stream frame, end of file or a read error.</returns>
+	static bool ReadFrame(FILE* in, FrameKind& kind, std::vector<uchar>& payload, uint32_t maxLength, bool& oversized);
+	static bool WriteFrame(FILE* out, FrameKind kind, const void* payload, uint32_t length);
+
+private:
+	struct Job
+	{
+		cv::Mat mat;
+		FrameKind kind;
+		std::vector<uchar> payload;
+	};
+
+	void Decode(FILE* in);
+	void Orderer();
+	void Encode(FILE* out);
+	void Process(Job& job) const;
+
+	StreamOptions options_;
+	BlockingQueue<Job> decoded_;
+	BlockingQueue<Job> ordered_;
+	int served_;
+};
+#endif
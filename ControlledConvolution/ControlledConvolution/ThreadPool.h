@@ -0,0 +1,114 @@
+#pragma once
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+/*
+ * Fixed size pool of worker threads. Tasks are run in submission order by whichever worker
+ * is free; Submit returns a future for the result (exceptions are rethrown by get()).
+ */
+class ThreadPool
+{
+public:
+	explicit ThreadPool(size_t threads = 0) : stop_(false)
+	{
+		if (threads == 0) threads = (std::max)(1u, std::thread::hardware_concurrency());
+
+		for (size_t i = 0; i < threads; i++)
+		{
+			workers_.emplace_back([this] { Work(); });
+		}
+	}
+
+	~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			stop_ = true;
+		}
+
+		condition_.notify_all();
+		for (auto& worker : workers_) worker.join();
+	}
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	size_t Size() const { return workers_.size(); }
+
+	template <typename F>
+	auto Submit(F&& f) -> std::future<decltype(f())>
+	{
+		typedef decltype(f()) R;
+		auto task = std::make_shared<std::packaged_task<R()>>(std::forward<F>(f));
+		auto result = task->get_future();
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			tasks_.emplace([task] { (*task)(); });
+		}
+
+		condition_.notify_one();
+		return result;
+	}
+
+	/// <summary>
+	/// Runs body(i) for every i in [begin, end) on the pool and waits for all of them.
+	/// The first exception thrown by a body is rethrown once every task has finished.
+	/// </summary>
+	template <typename F>
+	void ParallelFor(const size_t begin, const size_t end, F body)
+	{
+		if (begin >= end) return;
+
+		// one task per worker pulling indices keeps the queue short for large ranges
+		auto next = std::make_shared<std::atomic<size_t>>(begin);
+		std::vector<std::future<void>> pending;
+		const auto tasks = (std::min)(workers_.size(), end - begin);
+
+		for (size_t t = 0; t < tasks; t++)
+		{
+			pending.push_back(Submit([next, end, &body]
+			{
+				for (auto i = (*next)++; i < end; i = (*next)++) body(i);
+			}));
+		}
+
+		for (auto& p : pending) p.wait();
+		for (auto& p : pending) p.get();
+	}
+
+private:
+	void Work()
+	{
+		for (;;)
+		{
+			std::function<void()> task;
+			{
+				std::unique_lock<std::mutex> lock(mutex_);
+				condition_.wait(lock, [this] { return stop_ || !tasks_.empty(); });
+
+				if (stop_ && tasks_.empty()) return;
+
+				task = std::move(tasks_.front());
+				tasks_.pop();
+			}
+
+			task();
+		}
+	}
+
+	std::vector<std::thread> workers_;
+	std::queue<std::function<void()>> tasks_;
+	std::mutex mutex_;
+	std::condition_variable condition_;
+	bool stop_;
+};
+#endif
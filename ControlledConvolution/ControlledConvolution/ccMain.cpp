@@ -11,7 +11,23 @@
 #include "Reconstructor.h"
 #include <experimental/filesystem>
 #include <iomanip>
+#include <memory>
 #include "Dataset.h"
+#include "PermutationCache.h"
+#include "PermutationFile.h"
+#include "RunJournal.h"
+#include "StreamServer.h"
+#include "PixelSort.h"
+#include "Arena.h"
+#include "AllocationCounter.h"
+#include "FeatureIndex.h"
+#include "ClassScheduler.h"
+#include "convolution.h"
+#include "Filter.h"
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#endif
 
 typedef std::vector<std::string> stringvec;
 
@@ -112,6 +128,8 @@ static string ToString(const Order & order)
 		return "decreasing";
 	case Order::none:
 		return "none";
+	case Order::randomShuffle:
+		return "randomShuffle";
 	default: return "UnknownOrder";
 	}
 }
@@ -138,6 +156,18 @@ static string ToString(const SemiRandomSortType & order)
 	default: return "UnknownOrder";
 	}
 }
+//Relative change of a layer's channel means from the original to the reordered sample,
+//|means(reordered) - means(original)| / |means(original)|, -1 if the two can't be compared
+static double ProbeResponseChange(const Filter& probe, const cv::Mat& original, const cv::Mat& reordered)
+{
+	FeatureMap responses;
+	if (!probe.Forward(FeatureMap::FromMats(vector<cv::Mat>{ original, reordered }), responses, true)) return -1;
+
+	const auto means = responses.ChannelMeans();
+	const auto base = cv::norm(means.row(0));
+
+	return base > 0 ? cv::norm(means.row(1), means.row(0)) / base : 0;
+}
 
 
 int main(const int argc, char** argv)
@@ -178,7 +208,8 @@ int main(const int argc, char** argv)
 
 	//return -1;
 
-	cout << "Starting ...\n";
+	//stderr, stdout carries the frames in stream mode
+	clog << "Starting ...\n";
 	const String keys =
 		"{help h usage ?   |      | print this message}"
 		"{input_dir i iDir |<none>| directory containing samples}"
@@ -190,12 +221,25 @@ int main(const int argc, char** argv)
 		"{patch_height ph y   |8| patch height}"
 		"{height h         |224| resize input to this size before processing}"
 		"{width w          |224| resize input to this size before processing}"
-		"{datasetEntropy |false| resize input to this size before processing}"
+		"{datasetEntropy |false| compute the entropy statistics (mean, variance, distribution, pooled) of the dataset directory given as second argument}"
 		"{order |-1| ordering of patches during sorting. Options(0=increasing, 1=decreasing, 2=randomShuffle)}"
 		"{resize r |32| resize input to this size}"
 		"{roundup |false| round up input size to nearest power of 2}"
 		"{debug d |0| set debug mode. This flag must be followed by a sample (--sample=path to sample).}"
-		"{sample || sample to debug on}";
+		"{sample || sample to debug on}"
+		"{cache || directory of the persistent ordering cache. Samples found in the cache skip measure computation}"
+		"{permutation_only |false| write only the patch ordering of every sample (permutations.porp) instead of the reordered patches}"
+		"{resume |false| resume an interrupted run. Samples recorded in the run manifest are skipped and outputs are renamed into place once complete}"
+		"{stream |false| read length-prefixed images or tensors from stdin and write the ordered tensors to stdout}"
+		"{stream_queue |4| number of frames buffered between the decode, order and encode stages of stream mode}"
+		"{stream_max_frame |64| largest input frame payload of stream mode in MiB, longer frames are answered with an error frame}"
+		"{pixel_sort || sort the pixels of every saved patch by this key (sum, luminance, hue, c0, c1, c2) in the patch order}"
+		"{pixel_sort_rows |false| with pixel_sort, sort every row of a patch instead of the whole patch}"
+		"{feature_index || build (or extend) the per patch feature index of the class directories of the input directory in this directory and exit}"
+		"{per_class |false| the input directory is a dataset root with a subdirectory per class, classes are written to <output>/<size>/<measure>/<order>/<class>}"
+		"{threads |0| worker threads of per_class mode (0 = one per core)}"
+		"{io_limit |2| per_class mode: number of workers allowed to read or write samples at the same time}"
+		"{cnn_probe |0| output channels of a random 3x3 layer (Filter::Random) run on every saved sample and on its reordered patches, reports how much its channel means move (0 = off)}";
 
 	CommandLineParser parser(argc, argv, keys);
 
@@ -230,6 +274,7 @@ int main(const int argc, char** argv)
 
 		Dataset dataset(dir);
 		dataset.CalcualteEntropy();
+		cout << dataset;
 
 		return 0;
 	}
@@ -247,6 +292,19 @@ int main(const int argc, char** argv)
 	const auto debug = parser.get<bool>("debug");
 	const auto resized = parser.get<int>("resize");
 	const auto roundup = parser.get<bool>("roundup");
+	const auto cacheDir = parser.get<string>("cache");
+	const auto permutationOnly = parser.get<bool>("permutation_only");
+	const auto resume = parser.get<bool>("resume");
+	const auto stream = parser.get<bool>("stream");
+	const auto streamQueue = parser.get<int>("stream_queue");
+	const auto streamMaxFrame = parser.get<int>("stream_max_frame");
+	const auto pixelSort = parser.get<string>("pixel_sort");
+	const auto pixelSortRows = parser.get<bool>("pixel_sort_rows");
+	const auto featureIndexDir = parser.get<string>("feature_index");
+	const auto perClass = parser.get<bool>("per_class");
+	const auto threads = parser.get<int>("threads");
+	const auto ioLimit = parser.get<int>("io_limit");
+	const auto cnnProbe = parser.get<int>("cnn_probe");
 	auto done = false;
 
 	const fs::path path(iDir);
@@ -260,23 +318,7 @@ int main(const int argc, char** argv)
 	auto srst = SemiRandomSortType::none;
 	auto o = Order::none;
 
-	if (measure == "l1Norm" || measure == "l1norm") mt = MeasureType::l1Norm;
-	else if (measure == "l2norm" || measure == "l2Norm") mt = MeasureType::l2Norm;
-	else if (measure == "hamming" || measure == "hamming") mt = MeasureType::hammingNorm;
-	else if (measure == "c0e" || measure == "channel0_entropy") mt = MeasureType::channel0Entropy;
-	else if (measure == "c1e" || measure == "channel1_entropy") mt = MeasureType::channel1Entropy;
-	else if (measure == "c2e" || measure == "channel2_entropy") mt = MeasureType::channel2Entropy;
-	else if (measure == "ae" || measure == "average_entropy") mt = MeasureType::averageEntropy;
-	else if (measure == "psnr" || measure == "Psnr") mt = MeasureType::psnr;
-	else if (measure == "ssim" || measure == "ssim_average") mt = MeasureType::ssimAverage;
-	else if (measure == "ssim0" || measure == "channel0_ssim") mt = MeasureType::ssim0;
-	else if (measure == "ssim1" || measure == "channel1_ssim") mt = MeasureType::ssim1;
-	else if (measure == "ssim2" || measure == "channel2_ssim") mt = MeasureType::ssim2;
-	else if (measure == "mi" || measure == "mutual_information") mt = MeasureType::mi;
-	else if (measure == "je" || measure == "joint_entropy") mt = MeasureType::je;
-	else if (measure == "ce" || measure == "conditional_entropy") mt = MeasureType::ce;
-	else if (measure == "kl" || measure == "k-l") mt = MeasureType::kl;
-	else
+	if (!Common::ToMeasureType(measure, mt))
 	{
 		cerr << "Exit code: -4, Unknown measure type. Aborting ...\n";
 		return -4;
@@ -290,6 +332,41 @@ int main(const int argc, char** argv)
 	}
 
 	o = DetermineOrder(order);
+
+	auto pixelKey = PixelSortKey::sum;
+	if (!pixelSort.empty() && !PixelSort::ToKey(pixelSort, pixelKey))
+	{
+		cerr << "Exit code: -4, Unknown pixel sort key. Aborting ...\n";
+		return -4;
+	}
+	const auto pixelOrder = o == Order::decreasing ? Order::decreasing : Order::increasing;
+
+	if (stream)
+	{
+		if (patchWidth != patchHeight)
+		{
+			cerr << "Exit code: -2, This version ony supports square size patches and inputs.\n";
+			return -2;
+		}
+
+		//Frames own stdout, progress and warnings go to stderr
+		cout.rdbuf(cerr.rdbuf());
+#ifdef _WIN32
+		_setmode(_fileno(stdin), _O_BINARY);
+		_setmode(_fileno(stdout), _O_BINARY);
+#endif
+		const StreamOptions options = { inputSize, roundup, patchSize, mt, o, srst, permutationOnly,
+			static_cast<size_t>(max(1, streamQueue)), static_cast<uint32_t>(min(4095, max(1, streamMaxFrame))) << 20 };
+		StreamServer server(options);
+
+		cv::TickMeter tm;
+		tm.start();
+		const auto served = server.Run(stdin, stdout);
+		tm.stop();
+
+		cerr << "Served " << served << " frames. Time: " << tm.getTimeSec() << " sec.\n";
+		return 0;
+	}
 	
 
 	if (debug)
@@ -327,7 +404,6 @@ int main(const int argc, char** argv)
 			Patch p(img, patchCoordinate);
 			const auto name = Common::GeneratePatchName(patchCoordinate);
 			p.SetName(name);
-			p.ToPixel();
 			//p.Save(saveOutput, "bmp");
 
 			//STEP 4. Compute standalone image characterstics
@@ -377,6 +453,71 @@ int main(const int argc, char** argv)
 		return -2;
 	}
 
+	string ordering = "";
+	if (o != Order::none) ordering = "\\" + ToString(o);
+	if (srst != SemiRandomSortType::none) ordering = "\\" + ToString(srst);
+
+	const auto outputRoot = oDir + "\\" + to_string(patchHeight) + "x" +
+		to_string(patchWidth) + "\\" + measure + "\\" + ordering + (pixelSort.empty() ? "" : "\\pixelsort_" + pixelSort);
+
+	if (perClass)
+	{
+		if (!cacheDir.empty() || permutationOnly || resume || cnnProbe > 0)
+		{
+			cerr << "Exit code: -6, per_class mode doesn't support cache, permutation_only, resume or cnn_probe.\n";
+			return -6;
+		}
+
+		const ClassRunOptions options = { inputSize, roundup, patchSize, mt, o, srst, format,
+			static_cast<size_t>(max(1, ioLimit)), !pixelSort.empty(), pixelKey, pixelSortRows };
+		ThreadPool pool(static_cast<size_t>(max(0, threads)));
+		ClassScheduler scheduler(options, pool);
+
+		cout << "Per class run of " << iDir << " on " << pool.Size() << " threads, " << options.ioLimit
+			<< " concurrent reads/writes, output " << outputRoot << endl;
+
+		cv::TickMeter tc;
+		tc.start();
+		const auto throughput = scheduler.Run(iDir, outputRoot);
+		tc.stop();
+
+		ClassScheduler::Report(cout, throughput);
+		cout << "Done processing " << throughput.size() << " classes. Time: " << tc.getTimeSec() << " sec.\n";
+		return 0;
+	}
+
+	if (!featureIndexDir.empty())
+	{
+		//The index takes the class of a sample from its parent directory, iDir holds a directory per class
+		vector<string> samples;
+		for (const auto& c : ClassScheduler::ListClasses(iDir))
+			samples.insert(samples.end(), c.second.begin(), c.second.end());
+
+		if (samples.empty())
+		{
+			cerr << "Exit code: -3, Directory contains no class directories with samples.\n";
+			return -3;
+		}
+
+		ThreadPool pool;
+		cv::TickMeter ti;
+		ti.start();
+		const auto appended = FeatureIndex::Build(featureIndexDir, samples, inputSize, roundup, patchSize, pool);
+		ti.stop();
+
+		const auto index = FeatureIndex::Open(featureIndexDir);
+		const auto p = index.Percentiles(FeatureColumn::averageEntropy, { 10, 50, 90 });
+		cout << "Indexed " << appended << " new samples in " << ti.getTimeSec() << " sec. " << index.Samples() << " samples, "
+			<< index.Rows() << " patches, average entropy p10/p50/p90: " << p[0] << "/" << p[1] << "/" << p[2] << endl;
+
+		for (const auto& c : index.Classes())
+		{
+			const auto cp = index.Percentiles(FeatureColumn::averageEntropy, { 10, 50, 90 }, index.ClassId(c));
+			cout << "\t" << c << ": " << cp[0] << "/" << cp[1] << "/" << cp[2] << endl;
+		}
+		return 0;
+	}
+
 	auto samples = GetSampleSet(iDir);
 
 	if (samples.empty())
@@ -393,6 +534,13 @@ int main(const int argc, char** argv)
 #endif
 
 	auto counter = 0;
+	uint64_t totalAllocations = 0;
+
+	//One layer for the whole run, so the changes of all samples are comparable
+	const auto probe = cnnProbe > 0 ? Filter::Random(cnnProbe, 3, 3, 1) : Filter();
+	double probeChange = 0;
+	auto probed = 0;
+	AllocationCounter::Install();
 
 	cv::TickMeter tm;
 	tm.start();
@@ -407,11 +555,45 @@ int main(const int argc, char** argv)
 		<< "\tHeight		    | " << patchHeight << endl
 		<< "\tNumber of Samples | " << samples.size() << endl;
 
+	//Only deterministic orderings are cached, a random one would replay its first permutation forever
+	const auto cacheable = o == Order::increasing || o == Order::decreasing || o == Order::none;
+	unique_ptr<PermutationCache> cache;
+	if (!cacheDir.empty() && cacheable) cache.reset(new PermutationCache(cacheDir));
+	else if (!cacheDir.empty()) cout << "Ordering " << ToString(o) << " is not deterministic, the cache is not used.\n";
+	const auto cacheOrdering = ToString(o) + ToString(srst);
+
+	unique_ptr<PermutationWriter> permutations;
+
+	//The manifest of a previous run is only trusted when resuming
+	const auto manifest = outputRoot + "\\manifest.txt";
+	unique_ptr<RunJournal> journal;
+	auto skipped = 0;
+	if (resume)
+	{
+		fs::create_directories(fs::path(outputRoot));
+		journal.reset(new RunJournal(manifest));
+		cout << "Resuming, " << journal->Completed() << " samples already completed.\n";
+	}
+	else if (fs::exists(fs::path(manifest)))
+	{
+		fs::remove(fs::path(manifest));
+	}
+
 	for (const auto& sample : samples)
 	{
 		counter++;
+
+		if (journal && journal->Done(sample))
+		{
+			skipped++;
+			continue;
+		}
 		const string title = "Original Image";
 
+		//Per sample temporaries come from the arena, rewound once the sample is deleted
+		ArenaScope arena;
+		const auto allocationsBefore = AllocationCounter::Now();
+
 		//Read Sample
 		auto s = new Sample(sample);
 		s->ToCvMat(inputSize,roundup);
@@ -429,6 +611,35 @@ int main(const int argc, char** argv)
 		//STEP 2. Generate patch proposals and coordinates
 		s->GeneratePatchProposals(patchSize);
 
+		//A cached ordering only needs the patches to be extracted, no measure is computed
+		uint64_t cacheKey = 0;
+		Permutation permutation;
+		auto cached = false;
+		if (cache)
+		{
+			cacheKey = PermutationCache::Hash(s->Mat(), patchSize, measure, cacheOrdering);
+			cached = cache->Lookup(cacheKey, permutation);
+		}
+
+		if (permutationOnly && !permutations)
+		{
+			const PermutationGrid grid = { resized, resized, patchHeight, patchWidth, roundup,
+				static_cast<int>(s->PatchesCoordinates().size()), measure, cacheOrdering };
+			fs::create_directories(fs::path(outputRoot));
+			permutations.reset(new PermutationWriter(outputRoot + "\\permutations.porp", grid, resume));
+		}
+
+		if (permutationOnly && cached)
+		{
+			//Nothing to extract, the cached ordering is all that is written
+			permutations->Append(sample, permutation);
+			if (journal) journal->MarkDone(sample);
+			ts.stop();
+			cout << "Sample " << counter << " cached, Time = " << ts.getTimeMilli() << " ms\n";
+			delete s;
+			continue;
+		}
+
 		//Extract patches
 		cout << "Sample " << counter << " 0% [";
 		for (const auto& patchCoordinate : s->PatchesCoordinates())
@@ -438,7 +649,6 @@ int main(const int argc, char** argv)
 			Patch p(img, patchCoordinate);
 			const auto name = Common::GeneratePatchName(patchCoordinate);
 			p.SetName(name);
-			p.ToPixel();
 			s->AddPatch(p);
 			img.release();
 			cout << "#";
@@ -449,24 +659,76 @@ int main(const int argc, char** argv)
 		s->SetSamplePatches(patches);
 		Reconstructor sampleReconstructor;
 		sampleReconstructor.SetSample(s);
-		
-		if (sampleReconstructor.SortPatches(patches, mt, o, srst))
+		auto sorted = true;
+
+		if (cached)
 		{
-			s->SetSortedSamplePatches(patches);
-			string ordering = "";
-			if (o != Order::none) ordering = "\\" + ToString(o);
-			if (srst != SemiRandomSortType::none) ordering = "\\" + ToString(srst);
+			patches = s->Permute(permutation);
+		}
+		else
+		{
+			sorted = sampleReconstructor.SortPatches(patches, mt, o, srst);
+			if (sorted && cache) cache->Store(cacheKey, s->ToPermutation(patches));
+		}
 
-			const auto outputDir = oDir  + "\\"+ to_string(patchHeight)+"x"+
-				to_string(patchWidth) + "\\" + measure +"\\"+ ordering + "\\" + s->BaseName();
+		if (sorted && permutationOnly)
+		{
+			permutations->Append(sample, cached ? permutation : s->ToPermutation(patches));
+		}
+		else if (sorted)
+		{
+			if (!pixelSort.empty())
+			{
+				//In place: every patch owns a distinct region and only the sorted patches are saved
+				for (auto& p : patches)
+				{
+					auto m = p.GetMat();
+					if (pixelSortRows) PixelSort::SortRows(m, pixelKey, pixelOrder);
+					else PixelSort::SortRegion(m, pixelKey, pixelOrder);
+				}
+			}
+
+			if (!probe.Empty())
+			{
+				//The saved patches tiled back in their order, against the sample they came from
+				vector<cv::Mat> mats;
+				for (const auto& p : patches) mats.push_back(p.GetMat());
+				const auto reordered = Convolution::TilePatches(mats, s->Mat().cols / patchWidth);
+				const auto change = ProbeResponseChange(probe, s->Mat(), reordered);
+				if (change >= 0)
+				{
+					probeChange += change;
+					probed++;
+				}
+			}
 
-			CreateDirecoty(outputDir);
-			s->SaveToDisc(outputDir, format);
+			s->SetSortedSamplePatches(patches);
+
+			const auto outputDir = outputRoot + "\\" + s->BaseName();
+
+			if (journal)
+			{
+				//Write next to the final directory and rename once every patch is on disc
+				const auto partial = outputDir + ".partial";
+				CreateDirecoty(partial);
+				s->SaveToDisc(partial, format);
+				RunJournal::Commit(partial, outputDir);
+			}
+			else
+			{
+				CreateDirecoty(outputDir);
+				s->SaveToDisc(outputDir, format);
+			}
 		}
 		else { throw exception("SortPatches failed, unable to save sorted patches"); }
+
+		if (journal) journal->MarkDone(sample);
 		ts.stop();
 
-		cout << "] 100%, Time = " << ts.getTimeMilli() << " ms\n";
+		const auto allocations = AllocationCounter::Now() - allocationsBefore;
+		totalAllocations += allocations.allocations;
+		cout << "] 100%, Time = " << ts.getTimeMilli() << " ms, allocations = " << allocations.allocations
+			<< " (" << allocations.bytes / 1024 << " KB)\n";
 
 		delete s;
 	}
@@ -475,6 +737,35 @@ int main(const int argc, char** argv)
 
 	cout << "Done processing " << samples.size() << "samples. Time: " << tm.getTimeSec() << " sec.";
 
+	if (journal)
+	{
+		cout << "\nSkipped " << skipped << " samples completed by a previous run.";
+	}
+
+	const auto processed = counter - skipped;
+	if (processed > 0)
+	{
+		cout << "\nHeap allocations: " << totalAllocations / processed << " per sample, arena peak "
+			<< Arena::ForThread().Peak() / 1024 << " KB.";
+	}
+
+	if (probed > 0)
+	{
+		cout << "\nProbe layer (" << cnnProbe << " channels): channel means moved by " << probeChange / probed * 100
+			<< "% on average over " << probed << " samples.";
+	}
+
+	if (permutations)
+	{
+		permutations->Close();
+		cout << "\nWrote " << permutations->Count() << " orderings to " << outputRoot << "\\permutations.porp";
+	}
+
+	if (cache)
+	{
+		cout << "\nOrdering cache " << cache->GetDir() << ": " << cache->Hits() << " hits, " << cache->Misses() << " misses.";
+	}
+
 	return 0;
 }
 
@@ -1,6 +1,183 @@
 #include "stdafx.h"
+#include <algorithm>
+#include <atomic>
 #include <cmath>
+#include <numeric>
+#include <vector>
 #include "convolution.h"
+#include "FftConvolution.h"
+
+// second singular value, relative to the first, below which a kernel is rank one
+static const double SEPARABLE_TOLERANCE = 1e-6;
+
+namespace
+{
+	// a single channel kernel Mat in the accumulator type, empty if it isn't one
+	template <typename Acc>
+	std::vector<Acc> KernelValues(const cv::Mat& kernel)
+	{
+		if (kernel.empty() || kernel.channels() != 1) return std::vector<Acc>();
+
+		cv::Mat converted;
+		kernel.convertTo(converted, cv::DataType<Acc>::type);
+		return std::vector<Acc>(converted.begin<Acc>(), converted.end<Acc>());
+	}
+
+	// 2D convolution of in with kernel, or separable with kernel and yKernel if one is given
+	template <typename T>
+	bool ConvolveMat(const cv::Mat& in, cv::Mat& out, const cv::Mat& kernel, const cv::Mat* yKernel,
+		const ConvolutionEngine& engine)
+	{
+		typedef typename ConvolutionTraits<T>::Accumulator Acc;
+
+		const auto xTaps = KernelValues<Acc>(kernel);
+		const auto yTaps = yKernel ? KernelValues<Acc>(*yKernel) : std::vector<Acc>();
+		if (xTaps.empty() || (yKernel && yTaps.empty())) return false;
+
+		// the engine reads and writes whole rows, views and in place calls go through copies
+		const cv::Mat src = in.isContinuous() ? in : in.clone();
+		out.create(in.size(), in.type());
+		const auto direct = out.isContinuous() && out.data != src.data;
+		auto dst = direct ? out : cv::Mat(in.size(), in.type());
+
+		const auto ok = yKernel
+			? engine.Convolve2DSeparable(src.ptr<T>(), dst.ptr<T>(), in.cols, in.rows, xTaps.data(),
+				static_cast<int>(xTaps.size()), yTaps.data(), static_cast<int>(yTaps.size()), in.channels())
+			: engine.Convolve2D(src.ptr<T>(), dst.ptr<T>(), in.cols, in.rows, xTaps.data(), kernel.cols, kernel.rows,
+				in.channels());
+
+		if (ok && !direct) dst.copyTo(out);
+		return ok;
+	}
+
+	bool ConvolveMat(const cv::Mat& in, cv::Mat& out, const cv::Mat& kernel, const cv::Mat* yKernel,
+		const ConvolutionEngine& engine)
+	{
+		if (in.empty()) return false;
+
+		switch (in.depth())
+		{
+		case CV_8U: return ConvolveMat<unsigned char>(in, out, kernel, yKernel, engine);
+		case CV_16U: return ConvolveMat<unsigned short>(in, out, kernel, yKernel, engine);
+		case CV_16S: return ConvolveMat<int16_t>(in, out, kernel, yKernel, engine);
+		case CV_32S: return ConvolveMat<int>(in, out, kernel, yKernel, engine);
+		case CV_32F: return ConvolveMat<float>(in, out, kernel, yKernel, engine);
+		case CV_64F: return ConvolveMat<double>(in, out, kernel, yKernel, engine);
+		default: return false;
+		}
+	}
+
+	// per patch convolution of in with kernel, or separable with kernel and yKernel if one is given
+	template <typename T>
+	bool ConvolvePatchesMat(const cv::Mat& in, cv::Mat& out, const cv::Size& patch, const cv::Mat& kernel,
+		const cv::Mat* yKernel, const PatchBorder border, const ConvolutionEngine& engine)
+	{
+		typedef typename ConvolutionTraits<T>::Accumulator Acc;
+
+		const auto xTaps = KernelValues<Acc>(kernel);
+		const auto yTaps = yKernel ? KernelValues<Acc>(*yKernel) : std::vector<Acc>();
+		if (xTaps.empty() || (yKernel && yTaps.empty())) return false;
+		if (patch.width <= 0 || patch.height <= 0 || in.cols % patch.width != 0 || in.rows % patch.height != 0) return false;
+
+		const auto kSizeX = yKernel ? static_cast<int>(xTaps.size()) : kernel.cols;
+		const auto kSizeY = yKernel ? static_cast<int>(yTaps.size()) : kernel.rows;
+		const auto outX = ConvolutionEngine::PatchOutputSize(patch.width, kSizeX, border);
+		const auto outY = ConvolutionEngine::PatchOutputSize(patch.height, kSizeY, border);
+		if (outX <= 0 || outY <= 0) return false;
+
+		// out holds a response per patch, in the grid of in; never in place, its size differs in valid mode
+		const cv::Mat src = in.isContinuous() ? in : in.clone();
+		const cv::Size size(in.cols / patch.width * outX, in.rows / patch.height * outY);
+		out.create(size, in.type());
+		const auto direct = out.isContinuous() && out.data != src.data;
+		auto dst = direct ? out : cv::Mat(size, in.type());
+
+		const auto ok = yKernel
+			? engine.Convolve2DSeparablePatches(src.ptr<T>(), dst.ptr<T>(), in.cols, in.rows, patch.width, patch.height,
+				xTaps.data(), kSizeX, yTaps.data(), kSizeY, border, in.channels())
+			: engine.Convolve2DPatches(src.ptr<T>(), dst.ptr<T>(), in.cols, in.rows, patch.width, patch.height,
+				xTaps.data(), kSizeX, kSizeY, border, in.channels());
+
+		if (ok && !direct) dst.copyTo(out);
+		return ok;
+	}
+
+	bool ConvolvePatchesMat(const cv::Mat& in, cv::Mat& out, const cv::Size& patch, const cv::Mat& kernel,
+		const cv::Mat* yKernel, const PatchBorder border, const ConvolutionEngine& engine)
+	{
+		if (in.empty()) return false;
+
+		switch (in.depth())
+		{
+		case CV_8U: return ConvolvePatchesMat<unsigned char>(in, out, patch, kernel, yKernel, border, engine);
+		case CV_16U: return ConvolvePatchesMat<unsigned short>(in, out, patch, kernel, yKernel, border, engine);
+		case CV_16S: return ConvolvePatchesMat<int16_t>(in, out, patch, kernel, yKernel, border, engine);
+		case CV_32S: return ConvolvePatchesMat<int>(in, out, patch, kernel, yKernel, border, engine);
+		case CV_32F: return ConvolvePatchesMat<float>(in, out, patch, kernel, yKernel, border, engine);
+		case CV_64F: return ConvolvePatchesMat<double>(in, out, patch, kernel, yKernel, border, engine);
+		default: return false;
+		}
+	}
+
+	// a 2D kernel with its rank one factors, separated once for every image it is applied to
+	struct Kernel2D
+	{
+		explicit Kernel2D(const cv::Mat& k) : kernel(k), separable(Convolution::Separate(k, x, y))
+		{
+		}
+
+		cv::Mat kernel;
+		cv::Mat x;
+		cv::Mat y;
+		bool separable;
+	};
+
+	bool Convolve2DMat(const cv::Mat& in, cv::Mat& out, const Kernel2D& k, ConvolutionMethod method,
+		const ConvolutionEngine& engine)
+	{
+		if (in.empty() || k.kernel.empty() || k.kernel.channels() != 1) return false;
+		if (method == ConvolutionMethod::automatic) method = Convolution::Select(in.size(), k.kernel.size(), k.separable);
+
+		switch (method)
+		{
+		case ConvolutionMethod::separable:
+			return k.separable && ConvolveMat(in, out, k.x, &k.y, engine);
+		case ConvolutionMethod::fft:
+			return FftConvolution::Shared().Convolve2D(in, out, k.kernel);
+		default:
+			return ConvolveMat(in, out, k.kernel, nullptr, engine);
+		}
+	}
+
+	// convolve(in, out, engine) for every image
+	template <typename F>
+	bool ConvolveBatch(const vector<cv::Mat>& in, vector<cv::Mat>& out, ThreadPool& pool, const bool fixedPoint,
+		const F& convolve)
+	{
+		out.resize(in.size());
+		std::atomic<bool> ok(true);
+
+		if (in.size() >= pool.Size())
+		{
+			// one image per task, each on a single thread
+			const ConvolutionEngine engine(nullptr, 0, fixedPoint);
+			pool.ParallelFor(0, in.size(), [&](const size_t i)
+			{
+				if (!convolve(in[i], out[i], engine)) ok = false;
+			});
+		}
+		else
+		{
+			const ConvolutionEngine engine(&pool, 0, fixedPoint);
+			for (size_t i = 0; i < in.size(); i++)
+			{
+				if (!convolve(in[i], out[i], engine)) ok = false;
+			}
+		}
+
+		return ok;
+	}
+}
 
 ///////////////////////////////////////////////////////////////////////////////
 // 1D convolution
@@ -77,1289 +254,158 @@ bool Convolution::Convolve2DSlow(unsigned char* in, unsigned char* out, const in
 	return true;
 }
 
-// 2D convolution
-// 2D data are usually stored in computer memory as contiguous 1D array.
-// So, we are using 1D array for 2D data.
-// 2D convolution assumes the kernel is center originated, which means, if
-// kernel size 3 then, k[-1], k[0], k[1]. The middle of index is always 0.
-// The following programming logics are somewhat complicated because of using
-// pointer indexing in order to minimize the number of multiplications.
-
-// unsigned char version (8bit): Note that the output is always positive number
-bool Convolution::Convolve2D(unsigned char* in, unsigned char* out, const int data_size_x, const int data_size_y,
-	float* kernel, const int kernel_size_x, const int kernel_size_y)
+///////////////////////////////////////////////////////////////////////////////
+// Composition filter
+///////////////////////////////////////////////////////////////////////////////
+bool Convolution::OrderByComposition(const double* in, double* out, const int sizeX, const int sizeY,
+	const int patchSizeX, const int patchSizeY, const double* xKernel, const int kSizeX, const double* yKernel,
+	const int kSizeY, int* permutation, const bool decreasing)
 {
-	unsigned char *inPtr2;
-
-	// check validity of params
-	if (!in || !out || !kernel) return false;
-	if (data_size_x <= 0 || kernel_size_x <= 0) return false;
+	if (!permutation) return false;
 
-	// find center position of kernel (half of kernel size)
-	const auto k_center_x = kernel_size_x >> 1;
-	const auto k_center_y = kernel_size_y >> 1;
+	// the identity ordering is a plain separable convolution
+	if (!ConvolutionEngine().ControlledConvolve2DSeparable(in, out, sizeX, sizeY, patchSizeX, patchSizeY, nullptr,
+		xKernel, kSizeX, yKernel, kSizeY)) return false;
 
-	// init working  pointers
-	auto in_ptr = inPtr2 = &in[data_size_x * k_center_y + k_center_x];  // note that  it is shifted (kCenterX, kCenterY),
-	auto outPtr = out;
-	auto kPtr = kernel;
+	const auto cellsX = sizeX / patchSizeX;
+	const auto cells = cellsX * (sizeY / patchSizeY);
+	std::vector<double> energy(cells, 0.0);
 
-	// start convolution
-	for (int i = 0; i < data_size_y; ++i)                   // number of rows
+	for (auto cell = 0; cell < cells; ++cell)
 	{
-		// compute the range of convolution, the current row of kernel should be between these
-		int rowMax = i + k_center_y;
-		int rowMin = i - data_size_y + k_center_y;
-
-		for (int j = 0; j < data_size_x; ++j)              // number of columns
-		{
-			// compute the range of convolution, the current column of kernel should be between these
-			int colMax = j + k_center_x;
-			int colMin = j - data_size_x + k_center_x;
-
-			float sum = 0;                                // set to 0 before accumulate
-
-			// flip the kernel and traverse all the kernel values
-			// multiply each kernel value with underlying Sample data
-			for (int m = 0; m < kernel_size_y; ++m)        // kernel rows
-			{
-				// check if the index is out of bound of Sample array
-				if (m <= rowMax && m > rowMin)
-				{
-					for (auto n = 0; n < kernel_size_x; ++n)
-					{
-						// check the boundary of array
-						if (n <= colMax && n > colMin)
-							sum += *(in_ptr - n) * *kPtr;
-
-						++kPtr;                     // next kernel
-					}
-				}
-				else
-					kPtr += kernel_size_x;            // out of bound, move to next row of kernel
-
-				in_ptr -= data_size_x;                 // move Sample data 1 raw up
-			}
+		const auto outCell = out + static_cast<size_t>((cell / cellsX) * patchSizeY) * sizeX + (cell % cellsX) * patchSizeX;
 
-			// convert negative number to positive
-			*outPtr = static_cast<unsigned char>(static_cast<float>(fabs(sum)) + 0.5f);
+		for (auto i = 0; i < patchSizeY; ++i)
+			for (auto j = 0; j < patchSizeX; ++j)
+				energy[cell] += fabs(outCell[static_cast<size_t>(i) * sizeX + j]);
 
-			kPtr = kernel;                          // reset kernel to (0,0)
-			in_ptr = ++inPtr2;                       // next Sample
-			++outPtr;                               // next output
-		}
+		energy[cell] /= patchSizeX * patchSizeY;
 	}
 
-	return true;
-}
-
-// unsigned short (16bit)
-bool Convolution::Convolve2D(unsigned short* in, unsigned short* out, const int data_size_x, const int data_size_y,
-	float* kernel, const int kernel_size_x, const int kernel_size_y)
-{
-	unsigned short *in_ptr2;
-
-	// check validity of params
-	if (!in || !out || !kernel) return false;
-	if (data_size_x <= 0 || kernel_size_x <= 0) return false;
-
-	// find center position of kernel (half of kernel size)
-	const int k_center_x = kernel_size_x >> 1;
-	const auto k_center_y = kernel_size_y >> 1;
-
-	// init working  pointers
-	auto in_ptr = in_ptr2 = &in[data_size_x * k_center_y + k_center_x];  // note that  it is shifted (kCenterX, kCenterY),
-	auto out_ptr = out;
-	auto k_ptr = kernel;
-
-	// start convolution
-	for (auto i = 0; i < data_size_y; ++i)                   // number of rows
+	// stable, equal responses keep their grid order
+	std::iota(permutation, permutation + cells, 0);
+	std::stable_sort(permutation, permutation + cells, [&](const int a, const int b)
 	{
-		// compute the range of convolution, the current row of kernel should be between these
-		const auto row_max = i + k_center_y;
-		const auto row_min = i - data_size_y + k_center_y;
-
-		for (auto j = 0; j < data_size_x; ++j)              // number of columns
-		{
-			// compute the range of convolution, the current column of kernel should be between these
-			int colMax = j + k_center_x;
-			int colMin = j - data_size_x + k_center_x;
-
-			float sum = 0;                                // set to 0 before accumulate
-
-			// flip the kernel and traverse all the kernel values
-			// multiply each kernel value with underlying Sample data
-			for (int m = 0; m < kernel_size_y; ++m)        // kernel rows
-			{
-				// check if the index is out of bound of Sample array
-				if (m <= row_max && m > row_min)
-				{
-					for (int n = 0; n < kernel_size_x; ++n)
-					{
-						// check the boundary of array
-						if (n <= colMax && n > colMin)
-							sum += *(in_ptr - n) * *k_ptr;
-
-						++k_ptr;                     // next kernel
-					}
-				}
-				else
-					k_ptr += kernel_size_x;            // out of bound, move to next row of kernel
-
-				in_ptr -= data_size_x;                 // move Sample data 1 raw up
-			}
-
-			// convert negative number to positive
-			*out_ptr = static_cast<unsigned short>(static_cast<float>(fabs(sum)) + 0.5f);
-
-			k_ptr = kernel;                          // reset kernel to (0,0)
-			in_ptr = ++in_ptr2;                       // next Sample
-			++out_ptr;                               // next output
-		}
-	}
+		return decreasing ? energy[a] > energy[b] : energy[a] < energy[b];
+	});
 
 	return true;
 }
 
-// signed integer (32bit) version:
-bool Convolution::Convolve2D(int* in, int* out, const int dataSizeX, const int dataSizeY,
-	float* kernel, const int kernelSizeX, const int kernelSizeY)
+///////////////////////////////////////////////////////////////////////////////
+// Mat convolution
+// Every channel of the interleaved pixels in one pass of the engine.
+///////////////////////////////////////////////////////////////////////////////
+bool Convolution::Convolve2D(const cv::Mat& in, cv::Mat& out, const cv::Mat& kernel, ThreadPool* pool,
+	const ConvolutionMethod method)
 {
-	int *inPtr2;
-
-	// check validity of params
-	if (!in || !out || !kernel) return false;
-	if (dataSizeX <= 0 || kernelSizeX <= 0) return false;
-
-	// find center position of kernel (half of kernel size)
-	const auto kCenterX = kernelSizeX >> 1;
-	const auto kCenterY = kernelSizeY >> 1;
-
-	// init working  pointers
-	auto inPtr = inPtr2 = &in[dataSizeX * kCenterY + kCenterX];  // note that  it is shifted (kCenterX, kCenterY),
-	auto outPtr = out;
-	auto kPtr = kernel;
-
-	// start convolution
-	for (auto i = 0; i < dataSizeY; ++i)                   // number of rows
-	{
-		// compute the range of convolution, the current row of kernel should be between these
-		const auto rowMax = i + kCenterY;
-		const auto rowMin = i - dataSizeY + kCenterY;
-
-		for (auto j = 0; j < dataSizeX; ++j)              // number of columns
-		{
-			// compute the range of convolution, the current column of kernel should be between these
-			const auto colMax = j + kCenterX;
-			const auto colMin = j - dataSizeX + kCenterX;
-
-			float sum = 0;                                // set to 0 before accumulate
-
-			// flip the kernel and traverse all the kernel values
-			// multiply each kernel value with underlying Sample data
-			for (auto m = 0; m < kernelSizeY; ++m)        // kernel rows
-			{
-				// check if the index is out of bound of Sample array
-				if (m <= rowMax && m > rowMin)
-				{
-					for (auto n = 0; n < kernelSizeX; ++n)
-					{
-						// check the boundary of array
-						if (n <= colMax && n > colMin)
-							sum += *(inPtr - n) * *kPtr;
-
-						++kPtr;                     // next kernel
-					}
-				}
-				else
-					kPtr += kernelSizeX;            // out of bound, move to next row of kernel
-
-				inPtr -= dataSizeX;                 // move Sample data 1 raw up
-			}
-
-			// convert integer number
-			if (sum >= 0) *outPtr = static_cast<int>(sum + 0.5f);
-			else *outPtr = static_cast<int>(sum - 0.5f);
-
-			kPtr = kernel;                          // reset kernel to (0,0)
-			inPtr = ++inPtr2;                       // next Sample
-			++outPtr;                               // next output
-		}
-	}
-
-	return true;
+	return Convolve2DMat(in, out, Kernel2D(kernel), method, ConvolutionEngine(pool, 0, fixedPoint_));
 }
 
-// single float precision version:
-bool Convolution::Convolve2D(float* in, float* out, const int dataSizeX, const int dataSizeY,
-	float* kernel, const int kernelSizeX, const int kernelSizeY)
+bool Convolution::Convolve2DSeparable(const cv::Mat& in, cv::Mat& out, const cv::Mat& xKernel, const cv::Mat& yKernel,
+	ThreadPool* pool)
 {
-	float *inPtr2;
-
-	// check validity of params
-	if (!in || !out || !kernel) return false;
-	if (dataSizeX <= 0 || kernelSizeX <= 0) return false;
-
-	// find center position of kernel (half of kernel size)
-	const auto kCenterX = kernelSizeX >> 1;
-	const auto kCenterY = kernelSizeY >> 1;
-
-	// init working  pointers
-	auto inPtr = inPtr2 = &in[dataSizeX * kCenterY + kCenterX];  // note that  it is shifted (kCenterX, kCenterY),
-	auto outPtr = out;
-	auto kPtr = kernel;
-
-	// start convolution
-	for (auto i = 0; i < dataSizeY; ++i)                   // number of rows
-	{
-		// compute the range of convolution, the current row of kernel should be between these
-		const auto rowMax = i + kCenterY;
-		const auto rowMin = i - dataSizeY + kCenterY;
-
-		for (auto j = 0; j < dataSizeX; ++j)              // number of columns
-		{
-			// compute the range of convolution, the current column of kernel should be between these
-			const auto colMax = j + kCenterX;
-			const auto colMin = j - dataSizeX + kCenterX;
-
-			*outPtr = 0;                            // set to 0 before accumulate
-
-			// flip the kernel and traverse all the kernel values
-			// multiply each kernel value with underlying Sample data
-			for (auto m = 0; m < kernelSizeY; ++m)        // kernel rows
-			{
-				// check if the index is out of bound of Sample array
-				if (m <= rowMax && m > rowMin)
-				{
-					for (auto n = 0; n < kernelSizeX; ++n)
-					{
-						// check the boundary of array
-						if (n <= colMax && n > colMin)
-							*outPtr += *(inPtr - n) * *kPtr;
-						++kPtr;                     // next kernel
-					}
-				}
-				else
-					kPtr += kernelSizeX;            // out of bound, move to next row of kernel
-
-				inPtr -= dataSizeX;                 // move Sample data 1 raw up
-			}
-
-			kPtr = kernel;                          // reset kernel to (0,0)
-			inPtr = ++inPtr2;                       // next Sample
-			++outPtr;                               // next output
-		}
-	}
-
-	return true;
+	return ConvolveMat(in, out, xKernel, &yKernel, ConvolutionEngine(pool, 0, fixedPoint_));
 }
 
-// double float precision version:
-bool Convolution::Convolve2D(double* in, double* out, const int dataSizeX, const int dataSizeY,
-	double* kernel, const int kernelSizeX, const int kernelSizeY)
+///////////////////////////////////////////////////////////////////////////////
+// Per patch convolution
+// Every grid cell of in convolved on its own, all cells in one pass.
+///////////////////////////////////////////////////////////////////////////////
+bool Convolution::Convolve2DPatches(const cv::Mat& in, cv::Mat& out, const cv::Size& patch, const cv::Mat& kernel,
+	const PatchBorder border, ThreadPool* pool)
 {
-	double *inPtr2;
-
-	// check validity of params
-	if (!in || !out || !kernel) return false;
-	if (dataSizeX <= 0 || kernelSizeX <= 0) return false;
-
-	// find center position of kernel (half of kernel size)
-	const auto kCenterX = kernelSizeX >> 1;
-	const auto kCenterY = kernelSizeY >> 1;
-
-	// init working  pointers
-	auto inPtr = inPtr2 = &in[dataSizeX * kCenterY + kCenterX];  // note that  it is shifted (kCenterX, kCenterY),
-	auto outPtr = out;
-	auto kPtr = kernel;
-
-	// start convolution
-	for (auto i = 0; i < dataSizeY; ++i)                   // number of rows
-	{
-		// compute the range of convolution, the current row of kernel should be between these
-		const auto rowMax = i + kCenterY;
-		const auto rowMin = i - dataSizeY + kCenterY;
-
-		for (auto j = 0; j < dataSizeX; ++j)              // number of columns
-		{
-			// compute the range of convolution, the current column of kernel should be between these
-			const auto colMax = j + kCenterX;
-			const auto colMin = j - dataSizeX + kCenterX;
-
-			*outPtr = 0;                            // set to 0 before accumulate
-
-			// flip the kernel and traverse all the kernel values
-			// multiply each kernel value with underlying Sample data
-			for (int m = 0; m < kernelSizeY; ++m)        // kernel rows
-			{
-				// check if the index is out of bound of Sample array
-				if (m <= rowMax && m > rowMin)
-				{
-					for (int n = 0; n < kernelSizeX; ++n)
-					{
-						// check the boundary of array
-						if (n <= colMax && n > colMin)
-							*outPtr += *(inPtr - n) * *kPtr;
-						++kPtr;                     // next kernel
-					}
-				}
-				else
-					kPtr += kernelSizeX;            // out of bound, move to next row of kernel
-
-				inPtr -= dataSizeX;                 // move Sample data 1 raw up
-			}
-
-			kPtr = kernel;                          // reset kernel to (0,0)
-			inPtr = ++inPtr2;                       // next Sample
-			++outPtr;                               // next output
-		}
-	}
-
-	return true;
+	return ConvolvePatchesMat(in, out, patch, kernel, nullptr, border, ConvolutionEngine(pool));
 }
 
-// Separable 2D Convolution
-// If the MxN kernel can be separable to (Mx1) and (1xN) matrices, the
-// multiplication can be reduced to M+N comapred to MxN in normal convolution.
-// It does not check the output is excceded max for performance reason. And we
-// assume the kernel contains good(valid) data, therefore, the result cannot be
-// larger than max.
-
-// unsigned char (8-bit) version
-bool Convolution::Convolve2DSeparable(unsigned char* in, unsigned char* out, int dataSizeX, int dataSizeY,
-	float* kernelX, int kSizeX, float* kernelY, int kSizeY)
+bool Convolution::Convolve2DSeparablePatches(const cv::Mat& in, cv::Mat& out, const cv::Size& patch,
+	const cv::Mat& xKernel, const cv::Mat& yKernel, const PatchBorder border, ThreadPool* pool)
 {
-	int i, j, k, m, n;
-	float*tmpPtr2;                        // working pointers
-	int kOffset;                 // kernel indice
-
-	// check validity of params
-	if (!in || !out || !kernelX || !kernelY) return false;
-	if (dataSizeX <= 0 || kSizeX <= 0) return false;
-
-	// allocate temp storage to keep intermediate result
-	float *tmp = new float[dataSizeX * dataSizeY];
-	if (!tmp) return false;  // memory allocation error
-
-	// store accumulated sum
-	float *sum = new float[dataSizeX];
-	if (!sum) return false;  // memory allocation error
-
-	// covolve horizontal direction ///////////////////////
+	return ConvolvePatchesMat(in, out, patch, xKernel, &yKernel, border, ConvolutionEngine(pool));
+}
 
-	// find center position of kernel (half of kernel size)
-	int kCenter = kSizeX >> 1;                          // center index of kernel array
-	int endIndex = dataSizeX - kCenter;                 // index for full kernel convolution
+cv::Mat Convolution::TilePatches(const vector<cv::Mat>& patches, const int columns)
+{
+	if (patches.empty() || columns <= 0) return cv::Mat();
 
-	// init working pointers
-	unsigned char *inPtr = in;
-	float *tmpPtr = tmp;                                   // store intermediate results from 1D horizontal convolution
+	const auto size = patches.front().size();
+	const auto type = patches.front().type();
+	const auto rows = static_cast<int>((patches.size() + columns - 1) / columns);
+	cv::Mat grid = cv::Mat::zeros(rows * size.height, columns * size.width, type);
 
-	// start horizontal convolution (x-direction)
-	for (i = 0; i < dataSizeY; ++i)                    // number of rows
+	for (size_t i = 0; i < patches.size(); i++)
 	{
-		kOffset = 0;                                // starting index of partial kernel varies for each Sample
-
-		// COLUMN FROM index=0 TO index=kCenter-1
-		for (j = 0; j < kCenter; ++j)
-		{
-			*tmpPtr = 0;                            // init to 0 before accumulation
-
-			for (k = kCenter + kOffset, m = 0; k >= 0; --k, ++m) // convolve with partial of kernel
-			{
-				*tmpPtr += *(inPtr + m) * kernelX[k];
-			}
-			++tmpPtr;                               // next output
-			++kOffset;                              // increase starting index of kernel
-		}
-
-		// COLUMN FROM index=kCenter TO index=(dataSizeX-kCenter-1)
-		for (j = kCenter; j < endIndex; ++j)
-		{
-			*tmpPtr = 0;                            // init to 0 before accumulate
-
-			for (k = kSizeX - 1, m = 0; k >= 0; --k, ++m)  // full kernel
-			{
-				*tmpPtr += *(inPtr + m) * kernelX[k];
-			}
-			++inPtr;                                // next Sample
-			++tmpPtr;                               // next output
-		}
-
-		kOffset = 1;                                // ending index of partial kernel varies for each Sample
-
-		// COLUMN FROM index=(dataSizeX-kCenter) TO index=(dataSizeX-1)
-		for (j = endIndex; j < dataSizeX; ++j)
-		{
-			*tmpPtr = 0;                            // init to 0 before accumulation
-
-			for (k = kSizeX - 1, m = 0; k >= kOffset; --k, ++m)   // convolve with partial of kernel
-			{
-				*tmpPtr += *(inPtr + m) * kernelX[k];
-			}
-			++inPtr;                                // next Sample
-			++tmpPtr;                               // next output
-			++kOffset;                              // increase ending index of partial kernel
-		}
+		if (patches[i].size() != size || patches[i].type() != type) return cv::Mat();
 
-		inPtr += kCenter;                           // next row
+		const auto cell = static_cast<int>(i);
+		patches[i].copyTo(grid(cv::Rect(cell % columns * size.width, cell / columns * size.height, size.width,
+			size.height)));
 	}
-	// END OF HORIZONTAL CONVOLUTION //////////////////////
-
-	// start vertical direction ///////////////////////////
-
-	// find center position of kernel (half of kernel size)
-	kCenter = kSizeY >> 1;                          // center index of vertical kernel
-	endIndex = dataSizeY - kCenter;                 // index where full kernel convolution should stop
-
-	// set working pointers
-	tmpPtr = tmpPtr2 = tmp;
-	unsigned char *outPtr = out;
-
-	// clear out array before accumulation
-	for (i = 0; i < dataSizeX; ++i)
-		sum[i] = 0;
 
-	// start to convolve vertical direction (y-direction)
+	return grid;
+}
 
-	// ROW FROM index=0 TO index=(kCenter-1)
-	kOffset = 0;                                    // starting index of partial kernel varies for each Sample
-	for (i = 0; i < kCenter; ++i)
+///////////////////////////////////////////////////////////////////////////////
+// Batch convolution
+///////////////////////////////////////////////////////////////////////////////
+bool Convolution::Convolve2DBatch(const vector<cv::Mat>& in, vector<cv::Mat>& out, const cv::Mat& kernel,
+	ThreadPool& pool, const ConvolutionMethod method)
+{
+	const Kernel2D k(kernel);
+	return ConvolveBatch(in, out, pool, fixedPoint_, [&](const cv::Mat& image, cv::Mat& result, const ConvolutionEngine& engine)
 	{
-		for (k = kCenter + kOffset; k >= 0; --k)     // convolve with partial kernel
-		{
-			for (j = 0; j < dataSizeX; ++j)
-			{
-				sum[j] += *tmpPtr * kernelY[k];
-				++tmpPtr;
-			}
-		}
-
-		for (n = 0; n < dataSizeX; ++n)              // convert and copy from sum to out
-		{
-			// covert negative to positive
-			*outPtr = (unsigned char)((float)fabs(sum[n]) + 0.5f);
-			sum[n] = 0;                             // reset to zero for next summing
-			++outPtr;                               // next element of output
-		}
-
-		tmpPtr = tmpPtr2;                           // reset Sample pointer
-		++kOffset;                                  // increase starting index of kernel
-	}
+		return Convolve2DMat(image, result, k, method, engine);
+	});
+}
 
-	// ROW FROM index=kCenter TO index=(dataSizeY-kCenter-1)
-	for (i = kCenter; i < endIndex; ++i)
+bool Convolution::Convolve2DSeparableBatch(const vector<cv::Mat>& in, vector<cv::Mat>& out, const cv::Mat& xKernel,
+	const cv::Mat& yKernel, ThreadPool& pool)
+{
+	return ConvolveBatch(in, out, pool, fixedPoint_, [&](const cv::Mat& image, cv::Mat& result, const ConvolutionEngine& engine)
 	{
-		for (k = kSizeY - 1; k >= 0; --k)             // convolve with full kernel
-		{
-			for (j = 0; j < dataSizeX; ++j)
-			{
-				sum[j] += *tmpPtr * kernelY[k];
-				++tmpPtr;
-			}
-		}
+		return ConvolveMat(image, result, xKernel, &yKernel, engine);
+	});
+}
 
-		for (n = 0; n < dataSizeX; ++n)              // convert and copy from sum to out
-		{
-			// covert negative to positive
-			*outPtr = (unsigned char)((float)fabs(sum[n]) + 0.5f);
-			sum[n] = 0;                             // reset for next summing
-			++outPtr;                               // next output
-		}
+///////////////////////////////////////////////////////////////////////////////
+// Method selection
+///////////////////////////////////////////////////////////////////////////////
+ConvolutionMethod Convolution::Select(const cv::Size& image, const cv::Size& kernel, const bool separable)
+{
+	const auto direct = static_cast<double>(kernel.area());
+	const auto split = separable ? static_cast<double>(kernel.width + kernel.height) : direct;
+	const auto fft = FftConvolution::Cost(image, kernel);
 
-		// move to next row
-		tmpPtr2 += dataSizeX;
-		tmpPtr = tmpPtr2;
-	}
+	if (direct <= split && direct <= fft) return ConvolutionMethod::direct;
+	return split <= fft ? ConvolutionMethod::separable : ConvolutionMethod::fft;
+}
 
-	// ROW FROM index=(dataSizeY-kCenter) TO index=(dataSizeY-1)
-	kOffset = 1;                                    // ending index of partial kernel varies for each Sample
-	for (i = endIndex; i < dataSizeY; ++i)
-	{
-		for (k = kSizeY - 1; k >= kOffset; --k)        // convolve with partial kernel
-		{
-			for (j = 0; j < dataSizeX; ++j)
-			{
-				sum[j] += *tmpPtr * kernelY[k];
-				++tmpPtr;
-			}
-		}
+bool Convolution::Separate(const cv::Mat& kernel, cv::Mat& xKernel, cv::Mat& yKernel)
+{
+	if (kernel.empty() || kernel.channels() != 1) return false;
 
-		for (n = 0; n < dataSizeX; ++n)              // convert and copy from sum to out
-		{
-			// covert negative to positive
-			*outPtr = (unsigned char)((float)fabs(sum[n]) + 0.5f);
-			sum[n] = 0;                             // reset for next summing
-			++outPtr;                               // next output
-		}
+	cv::Mat k;
+	kernel.convertTo(k, CV_64F);
 
-		// move to next row
-		tmpPtr2 += dataSizeX;
-		tmpPtr = tmpPtr2;                           // next Sample
-		++kOffset;                                  // increase ending index of kernel
-	}
-	// END OF VERTICAL CONVOLUTION ////////////////////////
+	// singular values come in decreasing order
+	const cv::SVD svd(k);
+	const auto first = svd.w.at<double>(0);
+	if (first <= 0) return false;
+	if (svd.w.rows > 1 && svd.w.at<double>(1) > SEPARABLE_TOLERANCE * first) return false;
 
-	// deallocate temp buffers
-	delete[] tmp;
-	delete[] sum;
+	const auto scale = std::sqrt(first);
+	xKernel = svd.vt.row(0) * scale;
+	yKernel = svd.u.col(0) * scale;
 	return true;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-// unsigned short (16-bit) version
-///////////////////////////////////////////////////////////////////////////////
-bool Convolution::Convolve2DSeparable(unsigned short* in, unsigned short* out, int dataSizeX, int dataSizeY,
-	float* kernelX, int kSizeX, float* kernelY, int kSizeY)
-{
-	int i, j, k, m, n;
-	float*tmpPtr2;                        // working pointers
-	int kOffset;                 // kernel indice
-
-	// check validity of params
-	if (!in || !out || !kernelX || !kernelY) return false;
-	if (dataSizeX <= 0 || kSizeX <= 0) return false;
-
-	// allocate temp storage to keep intermediate result
-	float *tmp = new float[dataSizeX * dataSizeY];
-	if (!tmp) return false;  // memory allocation error
-
-	// store accumulated sum
-	float *sum = new float[dataSizeX];
-	if (!sum) return false;  // memory allocation error
-
-	// covolve horizontal direction ///////////////////////
-
-	// find center position of kernel (half of kernel size)
-	int kCenter = kSizeX >> 1;                          // center index of kernel array
-	int endIndex = dataSizeX - kCenter;                 // index for full kernel convolution
-
-	// init working pointers
-	unsigned short *inPtr = in;
-	float *tmpPtr = tmp;                                   // store intermediate results from 1D horizontal convolution
-
-	// start horizontal convolution (x-direction)
-	for (i = 0; i < dataSizeY; ++i)                    // number of rows
-	{
-		kOffset = 0;                                // starting index of partial kernel varies for each Sample
-
-		// COLUMN FROM index=0 TO index=kCenter-1
-		for (j = 0; j < kCenter; ++j)
-		{
-			*tmpPtr = 0;                            // init to 0 before accumulation
-
-			for (k = kCenter + kOffset, m = 0; k >= 0; --k, ++m) // convolve with partial of kernel
-			{
-				*tmpPtr += *(inPtr + m) * kernelX[k];
-			}
-			++tmpPtr;                               // next output
-			++kOffset;                              // increase starting index of kernel
-		}
-
-		// COLUMN FROM index=kCenter TO index=(dataSizeX-kCenter-1)
-		for (j = kCenter; j < endIndex; ++j)
-		{
-			*tmpPtr = 0;                            // init to 0 before accumulate
-
-			for (k = kSizeX - 1, m = 0; k >= 0; --k, ++m)  // full kernel
-			{
-				*tmpPtr += *(inPtr + m) * kernelX[k];
-			}
-			++inPtr;                                // next Sample
-			++tmpPtr;                               // next output
-		}
-
-		kOffset = 1;                                // ending index of partial kernel varies for each Sample
-
-		// COLUMN FROM index=(dataSizeX-kCenter) TO index=(dataSizeX-1)
-		for (j = endIndex; j < dataSizeX; ++j)
-		{
-			*tmpPtr = 0;                            // init to 0 before accumulation
-
-			for (k = kSizeX - 1, m = 0; k >= kOffset; --k, ++m)   // convolve with partial of kernel
-			{
-				*tmpPtr += *(inPtr + m) * kernelX[k];
-			}
-			++inPtr;                                // next Sample
-			++tmpPtr;                               // next output
-			++kOffset;                              // increase ending index of partial kernel
-		}
-
-		inPtr += kCenter;                           // next row
-	}
-	// END OF HORIZONTAL CONVOLUTION //////////////////////
-
-	// start vertical direction ///////////////////////////
-
-	// find center position of kernel (half of kernel size)
-	kCenter = kSizeY >> 1;                          // center index of vertical kernel
-	endIndex = dataSizeY - kCenter;                 // index where full kernel convolution should stop
-
-	// set working pointers
-	tmpPtr = tmpPtr2 = tmp;
-	unsigned short *outPtr = out;
-
-	// clear out array before accumulation
-	for (i = 0; i < dataSizeX; ++i)
-		sum[i] = 0;
-
-	// start to convolve vertical direction (y-direction)
-
-	// ROW FROM index=0 TO index=(kCenter-1)
-	kOffset = 0;                                    // starting index of partial kernel varies for each Sample
-	for (i = 0; i < kCenter; ++i)
-	{
-		for (k = kCenter + kOffset; k >= 0; --k)     // convolve with partial kernel
-		{
-			for (j = 0; j < dataSizeX; ++j)
-			{
-				sum[j] += *tmpPtr * kernelY[k];
-				++tmpPtr;
-			}
-		}
-
-		for (n = 0; n < dataSizeX; ++n)              // convert and copy from sum to out
-		{
-			// covert negative to positive
-			*outPtr = (unsigned short)((float)fabs(sum[n]) + 0.5f);
-			sum[n] = 0;                             // reset to zero for next summing
-			++outPtr;                               // next element of output
-		}
-
-		tmpPtr = tmpPtr2;                           // reset Sample pointer
-		++kOffset;                                  // increase starting index of kernel
-	}
-
-	// ROW FROM index=kCenter TO index=(dataSizeY-kCenter-1)
-	for (i = kCenter; i < endIndex; ++i)
-	{
-		for (k = kSizeY - 1; k >= 0; --k)             // convolve with full kernel
-		{
-			for (j = 0; j < dataSizeX; ++j)
-			{
-				sum[j] += *tmpPtr * kernelY[k];
-				++tmpPtr;
-			}
-		}
-
-		for (n = 0; n < dataSizeX; ++n)              // convert and copy from sum to out
-		{
-			// covert negative to positive
-			*outPtr = (unsigned short)((float)fabs(sum[n]) + 0.5f);
-			sum[n] = 0;                             // reset before next summing
-			++outPtr;                               // next output
-		}
-
-		// move to next row
-		tmpPtr2 += dataSizeX;
-		tmpPtr = tmpPtr2;
-	}
-
-	// ROW FROM index=(dataSizeY-kCenter) TO index=(dataSizeY-1)
-	kOffset = 1;                                    // ending index of partial kernel varies for each Sample
-	for (i = endIndex; i < dataSizeY; ++i)
-	{
-		for (k = kSizeY - 1; k >= kOffset; --k)        // convolve with partial kernel
-		{
-			for (j = 0; j < dataSizeX; ++j)
-			{
-				sum[j] += *tmpPtr * kernelY[k];
-				++tmpPtr;
-			}
-		}
-
-		for (n = 0; n < dataSizeX; ++n)              // convert and copy from sum to out
-		{
-			// covert negative to positive
-			*outPtr = (unsigned short)((float)fabs(sum[n]) + 0.5f);
-			sum[n] = 0;                             // reset before next summing
-			++outPtr;                               // next output
-		}
-
-		// move to next row
-		tmpPtr2 += dataSizeX;
-		tmpPtr = tmpPtr2;                           // next Sample
-		++kOffset;                                  // increase ending index of kernel
-	}
-	// END OF VERTICAL CONVOLUTION ////////////////////////
-
-	// deallocate temp buffers
-	delete[] tmp;
-	delete[] sum;
-	return true;
-}
-
-///////////////////////////////////////////////////////////////////////////////
-// integer (32-bit) version
-///////////////////////////////////////////////////////////////////////////////
-bool Convolution::Convolve2DSeparable(int* in, int* out, int dataSizeX, int dataSizeY,
-	float* kernelX, int kSizeX, float* kernelY, int kSizeY)
-{
-	int i, j, k, m, n;
-	float*tmpPtr2;                        // working pointers
-	int kOffset;                 // kernel indice
-
-	// check validity of params
-	if (!in || !out || !kernelX || !kernelY) return false;
-	if (dataSizeX <= 0 || kSizeX <= 0) return false;
-
-	// allocate temp storage to keep intermediate result
-	float *tmp = new float[dataSizeX * dataSizeY];
-	if (!tmp) return false;  // memory allocation error
-
-	// store accumulated sum
-	float *sum = new float[dataSizeX];
-	if (!sum) return false;  // memory allocation error
-
-	// covolve horizontal direction ///////////////////////
-
-	// find center position of kernel (half of kernel size)
-	int kCenter = kSizeX >> 1;                          // center index of kernel array
-	int endIndex = dataSizeX - kCenter;                 // index for full kernel convolution
-
-	// init working pointers
-	int *inPtr = in;
-	float *tmpPtr = tmp;                                   // store intermediate results from 1D horizontal convolution
-
-	// start horizontal convolution (x-direction)
-	for (i = 0; i < dataSizeY; ++i)                    // number of rows
-	{
-		kOffset = 0;                                // starting index of partial kernel varies for each Sample
-
-		// COLUMN FROM index=0 TO index=kCenter-1
-		for (j = 0; j < kCenter; ++j)
-		{
-			*tmpPtr = 0;                            // init to 0 before accumulation
-
-			for (k = kCenter + kOffset, m = 0; k >= 0; --k, ++m) // convolve with partial of kernel
-			{
-				*tmpPtr += *(inPtr + m) * kernelX[k];
-			}
-			++tmpPtr;                               // next output
-			++kOffset;                              // increase starting index of kernel
-		}
-
-		// COLUMN FROM index=kCenter TO index=(dataSizeX-kCenter-1)
-		for (j = kCenter; j < endIndex; ++j)
-		{
-			*tmpPtr = 0;                            // init to 0 before accumulate
-
-			for (k = kSizeX - 1, m = 0; k >= 0; --k, ++m)  // full kernel
-			{
-				*tmpPtr += *(inPtr + m) * kernelX[k];
-			}
-			++inPtr;                                // next Sample
-			++tmpPtr;                               // next output
-		}
-
-		kOffset = 1;                                // ending index of partial kernel varies for each Sample
-
-		// COLUMN FROM index=(dataSizeX-kCenter) TO index=(dataSizeX-1)
-		for (j = endIndex; j < dataSizeX; ++j)
-		{
-			*tmpPtr = 0;                            // init to 0 before accumulation
-
-			for (k = kSizeX - 1, m = 0; k >= kOffset; --k, ++m)   // convolve with partial of kernel
-			{
-				*tmpPtr += *(inPtr + m) * kernelX[k];
-			}
-			++inPtr;                                // next Sample
-			++tmpPtr;                               // next output
-			++kOffset;                              // increase ending index of partial kernel
-		}
-
-		inPtr += kCenter;                           // next row
-	}
-	// END OF HORIZONTAL CONVOLUTION //////////////////////
-
-	// start vertical direction ///////////////////////////
-
-	// find center position of kernel (half of kernel size)
-	kCenter = kSizeY >> 1;                          // center index of vertical kernel
-	endIndex = dataSizeY - kCenter;                 // index where full kernel convolution should stop
-
-	// set working pointers
-	tmpPtr = tmpPtr2 = tmp;
-	int *outPtr = out;
-
-	// clear out array before accumulation
-	for (i = 0; i < dataSizeX; ++i)
-		sum[i] = 0;
-
-	// start to convolve vertical direction (y-direction)
-
-	// ROW FROM index=0 TO index=(kCenter-1)
-	kOffset = 0;                                    // starting index of partial kernel varies for each Sample
-	for (i = 0; i < kCenter; ++i)
-	{
-		for (k = kCenter + kOffset; k >= 0; --k)     // convolve with partial kernel
-		{
-			for (j = 0; j < dataSizeX; ++j)
-			{
-				sum[j] += *tmpPtr * kernelY[k];
-				++tmpPtr;
-			}
-		}
-
-		for (n = 0; n < dataSizeX; ++n)              // convert and copy from sum to out
-		{
-			if (sum[n] >= 0)
-				*outPtr = (int)(sum[n] + 0.5f);     // store final result to output array
-			else
-				*outPtr = (int)(sum[n] - 0.5f);     // store final result to output array
-
-			sum[n] = 0;                             // reset to zero for next summing
-			++outPtr;                               // next element of output
-		}
-
-		tmpPtr = tmpPtr2;                           // reset Sample pointer
-		++kOffset;                                  // increase starting index of kernel
-	}
-
-	// ROW FROM index=kCenter TO index=(dataSizeY-kCenter-1)
-	for (i = kCenter; i < endIndex; ++i)
-	{
-		for (k = kSizeY - 1; k >= 0; --k)             // convolve with full kernel
-		{
-			for (j = 0; j < dataSizeX; ++j)
-			{
-				sum[j] += *tmpPtr * kernelY[k];
-				++tmpPtr;
-			}
-		}
-
-		for (n = 0; n < dataSizeX; ++n)              // convert and copy from sum to out
-		{
-			if (sum[n] >= 0)
-				*outPtr = (int)(sum[n] + 0.5f);     // store final result to output array
-			else
-				*outPtr = (int)(sum[n] - 0.5f);     // store final result to output array
-			sum[n] = 0;                             // reset to 0 before next summing
-			++outPtr;                               // next output
-		}
-
-		// move to next row
-		tmpPtr2 += dataSizeX;
-		tmpPtr = tmpPtr2;
-	}
-
-	// ROW FROM index=(dataSizeY-kCenter) TO index=(dataSizeY-1)
-	kOffset = 1;                                    // ending index of partial kernel varies for each Sample
-	for (i = endIndex; i < dataSizeY; ++i)
-	{
-		for (k = kSizeY - 1; k >= kOffset; --k)        // convolve with partial kernel
-		{
-			for (j = 0; j < dataSizeX; ++j)
-			{
-				sum[j] += *tmpPtr * kernelY[k];
-				++tmpPtr;
-			}
-		}
-
-		for (n = 0; n < dataSizeX; ++n)              // convert and copy from sum to out
-		{
-			if (sum[n] >= 0)
-				*outPtr = (int)(sum[n] + 0.5f);     // store final result to output array
-			else
-				*outPtr = (int)(sum[n] - 0.5f);     // store final result to output array
-			sum[n] = 0;                             // reset before next summing
-			++outPtr;                               // next output
-		}
-
-		// move to next row
-		tmpPtr2 += dataSizeX;
-		tmpPtr = tmpPtr2;                           // next Sample
-		++kOffset;                                  // increase ending index of kernel
-	}
-	// END OF VERTICAL CONVOLUTION ////////////////////////
-
-	// deallocate temp buffers
-	delete[] tmp;
-	delete[] sum;
-	return true;
-}
-
-///////////////////////////////////////////////////////////////////////////////
-// single precision float version
-///////////////////////////////////////////////////////////////////////////////
-bool Convolution::Convolve2DSeparable(float* in, float* out, int dataSizeX, int dataSizeY,
-	float* kernelX, int kSizeX, float* kernelY, int kSizeY)
-{
-	int i, j, k, m, n;
-	float*tmpPtr2;                        // working pointers
-	int kOffset;                 // kernel indice
-
-	// check validity of params
-	if (!in || !out || !kernelX || !kernelY) return false;
-	if (dataSizeX <= 0 || kSizeX <= 0) return false;
-
-	// allocate temp storage to keep intermediate result
-	float *tmp = new float[dataSizeX * dataSizeY];
-	if (!tmp) return false;  // memory allocation error
-
-	// store accumulated sum
-	float *sum = new float[dataSizeX];
-	if (!sum) return false;  // memory allocation error
-
-	// covolve horizontal direction ///////////////////////
-
-	// find center position of kernel (half of kernel size)
-	int kCenter = kSizeX >> 1;                          // center index of kernel array
-	int endIndex = dataSizeX - kCenter;                 // index for full kernel convolution
-
-	// init working pointers
-	float *inPtr = in;
-	float *tmpPtr = tmp;                                   // store intermediate results from 1D horizontal convolution
-
-	// start horizontal convolution (x-direction)
-	for (i = 0; i < dataSizeY; ++i)                    // number of rows
-	{
-		kOffset = 0;                                // starting index of partial kernel varies for each Sample
-
-		// COLUMN FROM index=0 TO index=kCenter-1
-		for (j = 0; j < kCenter; ++j)
-		{
-			*tmpPtr = 0;                            // init to 0 before accumulation
-
-			for (k = kCenter + kOffset, m = 0; k >= 0; --k, ++m) // convolve with partial of kernel
-			{
-				*tmpPtr += *(inPtr + m) * kernelX[k];
-			}
-			++tmpPtr;                               // next output
-			++kOffset;                              // increase starting index of kernel
-		}
-
-		// COLUMN FROM index=kCenter TO index=(dataSizeX-kCenter-1)
-		for (j = kCenter; j < endIndex; ++j)
-		{
-			*tmpPtr = 0;                            // init to 0 before accumulate
-
-			for (k = kSizeX - 1, m = 0; k >= 0; --k, ++m)  // full kernel
-			{
-				*tmpPtr += *(inPtr + m) * kernelX[k];
-			}
-			++inPtr;                                // next Sample
-			++tmpPtr;                               // next output
-		}
-
-		kOffset = 1;                                // ending index of partial kernel varies for each Sample
-
-		// COLUMN FROM index=(dataSizeX-kCenter) TO index=(dataSizeX-1)
-		for (j = endIndex; j < dataSizeX; ++j)
-		{
-			*tmpPtr = 0;                            // init to 0 before accumulation
-
-			for (k = kSizeX - 1, m = 0; k >= kOffset; --k, ++m)   // convolve with partial of kernel
-			{
-				*tmpPtr += *(inPtr + m) * kernelX[k];
-			}
-			++inPtr;                                // next Sample
-			++tmpPtr;                               // next output
-			++kOffset;                              // increase ending index of partial kernel
-		}
-
-		inPtr += kCenter;                           // next row
-	}
-	// END OF HORIZONTAL CONVOLUTION //////////////////////
-
-	// start vertical direction ///////////////////////////
-
-	// find center position of kernel (half of kernel size)
-	kCenter = kSizeY >> 1;                          // center index of vertical kernel
-	endIndex = dataSizeY - kCenter;                 // index where full kernel convolution should stop
-
-	// set working pointers
-	tmpPtr = tmpPtr2 = tmp;
-	float *outPtr = out;
-
-	// clear out array before accumulation
-	for (i = 0; i < dataSizeX; ++i)
-		sum[i] = 0;
-
-	// start to convolve vertical direction (y-direction)
-
-	// ROW FROM index=0 TO index=(kCenter-1)
-	kOffset = 0;                                    // starting index of partial kernel varies for each Sample
-	for (i = 0; i < kCenter; ++i)
-	{
-		for (k = kCenter + kOffset; k >= 0; --k)     // convolve with partial kernel
-		{
-			for (j = 0; j < dataSizeX; ++j)
-			{
-				sum[j] += *tmpPtr * kernelY[k];
-				++tmpPtr;
-			}
-		}
-
-		for (n = 0; n < dataSizeX; ++n)              // convert and copy from sum to out
-		{
-			*outPtr = sum[n];                       // store final result to output array
-			sum[n] = 0;                             // reset to zero for next summing
-			++outPtr;                               // next element of output
-		}
-
-		tmpPtr = tmpPtr2;                           // reset Sample pointer
-		++kOffset;                                  // increase starting index of kernel
-	}
-
-	// ROW FROM index=kCenter TO index=(dataSizeY-kCenter-1)
-	for (i = kCenter; i < endIndex; ++i)
-	{
-		for (k = kSizeY - 1; k >= 0; --k)             // convolve with full kernel
-		{
-			for (j = 0; j < dataSizeX; ++j)
-			{
-				sum[j] += *tmpPtr * kernelY[k];
-				++tmpPtr;
-			}
-		}
-
-		for (n = 0; n < dataSizeX; ++n)              // convert and copy from sum to out
-		{
-			*outPtr = sum[n];                       // store final result to output buffer
-			sum[n] = 0;                             // reset before next summing
-			++outPtr;                               // next output
-		}
-
-		// move to next row
-		tmpPtr2 += dataSizeX;
-		tmpPtr = tmpPtr2;
-	}
-
-	// ROW FROM index=(dataSizeY-kCenter) TO index=(dataSizeY-1)
-	kOffset = 1;                                    // ending index of partial kernel varies for each Sample
-	for (i = endIndex; i < dataSizeY; ++i)
-	{
-		for (k = kSizeY - 1; k >= kOffset; --k)        // convolve with partial kernel
-		{
-			for (j = 0; j < dataSizeX; ++j)
-			{
-				sum[j] += *tmpPtr * kernelY[k];
-				++tmpPtr;
-			}
-		}
-
-		for (n = 0; n < dataSizeX; ++n)              // convert and copy from sum to out
-		{
-			*outPtr = sum[n];                       // store final result to output array
-			sum[n] = 0;                             // reset to 0 for next sum
-			++outPtr;                               // next output
-		}
-
-		// move to next row
-		tmpPtr2 += dataSizeX;
-		tmpPtr = tmpPtr2;                           // next Sample
-		++kOffset;                                  // increase ending index of kernel
-	}
-	// END OF VERTICAL CONVOLUTION ////////////////////////
-
-	// deallocate temp buffers
-	delete[] tmp;
-	delete[] sum;
-	return true;
-}
-
-bool Convolution::Convolve2DSeparable(double * in, double * out, int sizeX, int sizeY, double * xKernel, int kSizeX, double * yKernel, int kSizeY)
-{
-	return false;
-}
-
-bool Convolution::ControlledConvolve2DSeparable(double * in, double * out, int sizeX, int sizeY, double * xKernel, int kSizeX, double * yKernel, int kSizeY)
-{
-	return false;
-}
-
-bool Convolution::OrderByComposition(double * in, double * out, int sizeX, int sizeY, double * xKernel, int kSizeX, double * yKernel, int kSizeY)
-{
-	return false;
-}
-
-///////////////////////////////////////////////////////////////////////////////
-// double precision float version
-///////////////////////////////////////////////////////////////////////////////
-bool Convolution::Convolve2DSeparable(double* in, double* out, int dataSizeX, int dataSizeY,
-	double* kernelX, int kSizeX, float* kernelY, int kSizeY)
-{
-	int i, j, k, m, n;
-	double*tmpPtr2;                       // working pointers
-	int kOffset;                 // kernel indice
-
-	// check validity of params
-	if (!in || !out || !kernelX || !kernelY) return false;
-	if (dataSizeX <= 0 || kSizeX <= 0) return false;
-
-	// allocate temp storage to keep intermediate result
-	double *tmp = new double[dataSizeX * dataSizeY];
-	if (!tmp) return false;  // memory allocation error
-
-	// store accumulated sum
-	double *sum = new double[dataSizeX];
-	if (!sum) return false;  // memory allocation error
-
-	// covolve horizontal direction ///////////////////////
-
-	// find center position of kernel (half of kernel size)
-	int kCenter = kSizeX >> 1;                          // center index of kernel array
-	int endIndex = dataSizeX - kCenter;                 // index for full kernel convolution
-
-	// init working pointers
-	double *inPtr = in;
-	double *tmpPtr = tmp;                                   // store intermediate results from 1D horizontal convolution
-
-	// start horizontal convolution (x-direction)
-	for (i = 0; i < dataSizeY; ++i)                    // number of rows
-	{
-		kOffset = 0;                                // starting index of partial kernel varies for each Sample
-
-		// COLUMN FROM index=0 TO index=kCenter-1
-		for (j = 0; j < kCenter; ++j)
-		{
-			*tmpPtr = 0;                            // init to 0 before accumulation
-
-			for (k = kCenter + kOffset, m = 0; k >= 0; --k, ++m) // convolve with partial of kernel
-			{
-				*tmpPtr += *(inPtr + m) * kernelX[k];
-			}
-			++tmpPtr;                               // next output
-			++kOffset;                              // increase starting index of kernel
-		}
-
-		// COLUMN FROM index=kCenter TO index=(dataSizeX-kCenter-1)
-		for (j = kCenter; j < endIndex; ++j)
-		{
-			*tmpPtr = 0;                            // init to 0 before accumulate
-
-			for (k = kSizeX - 1, m = 0; k >= 0; --k, ++m)  // full kernel
-			{
-				*tmpPtr += *(inPtr + m) * kernelX[k];
-			}
-			++inPtr;                                // next Sample
-			++tmpPtr;                               // next output
-		}
-
-		kOffset = 1;                                // ending index of partial kernel varies for each Sample
-
-		// COLUMN FROM index=(dataSizeX-kCenter) TO index=(dataSizeX-1)
-		for (j = endIndex; j < dataSizeX; ++j)
-		{
-			*tmpPtr = 0;                            // init to 0 before accumulation
-
-			for (k = kSizeX - 1, m = 0; k >= kOffset; --k, ++m)   // convolve with partial of kernel
-			{
-				*tmpPtr += *(inPtr + m) * kernelX[k];
-			}
-			++inPtr;                                // next Sample
-			++tmpPtr;                               // next output
-			++kOffset;                              // increase ending index of partial kernel
-		}
-
-		inPtr += kCenter;                           // next row
-	}
-	// END OF HORIZONTAL CONVOLUTION //////////////////////
-
-	// start vertical direction ///////////////////////////
-
-	// find center position of kernel (half of kernel size)
-	kCenter = kSizeY >> 1;                          // center index of vertical kernel
-	endIndex = dataSizeY - kCenter;                 // index where full kernel convolution should stop
-
-	// set working pointers
-	tmpPtr = tmpPtr2 = tmp;
-	double *outPtr = out;
-
-	// clear out array before accumulation
-	for (i = 0; i < dataSizeX; ++i)
-		sum[i] = 0;
-
-	// start to convolve vertical direction (y-direction)
-
-	// ROW FROM index=0 TO index=(kCenter-1)
-	kOffset = 0;                                    // starting index of partial kernel varies for each Sample
-	for (i = 0; i < kCenter; ++i)
-	{
-		for (k = kCenter + kOffset; k >= 0; --k)     // convolve with partial kernel
-		{
-			for (j = 0; j < dataSizeX; ++j)
-			{
-				sum[j] += *tmpPtr * kernelY[k];
-				++tmpPtr;
-			}
-		}
-
-		for (n = 0; n < dataSizeX; ++n)              // convert and copy from sum to out
-		{
-			*outPtr = sum[n];                       // store final result to output array
-			sum[n] = 0;                             // reset to zero for next summing
-			++outPtr;                               // next element of output
-		}
-
-		tmpPtr = tmpPtr2;                           // reset Sample pointer
-		++kOffset;                                  // increase starting index of kernel
-	}
-
-	// ROW FROM index=kCenter TO index=(dataSizeY-kCenter-1)
-	for (i = kCenter; i < endIndex; ++i)
-	{
-		for (k = kSizeY - 1; k >= 0; --k)             // convolve with full kernel
-		{
-			for (j = 0; j < dataSizeX; ++j)
-			{
-				sum[j] += *tmpPtr * kernelY[k];
-				++tmpPtr;
-			}
-		}
-
-		for (n = 0; n < dataSizeX; ++n)              // convert and copy from sum to out
-		{
-			*outPtr = sum[n];                       // store final result to output array
-			sum[n] = 0;                             // reset to zero for next summing
-			++outPtr;                               // next output
-		}
-
-		// move to next row
-		tmpPtr2 += dataSizeX;
-		tmpPtr = tmpPtr2;
-	}
-
-	// ROW FROM index=(dataSizeY-kCenter) TO index=(dataSizeY-1)
-	kOffset = 1;                                    // ending index of partial kernel varies for each Sample
-	for (i = endIndex; i < dataSizeY; ++i)
-	{
-		for (k = kSizeY - 1; k >= kOffset; --k)        // convolve with partial kernel
-		{
-			for (j = 0; j < dataSizeX; ++j)
-			{
-				sum[j] += *tmpPtr * kernelY[k];
-				++tmpPtr;
-			}
-		}
-
-		for (n = 0; n < dataSizeX; ++n)              // convert and copy from sum to out
-		{
-			*outPtr = sum[n];                       // store final result to output array
-			sum[n] = 0;                             // reset to zero for next summing
-			++outPtr;                               // increase ending index of partial kernel
-		}
-
-		// move to next row
-		tmpPtr2 += dataSizeX;
-		tmpPtr = tmpPtr2;                           // next Sample
-		++kOffset;                                  // increase ending index of kernel
-	}
-	// END OF VERTICAL CONVOLUTION ////////////////////////
-
-	// deallocate temp buffers
-	delete[] tmp;
-	delete[] sum;
-	return true;
-}
-
-///////////////////////////////////////////////////////////////////////////////
-// 2D Convolution Fast
-// In order to improve the performance, this function uses multple cursors of
-// Sample signal. It avoids indexing Sample array during convolution. And, the
-// Sample signal is partitioned to 9 different sections, so we don't need to
-// check the boundary for every samples.
+// 2D Convolution Fast
+// Runs on ConvolutionEngine: the Sample is copied band by band into a buffer
+// with a zero border, so no boundary is checked for any sample, and the inner
+// loops are vectorized. The result is bit identical to Convolve2DSlow, unless
+// fixedPoint_ is set: the fixed point loops quantize the kernel, their result is
+// within ConvolutionEngine::FixedPointErrorBound plus one of it.
 ///////////////////////////////////////////////////////////////////////////////
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -1368,271 +414,24 @@ bool Convolution::Convolve2DSeparable(double* in, double* out, int dataSizeX, in
 bool Convolution::Convolve2DFast(unsigned char* in, unsigned char* out, int dataSizeX, int dataSizeY,
 	float* kernel, int kernelSizeX, int kernelSizeY)
 {
-	int i, j, m, n, x, t;
-	float sum;                                      // temp accumulation buffer
-	int k;
-
-	// check validity of params
-	if (!in || !out || !kernel) return false;
-	if (dataSizeX <= 0 || kernelSizeX <= 0) return false;
-
-	// find center position of kernel (half of kernel size)
-	int kCenterX = kernelSizeX >> 1;
-	int kCenterY = kernelSizeY >> 1;
-	int kSize = kernelSizeX * kernelSizeY;              // total kernel size
-
-	// allocate memeory for multi-cursor
-	unsigned char **inPtr = new unsigned char*[kSize];
-	if (!inPtr) return false;                        // allocation error
-
-	// set initial position of multi-cursor, NOTE: it is swapped instead of kernel
-	unsigned char *ptr = in + (dataSizeX * kCenterY + kCenterX); // the first cursor is shifted (kCenterX, kCenterY)
-	for (m = 0, t = 0; m < kernelSizeY; ++m)
-	{
-		for (n = 0; n < kernelSizeX; ++n, ++t)
-		{
-			inPtr[t] = ptr - n;
-		}
-		ptr -= dataSizeX;
-	}
-
-	// init working  pointers
-	unsigned char *outPtr = out;
-
-	int rowEnd = dataSizeY - kCenterY;                  // bottom row partition divider
-	int colEnd = dataSizeX - kCenterX;                  // right column partition divider
-
-	// convolve rows from index=0 to index=kCenterY-1
-	int y = kCenterY;
-	for (i = 0; i < kCenterY; ++i)
-	{
-		// partition #1 ***********************************
-		x = kCenterX;
-		for (j = 0; j < kCenterX; ++j)                 // column from index=0 to index=kCenterX-1
-		{
-			sum = 0;
-			t = 0;
-			for (m = 0; m <= y; ++m)
-			{
-				for (n = 0; n <= x; ++n)
-				{
-					sum += *inPtr[t] * kernel[t];
-					++t;
-				}
-				t += (kernelSizeX - x - 1);         // jump to next row
-			}
-
-			// store output
-			*outPtr = (unsigned char)((float)fabs(sum) + 0.5f);
-			++outPtr;
-			++x;
-			for (k = 0; k < kSize; ++k) ++inPtr[k];    // move all cursors to next
-		}
-
-		// partition #2 ***********************************
-		for (j = kCenterX; j < colEnd; ++j)            // column from index=kCenterX to index=(dataSizeX-kCenterX-1)
-		{
-			sum = 0;
-			t = 0;
-			for (m = 0; m <= y; ++m)
-			{
-				for (n = 0; n < kernelSizeX; ++n)
-				{
-					sum += *inPtr[t] * kernel[t];
-					++t;
-				}
-			}
-
-			// store output
-			*outPtr = (unsigned char)((float)fabs(sum) + 0.5f);
-			++outPtr;
-			++x;
-			for (k = 0; k < kSize; ++k) ++inPtr[k];    // move all cursors to next
-		}
-
-		// partition #3 ***********************************
-		x = 1;
-		for (j = colEnd; j < dataSizeX; ++j)           // column from index=(dataSizeX-kCenter) to index=(dataSizeX-1)
-		{
-			sum = 0;
-			t = x;
-			for (m = 0; m <= y; ++m)
-			{
-				for (n = x; n < kernelSizeX; ++n)
-				{
-					sum += *inPtr[t] * kernel[t];
-					++t;
-				}
-				t += x;                             // jump to next row
-			}
-
-			// store output
-			*outPtr = static_cast<unsigned char>(static_cast<float>(fabs(sum)) + 0.5f);
-			++outPtr;
-			++x;
-			for (k = 0; k < kSize; ++k) ++inPtr[k];    // move all cursors to next
-		}
-
-		++y;                                        // add one more row to convolve for next run
-	}
-
-	// convolve rows from index=kCenterY to index=(dataSizeY-kCenterY-1)
-	for (i = kCenterY; i < rowEnd; ++i)               // number of rows
-	{
-		// partition #4 ***********************************
-		x = kCenterX;
-		for (j = 0; j < kCenterX; ++j)                 // column from index=0 to index=kCenterX-1
-		{
-			sum = 0;
-			t = 0;
-			for (m = 0; m < kernelSizeY; ++m)
-			{
-				for (n = 0; n <= x; ++n)
-				{
-					sum += *inPtr[t] * kernel[t];
-					++t;
-				}
-				t += (kernelSizeX - x - 1);
-			}
-
-			// store output
-			*outPtr = static_cast<unsigned char>(static_cast<float>(fabs(sum)) + 0.5f);
-			++outPtr;
-			++x;
-			for (k = 0; k < kSize; ++k) ++inPtr[k];    // move all cursors to next
-		}
-
-		// partition #5 ***********************************
-		for (j = kCenterX; j < colEnd; ++j)          // column from index=kCenterX to index=(dataSizeX-kCenterX-1)
-		{
-			sum = 0;
-			t = 0;
-			for (m = 0; m < kernelSizeY; ++m)
-			{
-				for (n = 0; n < kernelSizeX; ++n)
-				{
-					sum += *inPtr[t] * kernel[t];
-					++inPtr[t]; // in this partition, all cursors are used to convolve. moving cursors to next is safe here
-					++t;
-				}
-			}
-
-			// store output
-			*outPtr = static_cast<unsigned char>(static_cast<float>(fabs(sum)) + 0.5f);
-			++outPtr;
-			++x;
-		}
-
-		// partition #6 ***********************************
-		x = 1;
-		for (j = colEnd; j < dataSizeX; ++j)           // column from index=(dataSizeX-kCenter) to index=(dataSizeX-1)
-		{
-			sum = 0;
-			t = x;
-			for (m = 0; m < kernelSizeY; ++m)
-			{
-				for (n = x; n < kernelSizeX; ++n)
-				{
-					sum += *inPtr[t] * kernel[t];
-					++t;
-				}
-				t += x;
-			}
-
-			// store output
-			*outPtr = static_cast<unsigned char>(static_cast<float>(fabs(sum)) + 0.5f);
-			++outPtr;
-			++x;
-			for (k = 0; k < kSize; ++k) ++inPtr[k];    // move all cursors to next
-		}
-	}
-
-	// convolve rows from index=(dataSizeY-kCenterY) to index=(dataSizeY-1)
-	y = 1;
-	for (i = rowEnd; i < dataSizeY; ++i)               // number of rows
-	{
-		// partition #7 ***********************************
-		x = kCenterX;
-		for (j = 0; j < kCenterX; ++j)                 // column from index=0 to index=kCenterX-1
-		{
-			sum = 0;
-			t = kernelSizeX * y;
-
-			for (m = y; m < kernelSizeY; ++m)
-			{
-				for (n = 0; n <= x; ++n)
-				{
-					sum += *inPtr[t] * kernel[t];
-					++t;
-				}
-				t += (kernelSizeX - x - 1);
-			}
-
-			// store output
-			*outPtr = static_cast<unsigned char>(static_cast<float>(fabs(sum)) + 0.5f);
-			++outPtr;
-			++x;
-			for (k = 0; k < kSize; ++k) ++inPtr[k];    // move all cursors to next
-		}
-
-		// partition #8 ***********************************
-		for (j = kCenterX; j < colEnd; ++j)            // column from index=kCenterX to index=(dataSizeX-kCenterX-1)
-		{
-			sum = 0;
-			t = kernelSizeX * y;
-			for (m = y; m < kernelSizeY; ++m)
-			{
-				for (n = 0; n < kernelSizeX; ++n)
-				{
-					sum += *inPtr[t] * kernel[t];
-					++t;
-				}
-			}
-
-			// store output
-			*outPtr = (unsigned char)((float)fabs(sum) + 0.5f);
-			++outPtr;
-			++x;
-			for (k = 0; k < kSize; ++k) ++inPtr[k];
-		}
-
-		// partition #9 ***********************************
-		x = 1;
-		for (j = colEnd; j < dataSizeX; ++j)           // column from index=(dataSizeX-kCenter) to index=(dataSizeX-1)
-		{
-			sum = 0;
-			t = kernelSizeX * y + x;
-			for (m = y; m < kernelSizeY; ++m)
-			{
-				for (n = x; n < kernelSizeX; ++n)
-				{
-					sum += *inPtr[t] * kernel[t];
-					++t;
-				}
-				t += x;
-			}
-
-			// store output
-			*outPtr = (unsigned char)((float)fabs(sum) + 0.5f);
-			++outPtr;
-			++x;
-			for (k = 0; k < kSize; ++k) ++inPtr[k];    // move all cursors to next
-		}
-
-		++y;                                        // the starting row index is increased
-	}
-
-	return true;
+	return ConvolutionEngine(nullptr, 0, fixedPoint_).Convolve2D(in, out, dataSizeX, dataSizeY, kernel, kernelSizeX,
+		kernelSizeY);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 // Fast 2D Convolution using integer multiplication instead of float.
 // Multiply coefficient(factor) to accumulated sum at last.
-// NOTE: IT IS NOT FASTER THAN FLOAT MULTIPLICATION, TRY YOURSELF!!!
+// Kernels that fit int16 taps run on the 16 bit multiply-adds of the fixed
+// point engine, with the same int sums scaled by factor in float; wider kernels
+// take the multi-cursor loops below.
 ///////////////////////////////////////////////////////////////////////////////
 bool Convolution::Convolve2DFast2(unsigned char* in, unsigned char* out, int dataSizeX, int dataSizeY,
 	int* kernel, float factor, int kernelSizeX, int kernelSizeY)
 {
+	FixedPointKernel fixed;
+	if (FixedPointKernel::FromIntegers(kernel, kernelSizeX, kernelSizeY, factor, FixedPointTraits<unsigned char>::MAX_ABS,
+		fixed)) return ConvolutionEngine().Convolve2DFixed(in, out, dataSizeX, dataSizeY, fixed);
+
 	int i, j, m, n, x, t;
 	int sum;                                        // temp accumulation buffer
 	int k;
@@ -1646,9 +445,8 @@ bool Convolution::Convolve2DFast2(unsigned char* in, unsigned char* out, int dat
 	int kCenterY = kernelSizeY >> 1;
 	int kSize = kernelSizeX * kernelSizeY;              // total kernel size
 
-	// allocate memeory for multi-cursor
-	unsigned char **inPtr = new unsigned char*[kSize];
-	if (!inPtr) return false;                        // allocation error
+	// multi-cursor
+	std::vector<unsigned char*> inPtr(kSize);
 
 	// set initial position of multi-cursor, NOTE: it is swapped instead of kernel
 	unsigned char *ptr = in + (dataSizeX * kCenterY + kCenterX); // the first cursor is shifted (kCenterX, kCenterY)
@@ -1,10 +1,29 @@
 #ifndef CONVOLUTION_H
 #define CONVOLUTION_H
 #include "Filter.h"
+#include "ConvolutionEngine.h"
+
+/// <summary>
+/// How the Mat routines convolve with a 2D kernel.
+///automatic - the cheapest of the others for the image and kernel size (Convolution::Select)
+///direct - the engine's 2D loops, kernel width * height taps per pixel
+///separable - the row and column factors of a rank one kernel, width + height taps per pixel
+///fft - FftConvolution, for large kernels
+/// </summary>
+enum class ConvolutionMethod { automatic, direct, separable, fft };
 
 class Convolution
 {
 public:
+	// Fixed point mode ///////////////////////////////////////////////////////////
+	// Runs the 8 and 16 bit images (unsigned char, unsigned short, int16_t) of
+	// Convolve2D, Convolve2DSeparable, ControlledConvolve2DSeparable and the
+	// direct and separable Mat methods in fixed point: kernels quantized to int16
+	// taps, 16 bit multiply-adds into int32 sums (see ConvolutionEngine). Results
+	// are within ConvolutionEngine::FixedPointErrorBound (plus one) of the float
+	// ones. Other pixel types and the FFT method are not affected.
+	///////////////////////////////////////////////////////////////////////////////
+	explicit Convolution(bool fixedPoint = false) : fixedPoint_(fixedPoint) {}
 	// 1D convolution /////////////////////////////////////////////////////////////
 	// We assume Sample and kernel signal start from t=0. (The first element of
 	// kernel and Sample signal is at t=0)
@@ -20,50 +39,142 @@ public:
 	// So, we are using 1D array for 2D data.
 	// 2D convolution assumes the kernel is center originated, which means, if
 	// kernel size 3 then, k[-1], k[0], k[1]. The middle of index is always 0.
-	// The following programming logics are somewhat complicated because of using
-	// pointer indexing in order to minimize the number of multiplications.
+	// One implementation serves every pixel type with ConvolutionTraits
+	// (unsigned char, unsigned short, int16_t, int, float, double, Float16); the
+	// traits pick the kernel/accumulator type and how the sum is stored:
+	// unsigned types keep |sum| rounded, signed integers round to nearest and
+	// both saturate, floating point types store the sum.
+	// Multi-channel images are interleaved (BGR...), channels values per pixel,
+	// and every channel is convolved with the same kernel in the same pass.
 	// It returns false if parameters are not valid.
 	///////////////////////////////////////////////////////////////////////////////
-	bool Convolve2D(unsigned char* in, unsigned char* out, int sizeX, int sizeY, float* kernel, int kSizeX, int kSizeY);
-	bool Convolve2D(unsigned short* in, unsigned short* out, int sizeX, int sizeY, float* kernel, int kSizeX, int kSizeY);
-	bool Convolve2D(int* in, int* out, int sizeX, int sizeY, float* kernel, int kSizeX, int kSizeY);
-	bool Convolve2D(float* in, float* out, int sizeX, int sizeY, float* kernel, int kSizeX, int kSizeY);
-	bool Convolve2D(double* in, double* out, int sizeX, int sizeY, double* kernel, int kSizeX, int kSizeY);
+	template <typename T>
+	bool Convolve2D(const T* in, T* out, int sizeX, int sizeY,
+		const typename ConvolutionTraits<T>::Accumulator* kernel, int kSizeX, int kSizeY, int channels = 1)
+	{
+		return ConvolutionEngine(nullptr, 0, fixedPoint_).Convolve2D(in, out, sizeX, sizeY, kernel, kSizeX, kSizeY,
+			channels);
+	}
 	// 2D separable convolution ///////////////////////////////////////////////////
 	// If the MxN kernel can be separable to (Mx1) and (1xN) matrices, the
 	// multiplication can be reduced to M+N compared to MxN in normal convolution.
-	// It does not check the output is exceeded max for performance reason. And we
-	// assume the kernel contains good(valid) data, therefore, the result cannot be
-	// larger than max.
+	// The intermediate (horizontal) result is kept in the accumulator type and
+	// the output is stored as in Convolve2D.
 	// It returns false if parameters are not valid.
 	///////////////////////////////////////////////////////////////////////////////
-	bool Convolve2DSeparable(unsigned char* in, unsigned char* out, int sizeX, int sizeY, 
-		float* xKernel, int kSizeX, float* yKernel, int kSizeY);
-	bool Convolve2DSeparable(unsigned short* in, unsigned short* out, int sizeX, int sizeY, 
-		float* xKernel, int kSizeX, float* yKernel, int kSizeY);
-	bool Convolve2DSeparable(int* in, int* out, int sizeX, int sizeY, float* xKernel, int kSizeX, 
-		float* yKernel, int kSizeY);
-	bool Convolve2DSeparable(float* in, float* out, int size_x, int size_y, float* x_kernel, 
-		int k_size_x, float* y_kernel, int k_size_y);
-	bool Convolve2DSeparable(double* in, double* out, int size_x, int size_y, double* x_kernel, 
-		int k_size_x, double* y_kernel, int k_size_y);
-	//Signature for controlled convolution 
-	bool ControlledConvolve2DSeparable(double* in, double* out, int size_x, int size_y, 
-		double* x_kernel, int k_size_x, double* y_kernel, int k_size_y);
+	template <typename T>
+	bool Convolve2DSeparable(const T* in, T* out, int sizeX, int sizeY,
+		const typename ConvolutionTraits<T>::Accumulator* xKernel, int kSizeX,
+		const typename ConvolutionTraits<T>::Accumulator* yKernel, int kSizeY, int channels = 1)
+	{
+		return ConvolutionEngine(nullptr, 0, fixedPoint_).Convolve2DSeparable(in, out, sizeX, sizeY, xKernel, kSizeX,
+			yKernel, kSizeY, channels);
+	}
+	// Controlled convolution /////////////////////////////////////////////////////
+	// Separable convolution of the patch reordered image without building it.
+	// The image is a grid of patchSizeX x patchSizeY cells in row major order
+	// (the proposal order of Sample for square images); grid cell i of the
+	// reordered image holds cell permutation[i] of in. Rows of the reordered
+	// image are gathered one at a time from the source cells, so the halo of a
+	// cell comes from the source cells of its reordered neighbours, and the
+	// result is the same as Convolve2DSeparable on the reordered image, zero
+	// padded at the image border. A null permutation is the identity.
+	// It returns false if parameters are not valid or the image size is not a
+	// multiple of the patch size.
+	///////////////////////////////////////////////////////////////////////////////
+	template <typename T>
+	bool ControlledConvolve2DSeparable(const T* in, T* out, int sizeX, int sizeY, int patchSizeX, int patchSizeY,
+		const int* permutation, const typename ConvolutionTraits<T>::Accumulator* xKernel, int kSizeX,
+		const typename ConvolutionTraits<T>::Accumulator* yKernel, int kSizeY, int channels = 1)
+	{
+		return ConvolutionEngine(nullptr, 0, fixedPoint_).ControlledConvolve2DSeparable(in, out, sizeX, sizeY,
+			patchSizeX, patchSizeY, permutation, xKernel, kSizeX, yKernel, kSizeY, channels);
+	}
+	// Mat convolution ////////////////////////////////////////////////////////////
+	// Convolve2D and Convolve2DSeparable of a whole Mat, all channels of the
+	// interleaved pixels (samples and patches are BGR) in one pass. out gets the
+	// size and type of in. Depths CV_8U, CV_16U, CV_16S, CV_32S, CV_32F and
+	// CV_64F; kernels are single channel Mats of any depth, converted to the
+	// accumulator type of in (a separable kernel is a row or column vector).
+	// Views (patches of a sample) are read through a continuous copy. pool, if
+	// given, runs the row bands.
+	// A 2D kernel goes through method; separable needs a rank one kernel, and
+	// separable and fft results match direct up to floating point rounding.
+	// It returns false for an empty image, an unsupported depth or kernel.
+	///////////////////////////////////////////////////////////////////////////////
+	bool Convolve2D(const cv::Mat& in, cv::Mat& out, const cv::Mat& kernel, ThreadPool* pool = nullptr,
+		ConvolutionMethod method = ConvolutionMethod::automatic);
+	bool Convolve2DSeparable(const cv::Mat& in, cv::Mat& out, const cv::Mat& xKernel, const cv::Mat& yKernel,
+		ThreadPool* pool = nullptr);
+	// Per patch convolution //////////////////////////////////////////////////////
+	// Convolves every patch.width x patch.height cell of in's grid on its own
+	// (a batch of patches tiled by TilePatches, or the patches of a sample) in
+	// one pass over the grid, vectorized across the cells of a grid row.
+	// border valid keeps the outputs whose kernel lies inside the patch, clamp
+	// keeps every pixel and repeats the patch's edge pixels outside of it (see
+	// PatchBorder). out is the grid of the responses, each
+	// ConvolutionEngine::PatchOutputSize of the patch and kernel sizes, in the
+	// type of in; depths and kernels as in the Mat routines above. The patch
+	// routines always run in floating point or int accumulators.
+	// It returns false for an empty image, an image size that is not a multiple
+	// of the patch size, a valid border kernel larger than the patch, an
+	// unsupported depth or kernel.
+	///////////////////////////////////////////////////////////////////////////////
+	bool Convolve2DPatches(const cv::Mat& in, cv::Mat& out, const cv::Size& patch, const cv::Mat& kernel,
+		PatchBorder border, ThreadPool* pool = nullptr);
+	bool Convolve2DSeparablePatches(const cv::Mat& in, cv::Mat& out, const cv::Size& patch, const cv::Mat& xKernel,
+		const cv::Mat& yKernel, PatchBorder border, ThreadPool* pool = nullptr);
+	// Patches of one size and type copied into the cells of a grid, columns
+	// cells per row in row major order, the cells past the last patch zero.
+	// Empty if patches is empty or their sizes or types differ.
+	static cv::Mat TilePatches(const vector<cv::Mat>& patches, int columns);
+	// Batch convolution //////////////////////////////////////////////////////////
+	// Convolves every Mat of in (patches, or the samples of a class) into the
+	// same index of out with one kernel. Batches of at least as many images as
+	// the pool has workers run one image per task, smaller batches run the
+	// images one after the other with their row bands on the pool.
+	// It returns false if any image failed, the others are still convolved.
+	///////////////////////////////////////////////////////////////////////////////
+	bool Convolve2DBatch(const vector<cv::Mat>& in, vector<cv::Mat>& out, const cv::Mat& kernel, ThreadPool& pool,
+		ConvolutionMethod method = ConvolutionMethod::automatic);
+	bool Convolve2DSeparableBatch(const vector<cv::Mat>& in, vector<cv::Mat>& out, const cv::Mat& xKernel,
+		const cv::Mat& yKernel, ThreadPool& pool);
+	// Method selection ///////////////////////////////////////////////////////////
+	// The cheapest method for an image and kernel size, by taps per output
+	// pixel: direct, separable if the kernel is rank one, or FFT
+	// (FftConvolution::Cost). Ties go to the exact direct loops.
+	///////////////////////////////////////////////////////////////////////////////
+	static ConvolutionMethod Select(const cv::Size& image, const cv::Size& kernel, bool separable);
+	// Rank one kernels ///////////////////////////////////////////////////////////
+	// Factors kernel into a 1 x kSizeX row and a kSizeY x 1 column (double) whose
+	// outer product is the kernel, if its second singular value is negligible.
+	///////////////////////////////////////////////////////////////////////////////
+	static bool Separate(const cv::Mat& kernel, cv::Mat& xKernel, cv::Mat& yKernel);
 	// 2D convolution Fast ////////////////////////////////////////////////////////
-	// In order to improve the performance, this function uses multple cursors of
-	// Sample signal. It avoids indexing Sample array during convolution. And, the
-	// Sample signal is partitioned to 9 different sections, so we don't need to
-	// check the boundary for every samples.
+	// Padded, cache blocked and vectorized (see ConvolutionEngine), bit identical
+	// to Convolve2DSlow, except in fixed point mode: there the kernel is quantized
+	// to int16 taps and outputs are within FixedPointErrorBound plus one of it.
+	// Convolve2D runs on it for every pixel type; use ConvolutionEngine directly
+	// to run the row bands on a ThreadPool.
 	///////////////////////////////////////////////////////////////////////////////
 	bool Convolve2DFast(unsigned char* in, unsigned char* out, int size_x, int size_y, float* kernel, 
 		int k_size_x, int k_size_y);
+	// Integer kernel, the sum is multiplied by factor. Runs on the fixed point
+	// loops (Convolve2DFixed) when the kernel fits int16 taps and int32 sums,
+	// with the same integer sums, centered as Convolve2DSlow for even kernels.
 	bool Convolve2DFast2(unsigned char* in, unsigned char* out, int size_x, int size_y, int* kernel, 
 		float factor, int k_size_x, int k_size_y);
-	//Composition filter 
-	bool OrderByComposition(double* in, double* out, int size_x, int size_y, double* x_kernel, int k_size_x, 
-		double* y_kernel, int k_size_y);
-	bool Convolve2DSeparable(double* in, double* out, int dataSizeX, int dataSizeY,
-		double* kernelX, int kSizeX, float* kernelY, int kSizeY);
+	// Composition filter /////////////////////////////////////////////////////////
+	// Orders the patches of in by their response to the separable filter: out is
+	// the (unordered) filter response and permutation receives the grid cells
+	// sorted by mean absolute response, increasing unless decreasing is set.
+	// Feeding the permutation to ControlledConvolve2DSeparable composes the
+	// ordering with a second filter. permutation must hold one entry per cell.
+	///////////////////////////////////////////////////////////////////////////////
+	bool OrderByComposition(const double* in, double* out, int sizeX, int sizeY, int patchSizeX, int patchSizeY,
+		const double* xKernel, int kSizeX, const double* yKernel, int kSizeY, int* permutation, bool decreasing = false);
+
+private:
+	bool fixedPoint_;
 };
 #endif
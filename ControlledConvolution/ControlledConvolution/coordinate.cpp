@@ -1,12 +1,50 @@
 #include "stdafx.h"
 #include "coordinate.h"
+#include <stdexcept>
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define COORDINATE_SSE2 1
+#endif
 
-
-Coordinate::Coordinate(): x_0_(0), x_1_(0), y_0_(0), y_1_(0), width_(0), height_(0)
+std::vector<Coordinate> Coordinate::Grid(const int width, const int height, const int patchWidth, const int patchHeight)
 {
-}
+	if (patchWidth <= 0 || patchHeight <= 0)
+	{
+		throw std::invalid_argument("Patch size must be greater than zero");
+	}
 
+	const auto columns = (width + patchWidth - 1) / patchWidth;
+	const auto rows = (height + patchHeight - 1) / patchHeight;
+	if (columns * patchWidth > MAX_EXTENT || rows * patchHeight > MAX_EXTENT)
+	{
+		throw std::out_of_range("Proposal grid exceeds the int16 coordinate range");
+	}
 
-Coordinate::~Coordinate()
-{
+	std::vector<Coordinate> grid(static_cast<size_t>(columns) * rows);
+	auto out = grid.data();
+
+	for (auto x = 0; x < columns * patchWidth; x += patchWidth)
+	{
+		auto y = 0;
+		auto remaining = rows;
+#ifdef COORDINATE_SSE2
+		//lanes: {x, y, x + w, y + h} of the coordinate at y and of the one below it
+		auto pair = _mm_setr_epi16(static_cast<short>(x), 0, static_cast<short>(x + patchWidth), static_cast<short>(patchHeight),
+			static_cast<short>(x), static_cast<short>(patchHeight), static_cast<short>(x + patchWidth), static_cast<short>(2 * patchHeight));
+		const auto step = _mm_setr_epi16(0, static_cast<short>(2 * patchHeight), 0, static_cast<short>(2 * patchHeight),
+			0, static_cast<short>(2 * patchHeight), 0, static_cast<short>(2 * patchHeight));
+
+		for (; remaining >= 2; remaining -= 2, y += 2 * patchHeight, out += 2)
+		{
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out), pair);
+			pair = _mm_add_epi16(pair, step);
+		}
+#endif
+		for (; remaining > 0; remaining--, y += patchHeight, out++)
+		{
+			*out = Coordinate(x, y, x + patchWidth, y + patchHeight);
+		}
+	}
+
+	return grid;
 }
@@ -1,61 +1,82 @@
 #pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+ * Corners of a patch, <x0,y0,x1,y1>. x runs over rows and y over columns, as in the rest of the grid code.
+ *
+ * Stored as 4 x int16 (8 bytes): proposal grids are far below 32k pixels on a side.
+ * Accessors return by value and never allocate.
+ */
 class Coordinate
 {
 public:
-	Coordinate();
-	Coordinate(const int& x0, const int& y0, const int& x1, const int& y1): width_(0), height_(0)
+	struct Point
 	{
-		x_0_ = x0;
-		y_0_ = y0;
-		x_1_ = x1;
-		y_1_ = y1;
-	}
+		int x;
+		int y;
 
-	~Coordinate();
+		// Start()[0] / Start()[1], as the array accessors were used
+		constexpr int operator[](const int i) const { return i == 0 ? x : y; }
+	};
 
-	void SetStart(const int x0, const int y0)
+	struct Rect
 	{
-		x_0_ = x0;
-		y_0_ = y0;
-	}
+		Point start;
+		Point end;
 
-	void Set(const int x, const int y)
-	{
-		x_0_ = x;
-		y_0_ = y;
-	}
-	int GetWidth()
+		constexpr int Width() const { return end.x - start.x; }
+		constexpr int Height() const { return end.y - start.y; }
+	};
+
+	static const int MAX_EXTENT = INT16_MAX;
+
+	constexpr Coordinate() : x_0_(0), y_0_(0), x_1_(0), y_1_(0)
 	{
-		width_ = x_1_ - x_0_;
-		return width_;
 	}
-	int GetHeight()
+
+	constexpr Coordinate(const int& x0, const int& y0, const int& x1, const int& y1) :
+		x_0_(static_cast<int16_t>(x0)), y_0_(static_cast<int16_t>(y0)), x_1_(static_cast<int16_t>(x1)), y_1_(static_cast<int16_t>(y1))
 	{
-		height_ = y_1_ - y_0_;
-		return height_;
 	}
-	void SetEnd(const int x1, const int y1)
+
+	void SetStart(const int x0, const int y0)
 	{
-		x_1_ = x1;
-		y_1_ = y1;
+		x_0_ = static_cast<int16_t>(x0);
+		y_0_ = static_cast<int16_t>(y0);
 	}
-	int* Start() const
+
+	void Set(const int x, const int y)
 	{
-		return new int [2]{ x_0_, y_0_ };
+		SetStart(x, y);
 	}
-	int* End() const
+
+	void SetEnd(const int x1, const int y1)
 	{
-		return new int[2] {x_1_, y_1_};
+		x_1_ = static_cast<int16_t>(x1);
+		y_1_ = static_cast<int16_t>(y1);
 	}
 
+	constexpr int GetWidth() const { return x_1_ - x_0_; }
+	constexpr int GetHeight() const { return y_1_ - y_0_; }
+	constexpr Point Start() const { return Point{ x_0_, y_0_ }; }
+	constexpr Point End() const { return Point{ x_1_, y_1_ }; }
+	constexpr Rect ToRect() const { return Rect{ Start(), End() }; }
+
 	std::string ToStr() const { return "(" + std::to_string(x_0_) + "," + std::to_string(y_0_) + "," + std::to_string(x_1_) + "," + std::to_string(y_1_) + ")"; }
 
+	/// <summary>
+	/// Proposal grid of patch size (patchWidth, patchHeight) over a width x height input, in the order
+	/// GeneratePatchProposals always used: x outer, y inner. Two coordinates are written per SSE2 store.
+	/// </summary>
+	static std::vector<Coordinate> Grid(int width, int height, int patchWidth, int patchHeight);
+
 private:
-	int x_0_;
-	int x_1_;
-	int y_0_;
-	int y_1_;
-	int width_;
-	int height_;
+	int16_t x_0_;
+	int16_t y_0_;
+	int16_t x_1_;
+	int16_t y_1_;
 };
 
+static_assert(sizeof(Coordinate) == 4 * sizeof(int16_t), "Coordinate must stay packed");
@@ -1,12 +1,116 @@
 #include "stdafx.h"
 #include "feature_map.h"
 
+FeatureMap::FeatureMap() : images_(0), channels_(0), height_(0), width_(0), layout_(FeatureLayout::nchw)
+{
+}
 
-feature_map::feature_map()
+FeatureMap::FeatureMap(const int images, const int channels, const int height, const int width,
+	const FeatureLayout layout) : images_(images), channels_(channels), height_(height), width_(width), layout_(layout)
 {
+	if (images > 0 && channels > 0 && height > 0 && width > 0)
+		data_ = cv::Mat::zeros(1, static_cast<int>(Total()), CV_32F);
+	else
+		images_ = channels_ = height_ = width_ = 0;
 }
 
+FeatureMap FeatureMap::FromMat(const cv::Mat& image, const FeatureLayout layout)
+{
+	return FromMats(vector<cv::Mat>{ image }, layout);
+}
 
-feature_map::~feature_map()
+FeatureMap FeatureMap::FromMats(const vector<cv::Mat>& images, const FeatureLayout layout)
 {
+	if (images.empty() || images.front().empty()) return FeatureMap();
+
+	const auto& first = images.front();
+	for (const auto& image : images)
+	{
+		if (image.size() != first.size() || image.channels() != first.channels()) return FeatureMap();
+	}
+
+	FeatureMap map(static_cast<int>(images.size()), first.channels(), first.rows, first.cols, layout);
+	cv::Mat values;
+	for (auto n = 0; n < map.images_; n++)
+	{
+		images[n].convertTo(values, CV_32F);
+
+		// a Mat is nhwc already, a row is one copy
+		for (auto y = 0; y < map.height_; y++)
+		{
+			const auto row = values.ptr<float>(y);
+			auto dst = map.Data() + map.Offset(n, 0, y, 0);
+
+			if (layout == FeatureLayout::nhwc)
+			{
+				std::copy(row, row + map.width_ * map.channels_, dst);
+				continue;
+			}
+
+			for (auto x = 0; x < map.width_; x++)
+				for (auto c = 0; c < map.channels_; c++)
+					dst[c * map.ChannelStride() + x] = row[x * map.channels_ + c];
+		}
+	}
+
+	return map;
+}
+
+cv::Mat FeatureMap::ToMat(const int n) const
+{
+	if (Empty() || n < 0 || n >= images_) return cv::Mat();
+
+	cv::Mat image(height_, width_, CV_32FC(channels_));
+	for (auto y = 0; y < height_; y++)
+	{
+		auto row = image.ptr<float>(y);
+		for (auto x = 0; x < width_; x++)
+			for (auto c = 0; c < channels_; c++)
+				row[x * channels_ + c] = At(n, c, y, x);
+	}
+
+	return image;
+}
+
+FeatureMap FeatureMap::Converted(const FeatureLayout layout) const
+{
+	if (layout == layout_ || Empty()) return *this;
+
+	FeatureMap map(images_, channels_, height_, width_, layout);
+	for (auto n = 0; n < images_; n++)
+		for (auto c = 0; c < channels_; c++)
+			for (auto y = 0; y < height_; y++)
+				for (auto x = 0; x < width_; x++)
+					map.At(n, c, y, x) = At(n, c, y, x);
+
+	return map;
+}
+
+FeatureMap FeatureMap::Clone() const
+{
+	auto map = *this;
+	map.data_ = data_.clone();
+
+	return map;
+}
+
+cv::Mat FeatureMap::ChannelMeans() const
+{
+	cv::Mat means = cv::Mat::zeros(images_, channels_, CV_64F);
+	if (Empty()) return means;
+
+	for (auto n = 0; n < images_; n++)
+	{
+		auto out = means.ptr<double>(n);
+		for (auto c = 0; c < channels_; c++)
+		{
+			double sum = 0;
+			for (auto y = 0; y < height_; y++)
+				for (auto x = 0; x < width_; x++)
+					sum += At(n, c, y, x);
+			out[c] = sum / (static_cast<double>(height_) * width_);
+		}
+	}
+
+	return means;
 }
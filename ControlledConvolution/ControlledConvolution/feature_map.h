@@ -1,8 +1,87 @@
 #pragma once
-class feature_map
+#ifndef FEATURE_MAP_H
+#define FEATURE_MAP_H
+#include "stdafx.h"
+
+/// <summary>
+/// Memory order of a FeatureMap.
+///nchw - image, channel, row, column: every channel is a contiguous plane
+///nhwc - image, row, column, channel: the channels of a pixel are adjacent (the order of a Mat)
+/// </summary>
+enum class FeatureLayout { nchw, nhwc };
+
+/*
+ * Float feature maps of a batch of images, the input and output of a Filter (convolution
+ * layer).
+ *
+ * Values live in one continuous float buffer of a Mat, aligned as OpenCV aligns Mat data. Like
+ * a Mat, copies share the buffer; Clone copies it. Every value is reached through the strides
+ * of the layout, Offset(n, c, y, x) = n * ImageStride() + c * ChannelStride() + y * RowStride()
+ * + x * ColumnStride(), so code written against the strides serves both layouts.
+ */
+class FeatureMap
 {
 public:
-	feature_map();
-	~feature_map();
-};
+	FeatureMap();
+	FeatureMap(int images, int channels, int height, int width, FeatureLayout layout = FeatureLayout::nchw);
+
+	/// <summary>
+	/// One image map of a Mat of any depth and channel count, values converted to float.
+	/// </summary>
+	static FeatureMap FromMat(const cv::Mat& image, FeatureLayout layout = FeatureLayout::nchw);
+
+	/// <summary>
+	/// Maps of images of one size and channel count (a class of samples, reordered and original).
+	/// </summary>
+	/// <returns>an empty map if images is empty or the images differ.</returns>
+	static FeatureMap FromMats(const vector<cv::Mat>& images, FeatureLayout layout = FeatureLayout::nchw);
+
+	/// <summary>
+	/// Image n as a CV_32FC(channels) Mat.
+	/// </summary>
+	cv::Mat ToMat(int n = 0) const;
 
+	/// <summary>
+	/// Copy of the map in layout, or the map itself if it is in it already.
+	/// </summary>
+	FeatureMap Converted(FeatureLayout layout) const;
+	FeatureMap Clone() const;
+
+	/// <summary>
+	/// Images x channels CV_64F Mat of the mean of every channel (global average pooling), the
+	/// layer response compared between reordered and original samples.
+	/// </summary>
+	cv::Mat ChannelMeans() const;
+
+	bool Empty() const { return data_.empty(); }
+	int Images() const { return images_; }
+	int Channels() const { return channels_; }
+	int Height() const { return height_; }
+	int Width() const { return width_; }
+	FeatureLayout Layout() const { return layout_; }
+	size_t Total() const { return static_cast<size_t>(images_) * ImageStride(); }
+
+	size_t ImageStride() const { return static_cast<size_t>(channels_) * height_ * width_; }
+	size_t ChannelStride() const { return layout_ == FeatureLayout::nchw ? static_cast<size_t>(height_) * width_ : 1; }
+	size_t RowStride() const { return static_cast<size_t>(width_) * (layout_ == FeatureLayout::nchw ? 1 : channels_); }
+	size_t ColumnStride() const { return layout_ == FeatureLayout::nchw ? 1 : channels_; }
+	size_t Offset(const int n, const int c, const int y, const int x) const
+	{
+		return n * ImageStride() + c * ChannelStride() + y * RowStride() + x * ColumnStride();
+	}
+
+	float* Data() { return data_.ptr<float>(); }
+	const float* Data() const { return data_.ptr<float>(); }
+	float& At(const int n, const int c, const int y, const int x) { return Data()[Offset(n, c, y, x)]; }
+	float At(const int n, const int c, const int y, const int x) const { return Data()[Offset(n, c, y, x)]; }
+
+private:
+	int images_;
+	int channels_;
+	int height_;
+	int width_;
+	FeatureLayout layout_;
+	// 1 x Total() CV_32F
+	cv::Mat data_;
+};
+#endif
@@ -1,8 +1,7 @@
 #pragma once
 #include <iostream>
 #include "coordinate.h"
-#include <list>
-#include <map>
+#include "PixelView.h"
 
 /*A Patch is a unique , 4-tuple subsection of the original input <w,h> identified by its start and end cooridinates
  * w = <0,x_end>
@@ -14,6 +13,8 @@
  * 2. No Patch can intersect any other Patch: P1 intersection P2 <= 1
  * 3. A Patch is unique
  *
+ * Patch stays cheap to move: pixels are a view into the sample, the histogram is computed on demand.
+ * Sorting by a per patch scalar goes through PatchTable, which shuffles 16 byte records instead of patches.
  */
 
 class Patch
@@ -42,16 +43,11 @@ public:
 	explicit Patch(const cv::Mat& mat, const Coordinate &c);
 
 	void Release() { patch_mat_.release(); }
-	~Patch()
-	{
-		//delete corrdinates_;
-	}
 
 #pragma region utils
 	void SetName(const std::string &name) { name_ = name; }
 	void WriteToFile(const std::string& file) const;
 	void Save(const std::string& path, const std::string &format) const;
-	void ToPixel();
 	void SetMat(const cv::Mat& mat) { patch_mat_ = mat; }
 #pragma endregion
 
@@ -62,12 +58,12 @@ public:
 #pragma endregion
 
 #pragma region setters
-	std::initializer_list<cv::Mat> Hist() const { return patch_histogram_; };
-	cv::Mat RChannelHist()const { return r_channel_hist_; }
-	cv::Mat GChannelHist() const { return g_channel_hist_; }
-	cv::Mat BChannelHist() const { return b_channel_hist_; }
+	// 3x256 CV_32F, rows B, G, R. Empty until ComputeHisogram
+	cv::Mat Hist() const { return histogram_; }
+	cv::Mat RChannelHist() const { return histogram_.empty() ? histogram_ : histogram_.row(2); }
+	cv::Mat GChannelHist() const { return histogram_.empty() ? histogram_ : histogram_.row(1); }
+	cv::Mat BChannelHist() const { return histogram_.empty() ? histogram_ : histogram_.row(0); }
 	float Entropy() const { return entropy_; }
-	void SetBgrPlanes(std::vector<cv::Mat> &bgr_planes) { patch_bgr_planes_ = bgr_planes; }
 #pragma endregion
 
 #pragma region getters
@@ -78,31 +74,28 @@ public:
 
 	std::string Name() const { return name_; }
 	cv::Mat GetMat() const { return patch_mat_; }
-	std::vector<std::vector<float>> Pixels()const { return patch_pixels_float_; }
-	std::vector<cv::Mat> BgrPlanes() const { return patch_bgr_planes_; }
+	/// <summary>
+	/// Pixels as T in the given layout, materialized only when asked for.
+	///uint8 interleaved is the patch itself, other types and layouts are converted into buffer.
+	/// </summary>
+	template <typename T>
+	PixelView<T> Pixels(const PixelLayout layout, PixelBuffer& buffer) const
+	{
+		return MakePixelView<T>(patch_mat_, layout, buffer);
+	}
 #pragma endregion
 
 private:
-	std::vector<std::vector<float>> ExtractPixels();
 	int start_row_;
 	int end_row_;
 	int start_column_;
 	int end_column_;
-	int corrdinates_[4];
 	int rows_;
 	int columns_;
-	std::string file_;
 	std::string name_;
 	Coordinate coo_;
 	cv::Mat patch_mat_;
-	std::vector<std::vector<float>> patch_pixels_float_;
-	std::vector<uchar> patch_pixels_uchar_;
-	std::vector<cv::Mat> patch_bgr_planes_;
-	std::initializer_list<cv::Mat> patch_histogram_;
-	cv::Mat r_channel_hist_;
-	cv::Mat g_channel_hist_;
-	cv::Mat b_channel_hist_;
+	cv::Mat histogram_;
 	float entropy_;
-	std::map<Patch, float> mutual_information_;
 };
 
@@ -0,0 +1,106 @@
+#include "stdafx.h"
+#include "por.h"
+#include "PatchShuffleLoader.h"
+#include "PermutationFile.h"
+#include "Common.h"
+#include "Arena.h"
+
+namespace por
+{
+	bool OrderSample(Sample& s, const cv::Size& patchSize, const MeasureType measure, const ::Order order,
+		const SemiRandomSortType sortType, Permutation& permutation)
+	{
+		s.DetermineMinimumNumberOfPatchZones(patchSize.height, patchSize.width);
+		s.GeneratePatchProposals(patchSize);
+
+		cv::Mat img;
+		for (const auto& patchCoordinate : s.PatchesCoordinates())
+		{
+			s.ExtractPatch(img, patchCoordinate);
+			Patch p(img, patchCoordinate);
+			p.SetName(Common::GeneratePatchName(patchCoordinate));
+			s.AddPatch(p);
+			img.release();
+		}
+
+		auto patches = s.Patches();
+		s.SetSamplePatches(patches);
+		Reconstructor sampleReconstructor;
+		sampleReconstructor.SetSample(&s);
+
+		if (!sampleReconstructor.SortPatches(patches, measure, order, sortType)) return false;
+
+		permutation = s.ToPermutation(patches);
+		return true;
+	}
+
+	Permutation Order(const cv::Mat& image, const cv::Size& patchSize, const MeasureType measure, const ::Order order,
+		const SemiRandomSortType sortType)
+	{
+		if (patchSize.width != patchSize.height)
+		{
+			throw runtime_error("This version ony supports square size patches");
+		}
+
+		//Patches and measure temporaries live in the thread's arena until the sample is done
+		ArenaScope arena;
+		Sample s;
+		s.FromMat(image, image.size());
+
+		Permutation permutation;
+		if (!OrderSample(s, patchSize, measure, order, sortType, permutation))
+		{
+			throw runtime_error("SortPatches failed");
+		}
+
+		return permutation;
+	}
+
+	std::vector<Permutation> OrderBatch(const cv::Mat* images, const size_t count, const cv::Size& patchSize,
+		const MeasureType measure, const ::Order order, ThreadPool& pool, const SemiRandomSortType sortType)
+	{
+		std::vector<Permutation> permutations(count);
+
+		pool.ParallelFor(0, count, [&](const size_t i)
+		{
+			permutations[i] = Order(images[i], patchSize, measure, order, sortType);
+		});
+
+		return permutations;
+	}
+
+	std::vector<Permutation> OrderBatch(const std::vector<cv::Mat>& images, const cv::Size& patchSize,
+		const MeasureType measure, const ::Order order, ThreadPool& pool, const SemiRandomSortType sortType)
+	{
+		return OrderBatch(images.data(), images.size(), patchSize, measure, order, pool, sortType);
+	}
+
+	int GridCells(const cv::Size& image, const cv::Size& patchSize)
+	{
+		if (patchSize.width <= 0 || patchSize.height <= 0) return 0;
+
+		return ((image.height + patchSize.height - 1) / patchSize.height) *
+			((image.width + patchSize.width - 1) / patchSize.width);
+	}
+
+	cv::Mat Apply(const cv::Mat& image, const cv::Size& patchSize, const Permutation& permutation)
+	{
+		const auto cells = GridCells(image.size(), patchSize);
+		if (cells > PermutationFile::MAX_PATCHES)
+		{
+			throw runtime_error("Too many patches per sample for a uint16 permutation: " + to_string(cells));
+		}
+
+		for (const auto index : permutation)
+		{
+			if (index < 0 || index >= cells) throw runtime_error("Permutation index out of range");
+		}
+
+		const std::vector<uint16_t> indices(permutation.begin(), permutation.end());
+
+		cv::Mat output;
+		PatchShuffleLoader::Shuffle(image, output, patchSize, indices);
+
+		return output;
+	}
+}
@@ -0,0 +1,58 @@
+#pragma once
+#ifndef POR_H
+#define POR_H
+#include "stdafx.h"
+#include "Reconstructor.h"
+#include "ThreadPool.h"
+
+/*
+ * libpor - in-process patch proposal, ordering and reconstruction.
+ *
+ * The functions below run the same pipeline as ccMain (proposal, extraction, SortPatches)
+ * on images that are already in memory and return the resulting ordering, so callers don't
+ * need to spawn the executable or go through the file system.
+ * Images are ordered at their own size; resize them beforehand the way ccMain --resize does.
+ */
+namespace por
+{
+	typedef ::Permutation Permutation;
+
+	/// <summary>
+	/// Orders the patches of one image.
+	/// </summary>
+	/// <param name="image">BGR image.</param>
+	/// <param name="patchSize">patch size, the image is split into a grid of this size.</param>
+	/// <param name="measure">measure used to compare or rank patches.</param>
+	/// <param name="order">increasing or decreasing.</param>
+	/// <param name="sortType">custom sort used with MeasureType::custom.</param>
+	/// <returns>entry i is the grid index of the patch placed at position i.</returns>
+	Permutation Order(const cv::Mat& image, const cv::Size& patchSize, MeasureType measure, ::Order order,
+		SemiRandomSortType sortType = SemiRandomSortType::none);
+
+	/// <summary>
+	/// Orders count images on the pool, result i belongs to images[i].
+	/// </summary>
+	std::vector<Permutation> OrderBatch(const cv::Mat* images, size_t count, const cv::Size& patchSize, MeasureType measure,
+		::Order order, ThreadPool& pool, SemiRandomSortType sortType = SemiRandomSortType::none);
+	std::vector<Permutation> OrderBatch(const std::vector<cv::Mat>& images, const cv::Size& patchSize, MeasureType measure,
+		::Order order, ThreadPool& pool, SemiRandomSortType sortType = SemiRandomSortType::none);
+
+	/// <summary>
+	/// Cells of the patch grid of an image size, partial cells at the right and bottom included
+	///(0 for an empty patch size). Permutations leave the library as uint16 indices, so grids of
+	///more than PermutationFile::MAX_PATCHES cells are rejected before they are ordered.
+	/// </summary>
+	int GridCells(const cv::Size& image, const cv::Size& patchSize);
+
+	/// <summary>
+	/// Builds the reordered image: the patch at position i of the permutation is placed in grid cell i.
+	/// </summary>
+	cv::Mat Apply(const cv::Mat& image, const cv::Size& patchSize, const Permutation& permutation);
+
+	/// <summary>
+	/// Runs proposal, extraction and sorting on a loaded sample and returns its ordering.
+	/// </summary>
+	bool OrderSample(Sample& s, const cv::Size& patchSize, MeasureType measure, ::Order order,
+		SemiRandomSortType sortType, Permutation& permutation);
+}
+#endif
@@ -1,14 +1,17 @@
 #include "stdafx.h"
 #include "Sample.h"
 #include "static_data.h"
+#include "Arena.h"
 #include <opencv2/imgproc.hpp>
 
 string Sample::ExtractPatch(cv::Mat & patch, const Coordinate & c)
 {
-	const auto startRow = c.Start()[0];
-	const auto endRow = c.End()[0];
-	const auto startColumn = c.Start()[1];
-	const auto endColumn = c.End()[1];
+	const auto start = c.Start();
+	const auto end = c.End();
+	const auto startRow = start.x;
+	const auto endRow = end.x;
+	const auto startColumn = start.y;
+	const auto endColumn = end.y;
 
 	if (startRow > endRow || startColumn > endColumn)
 	{
@@ -21,7 +24,7 @@ string Sample::ExtractPatch(cv::Mat & patch, const Coordinate & c)
 	//cout << "Extracting patches ...";
 	//common::show(mat_,"");
 	const int rowBytes = static_cast<int>((endColumn - startColumn) * mat_.channels() * mat_.elemSize1());
-	patch.create(endRow - startRow, endColumn - startColumn, mat_.type());
+	patch = ScratchMat(endRow - startRow, endColumn - startColumn, mat_.type());
 	auto pixelOriginal = static_cast<const uchar*>(mat_.data) + mat_.step[0] * startRow + mat_.step[1] * startColumn;
 	auto pixelPatch = static_cast<uchar*>(patch.data);
 
@@ -36,7 +39,25 @@ string Sample::ExtractPatch(cv::Mat & patch, const Coordinate & c)
 
 void Sample::ToCvMat(const cv::Size& size, bool round_up_to_nearest_power_of_2)
 {
-	mat_ = imread(input_file_);
+	const auto mat = imread(input_file_);
+
+	if (!mat.data)
+	{
+		cout << "Unable to read image from file, file: " << input_file_ << endl;
+		exit(-1);
+	}
+
+	FromMat(mat, size, round_up_to_nearest_power_of_2);
+}
+
+void Sample::FromMat(const cv::Mat& mat, const cv::Size& size, bool round_up_to_nearest_power_of_2)
+{
+	if (!mat.data)
+	{
+		throw runtime_error("Sample has no image data: " + input_file_);
+	}
+
+	mat_ = mat;
 	original_height_ = mat_.size().height;
 	original_width_ = mat_.size().width;
 	//if(!Common::IsSquareImage(mat_))
@@ -47,12 +68,6 @@ void Sample::ToCvMat(const cv::Size& size, bool round_up_to_nearest_power_of_2)
 	mat_ = temp;
 	//}
 
-	if (!mat_.data)
-	{
-		cout << "Unable to read image from file, file: " << input_file_ << endl;
-		exit(-1);
-	}
-
 	auto rows = mat_.rows;
 	auto cols = mat_.cols;
 
@@ -143,19 +158,57 @@ void Sample::GeneratePatchProposals(const cv::Size& size)
 		throw(message);
 	}
 
-	Coordinate c;
+	patch_size_ = size;
+
+	// x over the width (outer), y over the height (inner)
+	const auto grid = Coordinate::Grid(width_, height_, size.width, size.height);
+	patch_proposal_coordinates_.insert(patch_proposal_coordinates_.end(), grid.begin(), grid.end());
+}
 
-	for (auto x = 0; x < width_; x += size.width)
+int Sample::PatchIndex(const Coordinate& c) const
+{
+	// proposals are generated column major, see GeneratePatchProposals
+	const auto patchesPerColumn = (height_ + patch_size_.height - 1) / patch_size_.height;
+	const auto start = c.Start();
+
+	return (start.x / patch_size_.width) * patchesPerColumn + start.y / patch_size_.height;
+}
+
+Permutation Sample::ToPermutation(const vector<Patch>& sorted) const
+{
+	Permutation permutation;
+	permutation.reserve(sorted.size());
+
+	for (const auto& p : sorted)
 	{
-		for (auto y = 0; y < height_; y += size.height)
-		{
-			c.SetStart(x, y);
-			c.SetEnd(x + size.width, y + size.height);
-			patch_proposal_coordinates_.push_back(c);
+		permutation.push_back(PatchIndex(p.GetPatchCoordinates()));
+	}
+
+	return permutation;
+}
 
-			//std::cout << "Successfully added Patch coordinates <" << x << "," << y << "," << x + size.width << "," << y + size.height << ">"<<endl;
+vector<Patch> Sample::Permute(const Permutation& permutation) const
+{
+	if (permutation.size() != sample_patches_original_.size())
+	{
+		throw exception("Permutation doesn't match the number of patches of the sample");
+	}
+
+	vector<Patch> patches;
+	patches.reserve(permutation.size());
+
+	for (size_t i = 0; i < permutation.size(); i++)
+	{
+		if (permutation[i] < 0 || permutation[i] >= static_cast<int>(sample_patches_original_.size()))
+		{
+			throw exception("Permutation index out of range");
 		}
+
+		patches.push_back(sample_patches_original_[permutation[i]]);
+		patches.back().SetName(to_string(i));
 	}
+
+	return patches;
 }
 
 bool Sample::operator<(const cv::Size& size) const
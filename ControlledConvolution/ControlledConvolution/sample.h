@@ -7,6 +7,10 @@
 #include <map>
 
 using namespace std;
+
+// Ordering of a sample: entry i is the index (in proposal order) of the patch placed at position i
+typedef std::vector<int> Permutation;
+
 class Sample
 {
 public: 
@@ -26,8 +30,9 @@ public:
 
 	string ExtractPatch(cv::Mat& patch, const Coordinate &c);
 	string GetInput() const { return input_file_; }
-	vector<Patch> Patches() const { return sample_patches_sorted_; }
+	const vector<Patch>& Patches() const { return sample_patches_sorted_; }
 	void ToCvMat(const cv::Size& size,bool round_up_to_nearest_power_of_2=false);
+	void FromMat(const cv::Mat& mat, const cv::Size& size, bool round_up_to_nearest_power_of_2 = false);
 	bool Load();
 	void DetermineMinimumNumberOfPatchZones(const int& patch_height, const int& patch_width);
 	static void DetermineSampleFittness();
@@ -39,7 +44,10 @@ public:
 		p.Release();
 	}
 	
-	vector<Coordinate> PatchesCoordinates() const { return patch_proposal_coordinates_; }
+	const vector<Coordinate>& PatchesCoordinates() const { return patch_proposal_coordinates_; }
+	int PatchIndex(const Coordinate& c) const;
+	Permutation ToPermutation(const vector<Patch>& sorted) const;
+	vector<Patch> Permute(const Permutation& permutation) const;
 
 	cv::Mat Mat() const
 	{
@@ -83,6 +91,7 @@ private:
 	vector<Patch> sample_patches_original_;
 	cv::Size sample_original_size_;
 	vector<Coordinate> patch_proposal_coordinates_;
+	cv::Size patch_size_;
 	int minimum_number_of_patches_x_;
 	int minimum_number_of_patches_y_;
 	int height_;
@@ -0,0 +1,647 @@
+// ConvolutionBenchmark.cpp : times every Convolution routine over a sweep of image sizes,
+// kernel sizes, pixel types and thread counts, checks that their outputs agree and writes
+// the throughput as CSV or JSON.
+//
+
+#include "stdafx.h"
+#include "convolution.h"
+#include "FftConvolution.h"
+#include "Filter.h"
+#include "ThreadPool.h"
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <type_traits>
+
+namespace
+{
+	typedef std::chrono::steady_clock Clock;
+
+	struct Options
+	{
+		vector<int> sizes;
+		vector<int> kernels;
+		vector<std::string> types;
+		vector<int> threads;
+		int repeat;
+		int patch;
+		int batchPatch;
+		int filterChannels;
+		double slowLimit;
+		unsigned seed;
+	};
+
+	// one timed routine on one configuration
+	struct Result
+	{
+		std::string variant;
+		std::string type;
+		std::string method;
+		int channels;
+		int width;
+		int height;
+		int kernel;
+		int threads;
+		double ms;
+		double megapixelsPerSecond;
+		double maxError;
+		bool exact;
+		bool match;
+	};
+
+	vector<std::string> Split(const std::string& list)
+	{
+		vector<std::string> items;
+		std::stringstream ss(list);
+		std::string item;
+		while (std::getline(ss, item, ','))
+		{
+			if (!item.empty()) items.push_back(item);
+		}
+
+		return items;
+	}
+
+	vector<int> SplitInts(const std::string& list)
+	{
+		vector<int> values;
+		for (const auto& item : Split(list)) values.push_back(std::stoi(item));
+		return values;
+	}
+
+	// median wall time of repeat runs after a warm up run, in ms
+	template <typename F>
+	double Time(const int repeat, const F& run)
+	{
+		run();
+
+		vector<double> ms;
+		for (auto i = 0; i < repeat; i++)
+		{
+			const auto start = Clock::now();
+			run();
+			ms.push_back(std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+		}
+
+		std::nth_element(ms.begin(), ms.begin() + ms.size() / 2, ms.end());
+		return ms[ms.size() / 2];
+	}
+
+	/*
+	 * Name, OpenCV depth (-1 if OpenCV has none), test value range and relative precision
+	 * (0 for integers) of a pixel type.
+	 */
+	template <typename T> struct BenchType;
+	template <> struct BenchType<unsigned char> { static const char* Name() { return "8u"; } static const int DEPTH = CV_8U; static double Max() { return 255; } static double Epsilon() { return 0; } };
+	template <> struct BenchType<unsigned short> { static const char* Name() { return "16u"; } static const int DEPTH = CV_16U; static double Max() { return 65535; } static double Epsilon() { return 0; } };
+	template <> struct BenchType<int16_t> { static const char* Name() { return "16s"; } static const int DEPTH = CV_16S; static double Max() { return 32767; } static double Epsilon() { return 0; } };
+	template <> struct BenchType<int> { static const char* Name() { return "32s"; } static const int DEPTH = CV_32S; static double Max() { return 1 << 20; } static double Epsilon() { return 0; } };
+	template <> struct BenchType<float> { static const char* Name() { return "32f"; } static const int DEPTH = CV_32F; static double Max() { return 1; } static double Epsilon() { return std::numeric_limits<float>::epsilon(); } };
+	template <> struct BenchType<double> { static const char* Name() { return "64f"; } static const int DEPTH = CV_64F; static double Max() { return 1; } static double Epsilon() { return std::numeric_limits<double>::epsilon(); } };
+	template <> struct BenchType<Float16> { static const char* Name() { return "16f"; } static const int DEPTH = -1; static double Max() { return 1; } static double Epsilon() { return 1.0 / 1024; } };
+
+	const char* MethodName(const ConvolutionMethod method)
+	{
+		switch (method)
+		{
+		case ConvolutionMethod::direct: return "direct";
+		case ConvolutionMethod::separable: return "separable";
+		case ConvolutionMethod::fft: return "fft";
+		default: return "automatic";
+		}
+	}
+
+	// normalized binomial kernel, a Gaussian approximation whose integer version is exact
+	vector<double> Binomial(const int size)
+	{
+		vector<double> b(size, 1.0);
+		for (auto i = 1; i < size; i++)
+			for (auto j = i - 1; j > 0; j--) b[j] += b[j - 1];
+
+		return b;
+	}
+
+	class Benchmark
+	{
+	public:
+		explicit Benchmark(const Options& options) : options_(options)
+		{
+			for (auto t : options_.threads)
+			{
+				if (t <= 0) t = static_cast<int>((std::max)(1u, std::thread::hardware_concurrency()));
+				pools_.emplace_back(t > 1 ? new ThreadPool(t) : nullptr);
+			}
+		}
+
+		bool Run()
+		{
+			for (const auto size : options_.sizes)
+			{
+				if (options_.filterChannels > 0) RunFilter(size);
+
+				for (const auto k : options_.kernels)
+				{
+					for (const auto& type : options_.types)
+					{
+						if (type == "8u") RunType<unsigned char>(size, k);
+						else if (type == "16u") RunType<unsigned short>(size, k);
+						else if (type == "16s") RunType<int16_t>(size, k);
+						else if (type == "32s") RunType<int>(size, k);
+						else if (type == "32f") RunType<float>(size, k);
+						else if (type == "64f") RunType<double>(size, k);
+						else if (type == "16f") RunType<Float16>(size, k);
+						else
+						{
+							cerr << "Unknown type " << type << ", skipped\n";
+							continue;
+						}
+
+						clog << "size " << size << ", kernel " << k << ", " << type << " done\n";
+					}
+				}
+			}
+
+			auto ok = true;
+			for (const auto& r : results_)
+			{
+				if (r.match) continue;
+
+				ok = false;
+				cerr << "MISMATCH " << r.variant << " " << r.type << " " << r.width << "x" << r.height << " kernel " << r.kernel
+					<< " threads " << r.threads << ": max error " << r.maxError << "\n";
+			}
+
+			return ok;
+		}
+
+		void WriteCsv(ostream& out) const
+		{
+			out << "variant,type,channels,width,height,kernel,threads,method,ms,mpix_per_s,max_error,exact,match\n";
+			for (const auto& r : results_)
+			{
+				out << r.variant << "," << r.type << "," << r.channels << "," << r.width << "," << r.height << "," << r.kernel << ","
+					<< r.threads << "," << r.method << "," << r.ms << "," << r.megapixelsPerSecond << "," << r.maxError << ","
+					<< (r.exact ? "true" : "false") << "," << (r.match ? "true" : "false") << "\n";
+			}
+		}
+
+		void WriteJson(ostream& out) const
+		{
+			out << "[\n";
+			for (size_t i = 0; i < results_.size(); i++)
+			{
+				const auto& r = results_[i];
+				out << "  {\"variant\": \"" << r.variant << "\", \"type\": \"" << r.type << "\", \"channels\": " << r.channels
+					<< ", \"width\": " << r.width << ", \"height\": " << r.height << ", \"kernel\": " << r.kernel
+					<< ", \"threads\": " << r.threads << ", \"method\": \"" << r.method << "\", \"ms\": " << r.ms
+					<< ", \"mpix_per_s\": " << r.megapixelsPerSecond << ", \"max_error\": " << r.maxError
+					<< ", \"exact\": " << (r.exact ? "true" : "false") << ", \"match\": " << (r.match ? "true" : "false") << "}"
+					<< (i + 1 < results_.size() ? ",\n" : "\n");
+			}
+			out << "]\n";
+		}
+
+	private:
+		template <typename T>
+		void RunType(int size, int k);
+
+		// a Filter layer on a three channel image: winograd against im2col, nhwc against nchw
+		void RunFilter(int size);
+
+		// the fixed point mode of the 8 and 16 bit types
+		template <typename T, typename Acc>
+		void RunFixed(int size, int k, ThreadPool* pool, const vector<T>& in, const vector<Acc>& kernel, const vector<Acc>& x,
+			const vector<T>& reference, const vector<T>& separable, std::true_type);
+
+		template <typename T, typename Acc>
+		void RunFixed(int, int, ThreadPool*, const vector<T>&, const vector<Acc>&, const vector<Acc>&, const vector<T>&,
+			const vector<T>&, std::false_type)
+		{
+		}
+
+		// the AbsRound types through the engine's Round instantiation, a Policy other than the default
+		template <typename T, typename Acc>
+		void RunRound(int size, int k, const ConvolutionEngine& engine, int threads, const vector<T>& in,
+			const vector<Acc>& kernel, const vector<T>& reference, std::true_type);
+
+		template <typename T, typename Acc>
+		void RunRound(int, int, const ConvolutionEngine&, int, const vector<T>&, const vector<Acc>&, const vector<T>&,
+			std::false_type)
+		{
+		}
+
+		// compares out to the reference and records the timing; exact routines have to match
+		// bit for bit, the others within the rounding of the accumulator type, plus bound if given
+		template <typename T>
+		void Record(const std::string& variant, const std::string& method, int channels, int size, int k, int threads,
+			double ms, const vector<T>& out, const vector<T>& reference, bool exact, double bound = 0);
+
+		Options options_;
+		vector<std::unique_ptr<ThreadPool>> pools_;
+		vector<Result> results_;
+	};
+
+	template <typename T>
+	void Benchmark::Record(const std::string& variant, const std::string& method, const int channels, const int size,
+		const int k, const int threads, const double ms, const vector<T>& out, const vector<T>& reference, const bool exact,
+		const double bound)
+	{
+		typedef typename ConvolutionTraits<T>::Accumulator Acc;
+
+		double maxError = 0, maxValue = 0;
+		for (size_t i = 0; i < out.size(); i++)
+		{
+			maxError = (std::max)(maxError, std::fabs(static_cast<double>(out[i]) - static_cast<double>(reference[i])));
+			maxValue = (std::max)(maxValue, std::fabs(static_cast<double>(reference[i])));
+		}
+
+		// an output may round the other way, and the sum carries the accumulator's error
+		const auto integer = std::numeric_limits<T>::is_integer ? 1.0 : 0.0;
+		const auto tolerance = bound + integer + (BenchType<T>::Epsilon() + 256 * std::numeric_limits<Acc>::epsilon()) * maxValue;
+
+		Result r;
+		r.variant = variant;
+		r.type = BenchType<T>::Name();
+		r.method = method;
+		r.channels = channels;
+		r.width = size;
+		r.height = size;
+		r.kernel = k;
+		r.threads = threads;
+		r.ms = ms;
+		r.megapixelsPerSecond = ms > 0 ? static_cast<double>(size) * size / (ms * 1000.0) : 0;
+		r.maxError = maxError;
+		r.exact = exact;
+		r.match = exact ? maxError == 0 : maxError <= tolerance;
+		results_.push_back(r);
+	}
+
+	template <typename T>
+	void Benchmark::RunType(const int size, const int k)
+	{
+		typedef typename ConvolutionTraits<T>::Accumulator Acc;
+		const auto pixels = static_cast<size_t>(size) * size;
+		const auto depth = BenchType<T>::DEPTH;
+		const auto repeat = options_.repeat;
+		Convolution convolution;
+
+		std::mt19937 rng(options_.seed);
+		std::uniform_real_distribution<double> value(0, BenchType<T>::Max());
+		vector<T> in(pixels), in3(pixels * 3);
+		for (auto& v : in) v = static_cast<T>(value(rng));
+		for (auto& v : in3) v = static_cast<T>(value(rng));
+
+		// the binomial kernel, its separable factors and a kernel Mat for the Mat routines
+		const auto b = Binomial(k);
+		double sum = 0;
+		for (const auto v : b) sum += v;
+
+		vector<Acc> x(k), kernel(static_cast<size_t>(k) * k);
+		vector<double> kernelD(kernel.size());
+		for (auto i = 0; i < k; i++) x[i] = static_cast<Acc>(b[i] / sum);
+		for (auto m = 0; m < k; m++)
+		{
+			for (auto n = 0; n < k; n++)
+			{
+				kernelD[m * k + n] = b[m] / sum * (b[n] / sum);
+				kernel[m * k + n] = static_cast<Acc>(kernelD[m * k + n]);
+			}
+		}
+		const cv::Mat kernelMat(k, k, CV_64F, kernelD.data());
+
+		// single channel reference: the engine's exact 2D loops
+		vector<T> reference(pixels), separable(pixels), out(pixels);
+		const auto ms = Time(repeat, [&] { convolution.Convolve2D(in.data(), reference.data(), size, size, kernel.data(), k, k); });
+		Record("convolve2d", "direct", 1, size, k, 1, ms, reference, reference, true);
+
+		const auto separableMs = Time(repeat, [&]
+		{
+			convolution.Convolve2DSeparable(in.data(), separable.data(), size, size, x.data(), k, x.data(), k);
+		});
+		Record("separable", "separable", 1, size, k, 1, separableMs, separable, reference, false);
+
+		// controlled convolution against the separable convolution of the reordered image
+		const auto patch = options_.patch;
+		const auto controlled = patch > 0 && size % patch == 0;
+		vector<int> permutation;
+		vector<T> moved, reordered;
+
+		// the patches copied into their new places, what the controlled convolution saves
+		const auto reorder = [&]
+		{
+			const auto cellsX = size / patch;
+			for (auto cell = 0; cell < static_cast<int>(permutation.size()); cell++)
+			{
+				const auto source = permutation[cell];
+				for (auto r = 0; r < patch; r++)
+				{
+					const auto src = &in[static_cast<size_t>((source / cellsX) * patch + r) * size + (source % cellsX) * patch];
+					std::copy(src, src + patch, &moved[static_cast<size_t>((cell / cellsX) * patch + r) * size + (cell % cellsX) * patch]);
+				}
+			}
+		};
+
+		if (controlled)
+		{
+			const auto cellsX = size / patch;
+			permutation.resize(static_cast<size_t>(cellsX) * cellsX);
+			std::iota(permutation.begin(), permutation.end(), 0);
+			std::shuffle(permutation.begin(), permutation.end(), rng);
+
+			moved.resize(pixels);
+			reorder();
+
+			reordered.resize(pixels);
+			convolution.Convolve2DSeparable(moved.data(), reordered.data(), size, size, x.data(), k, x.data(), k);
+		}
+
+		// the historical unsigned char routines have no pool, they run once single threaded
+		if (std::is_same<T, unsigned char>::value)
+		{
+			const auto in8 = reinterpret_cast<unsigned char*>(in.data());
+			const auto out8 = reinterpret_cast<unsigned char*>(out.data());
+			auto kernelF = vector<float>(kernel.begin(), kernel.end());
+
+			if (static_cast<double>(pixels) * k * k <= options_.slowLimit)
+			{
+				const auto slowMs = Time(1, [&] { convolution.Convolve2DSlow(in8, out8, size, size, kernelF.data(), k, k); });
+				Record("slow", "direct", 1, size, k, 1, slowMs, out, reference, true);
+			}
+
+			const auto fastMs = Time(repeat, [&] { convolution.Convolve2DFast(in8, out8, size, size, kernelF.data(), k, k); });
+			Record("fast", "direct", 1, size, k, 1, fastMs, out, reference, true);
+
+			// integer kernel. Fast2 runs it on the fixed point loops when it fits their int16 taps,
+			// otherwise on the historical loops, whose int sum has to hold 255 * the kernel sum and
+			// whose border handling is off for even kernels
+			vector<int> kernelI(kernel.size());
+			for (auto m = 0; m < k; m++)
+				for (auto n = 0; n < k; n++) kernelI[m * k + n] = static_cast<int>(b[m] * b[n]);
+
+			const auto factor = static_cast<float>(1.0 / (sum * sum));
+			FixedPointKernel fixed;
+			if (FixedPointKernel::FromIntegers(kernelI.data(), k, k, factor, 255, fixed)
+				|| (k % 2 == 1 && 255.0 * sum * sum <= INT_MAX))
+			{
+				const auto fast2Ms = Time(repeat, [&]
+				{
+					convolution.Convolve2DFast2(in8, out8, size, size, kernelI.data(), factor, k, k);
+				});
+				Record("fast2", "direct", 1, size, k, 1, fast2Ms, out, reference, false);
+			}
+		}
+
+		// three channel reference for the Mat routines
+		vector<T> reference3(pixels * 3), out3(pixels * 3);
+		ConvolutionEngine().Convolve2D(in3.data(), reference3.data(), size, size, kernel.data(), k, k, 3);
+
+		for (size_t t = 0; t < pools_.size(); t++)
+		{
+			const auto pool = pools_[t].get();
+			const auto threads = pool ? static_cast<int>(pool->Size()) : 1;
+			const ConvolutionEngine engine(pool);
+
+			const auto engineMs = Time(repeat, [&] { engine.Convolve2D(in.data(), out.data(), size, size, kernel.data(), k, k); });
+			Record("engine_2d", "direct", 1, size, k, threads, engineMs, out, reference, true);
+
+			RunRound(size, k, engine, threads, in, kernel, reference,
+				std::integral_constant<bool, std::is_same<typename ConvolutionTraits<T>::Policy, AbsRound>::value>());
+
+			const auto engineSeparableMs = Time(repeat, [&]
+			{
+				engine.Convolve2DSeparable(in.data(), out.data(), size, size, x.data(), k, x.data(), k);
+			});
+			Record("engine_separable", "separable", 1, size, k, threads, engineSeparableMs, out, separable, true);
+
+			if (controlled)
+			{
+				const auto controlledMs = Time(repeat, [&]
+				{
+					engine.ControlledConvolve2DSeparable(in.data(), out.data(), size, size, patch, patch, permutation.data(),
+						x.data(), k, x.data(), k);
+				});
+				Record("controlled", "separable", 1, size, k, threads, controlledMs, out, reordered, true);
+
+				// the baseline it replaces: reorder the image, then convolve the copy
+				const auto reorderMs = Time(repeat, [&]
+				{
+					reorder();
+					engine.Convolve2DSeparable(moved.data(), out.data(), size, size, x.data(), k, x.data(), k);
+				});
+				Record("reorder_separable", "separable", 1, size, k, threads, reorderMs, out, reordered, true);
+			}
+
+			const auto interleavedMs = Time(repeat, [&]
+			{
+				engine.Convolve2D(in3.data(), out3.data(), size, size, kernel.data(), k, k, 3);
+			});
+			Record("engine_2d_c3", "direct", 3, size, k, threads, interleavedMs, out3, reference3, true);
+
+			RunFixed(size, k, pool, in, kernel, x, reference, separable,
+				std::integral_constant<bool, FixedPointTraits<T>::SUPPORTED>());
+
+			if (depth < 0) continue;
+
+			// Mat routines on an interleaved three channel image
+			const cv::Mat image(size, size, CV_MAKETYPE(depth, 3), in3.data());
+			cv::Mat result(size, size, CV_MAKETYPE(depth, 3), out3.data());
+
+			const ConvolutionMethod methods[] = { ConvolutionMethod::direct, ConvolutionMethod::separable,
+				ConvolutionMethod::fft, ConvolutionMethod::automatic };
+			for (const auto method : methods)
+			{
+				const auto selected = method == ConvolutionMethod::automatic
+					? Convolution::Select(image.size(), kernelMat.size(), true) : method;
+				const auto matMs = Time(repeat, [&] { convolution.Convolve2D(image, result, kernelMat, pool, method); });
+				Record(std::string("mat_") + MethodName(method), MethodName(selected), 3, size, k, threads, matMs, out3,
+					reference3, selected == ConvolutionMethod::direct);
+			}
+
+			// batch of patch views against convolving every patch on its own
+			const auto batchPatch = options_.batchPatch;
+			if (batchPatch <= 0 || size % batchPatch != 0) continue;
+
+			vector<cv::Mat> patches, convolved;
+			for (auto r = 0; r < size; r += batchPatch)
+				for (auto c = 0; c < size; c += batchPatch) patches.push_back(image(cv::Rect(c, r, batchPatch, batchPatch)));
+
+			ThreadPool single(1);
+			const auto batchMs = Time(repeat, [&]
+			{
+				convolution.Convolve2DBatch(patches, convolved, kernelMat, pool ? *pool : single, ConvolutionMethod::direct);
+			});
+
+			vector<T> batched(pixels * 3), expected(pixels * 3);
+			const auto patchValues = static_cast<size_t>(batchPatch) * batchPatch * 3;
+			for (size_t p = 0; p < patches.size(); p++)
+			{
+				const cv::Mat view = patches[p].clone();
+				ConvolutionEngine().Convolve2D(view.ptr<T>(), &expected[p * patchValues], batchPatch, batchPatch, kernel.data(),
+					k, k, 3);
+				std::copy(convolved[p].ptr<T>(), convolved[p].ptr<T>() + patchValues, &batched[p * patchValues]);
+			}
+			Record("batch", "direct", 3, size, k, threads, batchMs, batched, expected, true);
+		}
+	}
+
+	void Benchmark::RunFilter(const int size)
+	{
+		const auto channels = options_.filterChannels;
+		const auto filter = Filter::Random(channels, 3, 3, options_.seed);
+
+		std::mt19937 rng(options_.seed);
+		std::uniform_real_distribution<float> value(0, 1);
+		cv::Mat image(size, size, CV_32FC3);
+		for (auto y = 0; y < size; y++)
+			for (auto x = 0; x < size * 3; x++) image.ptr<float>(y)[x] = value(rng);
+
+		const FeatureLayout layouts[] = { FeatureLayout::nchw, FeatureLayout::nhwc };
+		const FilterAlgorithm algorithms[] = { FilterAlgorithm::im2col, FilterAlgorithm::winograd };
+
+		// every output compared in nchw order to im2col on nchw, the layer as frameworks compute it.
+		// The others sum in another order: winograd's transforms grow the terms (up to 8x for
+		// F(2x2, 3x3)) and nhwc runs the transposed gemm, so they get a bound per tap of fan in
+		vector<float> reference;
+		double bound = 0;
+		for (const auto layout : layouts)
+		{
+			const auto in = FeatureMap::FromMat(image, layout);
+			for (const auto algorithm : algorithms)
+			{
+				FeatureMap out;
+				const auto ms = Time(options_.repeat, [&] { filter.Forward(in, out, false, algorithm); });
+
+				const auto nchw = out.Converted(FeatureLayout::nchw);
+				const vector<float> values(nchw.Data(), nchw.Data() + nchw.Total());
+				if (reference.empty())
+				{
+					reference = values;
+					double maxValue = 0;
+					for (const auto v : reference) maxValue = (std::max)(maxValue, std::fabs(static_cast<double>(v)));
+					bound = 8.0 * filter.InChannels() * 9 * std::numeric_limits<float>::epsilon() * maxValue;
+				}
+
+				const auto winograd = algorithm == FilterAlgorithm::winograd;
+				const auto nhwc = layout == FeatureLayout::nhwc;
+				const auto exact = !winograd && !nhwc;
+				Record(std::string("filter_") + (winograd ? "winograd" : "im2col") + (nhwc ? "_nhwc" : "_nchw"),
+					winograd ? "winograd" : "im2col", 3, size, 3, 1, ms, values, reference, exact, exact ? 0 : bound);
+			}
+		}
+	}
+
+	template <typename T, typename Acc>
+	void Benchmark::RunRound(const int size, const int k, const ConvolutionEngine& engine, const int threads,
+		const vector<T>& in, const vector<Acc>& kernel, const vector<T>& reference, std::true_type)
+	{
+		// the binomial kernel and the pixels are non-negative, so rounding the sum or its magnitude agree
+		vector<T> out(in.size());
+		const auto ms = Time(options_.repeat, [&]
+		{
+			engine.Convolve2D<T, Acc, Round>(in.data(), out.data(), size, size, kernel.data(), k, k);
+		});
+		Record("engine_2d_round", "direct", 1, size, k, threads, ms, out, reference, true);
+	}
+
+	template <typename T, typename Acc>
+	void Benchmark::RunFixed(const int size, const int k, ThreadPool* pool, const vector<T>& in, const vector<Acc>& kernel,
+		const vector<Acc>& x, const vector<T>& reference, const vector<T>& separable, std::true_type)
+	{
+		const auto range = static_cast<double>(FixedPointTraits<T>::MAX_ABS);
+		const auto threads = pool ? static_cast<int>(pool->Size()) : 1;
+		const ConvolutionEngine engine(pool, 0, true);
+		vector<T> out(in.size());
+
+		// the kernels as the fixed point mode quantizes them, for the error bounds
+		const auto fixed = FixedPointKernel::Quantize(kernel.data(), k, k, range);
+		const auto xFixed = FixedPointKernel::Quantize(x.data(), k, 1, range);
+		const auto yFixed = FixedPointKernel::Quantize(x.data(), 1, k, ConvolutionEngine::INTERMEDIATE_MAX_ABS);
+
+		const auto fixedMs = Time(options_.repeat, [&] { engine.Convolve2D(in.data(), out.data(), size, size, kernel.data(), k, k); });
+		Record("fixed_2d", "direct", 1, size, k, threads, fixedMs, out, reference, false,
+			ConvolutionEngine::FixedPointErrorBound(fixed, range));
+
+		const auto fixedSeparableMs = Time(options_.repeat, [&]
+		{
+			engine.Convolve2DSeparable(in.data(), out.data(), size, size, x.data(), k, x.data(), k);
+		});
+		Record("fixed_separable", "separable", 1, size, k, threads, fixedSeparableMs, out, separable, false,
+			ConvolutionEngine::FixedPointErrorBound(xFixed, yFixed, range));
+	}
+}
+
+int main(const int argc, char** argv)
+{
+	const String keys =
+		"{help h usage ?   |      | print this message}"
+		"{sizes            |64,224,1024| square image sizes}"
+		"{kernels          |3,5,7,15,31| square kernel sizes}"
+		"{types            |8u,16u,16s,32s,32f,64f,16f| pixel types}"
+		"{threads          |1,0| thread counts of the pooled routines (0 = one per core)}"
+		"{repeat           |5| timed runs per routine, the median is reported}"
+		"{patch            |8| patch size of the controlled convolution}"
+		"{batch_patch      |32| patch size of the batch routine}"
+		"{filter_channels  |16| output channels of the Filter layer rows (0 = none)}"
+		"{slow_limit       |100000000| skip Convolve2DSlow above this many pixel * kernel taps}"
+		"{seed             |1| seed of the random images}"
+		"{format f         |csv| csv or json}"
+		"{output o         || output file (standard output if not given)}";
+
+	CommandLineParser parser(argc, argv, keys);
+	parser.about("\nConvolution benchmark v1.0.0");
+
+	if (parser.has("help"))
+	{
+		parser.printMessage();
+		return 0;
+	}
+
+	Options options;
+	options.sizes = SplitInts(parser.get<string>("sizes"));
+	options.kernels = SplitInts(parser.get<string>("kernels"));
+	options.types = Split(parser.get<string>("types"));
+	options.threads = SplitInts(parser.get<string>("threads"));
+	options.repeat = (std::max)(1, parser.get<int>("repeat"));
+	options.patch = parser.get<int>("patch");
+	options.batchPatch = parser.get<int>("batch_patch");
+	options.filterChannels = parser.get<int>("filter_channels");
+	options.slowLimit = parser.get<double>("slow_limit");
+	options.seed = parser.get<unsigned>("seed");
+	const auto format = parser.get<string>("format");
+	const auto output = parser.get<string>("output");
+
+	if (!parser.check() || options.threads.empty() || (format != "csv" && format != "json"))
+	{
+		parser.printMessage();
+		return -1;
+	}
+
+	Benchmark benchmark(options);
+	const auto ok = benchmark.Run();
+
+	ofstream file;
+	if (!output.empty())
+	{
+		file.open(output);
+		if (!file.is_open())
+		{
+			cerr << "Unable to write " << output << endl;
+			return -1;
+		}
+	}
+
+	auto& out = output.empty() ? cout : file;
+	if (format == "json") benchmark.WriteJson(out);
+	else benchmark.WriteCsv(out);
+
+	clog << "FFT kernel spectra: " << FftConvolution::Shared().Hits() << " cached, " << FftConvolution::Shared().Misses()
+		<< " computed\n";
+
+	return ok ? 0 : 1;
+}
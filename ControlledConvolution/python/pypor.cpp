@@ -0,0 +1,198 @@
+// pypor.cpp : Python bindings of libpor.
+//
+// NumPy arrays are wrapped as cv::Mat headers without copying (uint8, HxWx3 BGR, C contiguous)
+// and results are handed back as arrays that own the underlying cv::Mat / vector.
+// Batch calls release the GIL while libpor runs on its thread pool.
+
+#include <pybind11/pybind11.h>
+#include <pybind11/numpy.h>
+#include <pybind11/stl.h>
+#include <memory>
+#include <mutex>
+#include "stdafx.h"
+#include "por.h"
+#include "Common.h"
+#include "PermutationFile.h"
+#include "PixelSort.h"
+
+namespace py = pybind11;
+
+typedef py::array_t<uint8_t, py::array::c_style> ImageArray;
+
+static ::Order ToOrder(const std::string& order)
+{
+	if (order == "increasing" || order == "0") return ::Order::increasing;
+	if (order == "decreasing" || order == "1") return ::Order::decreasing;
+
+	throw py::value_error("Unknown order '" + order + "', expected increasing or decreasing");
+}
+
+static MeasureType ToMeasure(const std::string& measure)
+{
+	MeasureType mt = {};
+	if (!Common::ToMeasureType(measure, mt)) throw py::value_error("Unknown measure type '" + measure + "'");
+
+	return mt;
+}
+
+// permutations are returned as uint16 arrays, larger grids would wrap their indices
+static void CheckGrid(const cv::Size& image, const int patchSize)
+{
+	const auto cells = por::GridCells(image, cv::Size(patchSize, patchSize));
+	if (cells > PermutationFile::MAX_PATCHES)
+	{
+		throw py::value_error("Too many patches per image for a uint16 permutation: " + std::to_string(cells));
+	}
+}
+
+// view of a HxWx3 (or HxW) array, no copy
+static cv::Mat AsMat(const ImageArray& image)
+{
+	const auto info = image.request();
+
+	if (info.ndim == 3 && info.shape[2] == 3)
+		return cv::Mat(static_cast<int>(info.shape[0]), static_cast<int>(info.shape[1]), CV_8UC3, info.ptr);
+	if (info.ndim == 2)
+	{
+		const cv::Mat gray(static_cast<int>(info.shape[0]), static_cast<int>(info.shape[1]), CV_8UC1, info.ptr);
+		cv::Mat bgr;
+		cvtColor(gray, bgr, COLOR_GRAY2BGR);
+		return bgr;
+	}
+
+	throw py::value_error("Expected a HxWx3 (BGR) or HxW uint8 array");
+}
+
+// hands the Mat over to NumPy, the array keeps it alive
+static py::array ToArray(const cv::Mat& mat)
+{
+	auto owner = new cv::Mat(mat.isContinuous() ? mat : mat.clone());
+	const py::capsule release(owner, [](void* p) { delete static_cast<cv::Mat*>(p); });
+
+	const auto channels = static_cast<py::ssize_t>(owner->channels());
+	return py::array_t<uint8_t>(
+		{ static_cast<py::ssize_t>(owner->rows), static_cast<py::ssize_t>(owner->cols), channels },
+		{ static_cast<py::ssize_t>(owner->step[0]), channels, static_cast<py::ssize_t>(1) },
+		owner->data, release);
+}
+
+static py::array ToArray(std::vector<uint16_t>* permutation)
+{
+	const py::capsule release(permutation, [](void* p) { delete static_cast<std::vector<uint16_t>*>(p); });
+
+	return py::array_t<uint16_t>({ static_cast<py::ssize_t>(permutation->size()) }, { sizeof(uint16_t) },
+		permutation->data(), release);
+}
+
+// shared by the batch calls; a call holds its pool until it returns, so a call asking for another
+// size replaces the pool for later calls without destroying it under a running one
+static std::shared_ptr<ThreadPool> Pool(const size_t threads)
+{
+	static std::mutex mutex;
+	static std::shared_ptr<ThreadPool> pool;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	if (!pool || (threads != 0 && pool->Size() != threads)) pool = std::make_shared<ThreadPool>(threads);
+
+	return pool;
+}
+
+PYBIND11_MODULE(pypor, m)
+{
+	m.doc() = "Patch proposal, ordering and reconstruction (libpor)";
+
+	m.def("order", [](const ImageArray& image, const int patchSize, const std::string& measure, const std::string& order)
+	{
+		const auto mat = AsMat(image);
+		const auto mt = ToMeasure(measure);
+		const auto o = ToOrder(order);
+		CheckGrid(mat.size(), patchSize);
+
+		std::unique_ptr<std::vector<uint16_t>> permutation;
+		{
+			py::gil_scoped_release release;
+			const auto p = por::Order(mat, cv::Size(patchSize, patchSize), mt, o);
+			permutation.reset(new std::vector<uint16_t>(p.begin(), p.end()));
+		}
+
+		return ToArray(permutation.release());
+	}, py::arg("image"), py::arg("patch_size"), py::arg("measure") = "ae", py::arg("order") = "increasing",
+		"Orders the patches of a HxWx3 uint8 BGR image, returns the uint16 permutation of the patch grid.");
+
+	m.def("order_batch", [](const ImageArray& images, const int patchSize, const std::string& measure,
+		const std::string& order, const size_t threads)
+	{
+		const auto info = images.request();
+		if (info.ndim != 4 || info.shape[3] != 3) throw py::value_error("Expected a NxHxWx3 uint8 array");
+
+		const auto count = static_cast<size_t>(info.shape[0]);
+		const auto rows = static_cast<int>(info.shape[1]);
+		const auto cols = static_cast<int>(info.shape[2]);
+		const auto mt = ToMeasure(measure);
+		const auto o = ToOrder(order);
+		CheckGrid(cv::Size(cols, rows), patchSize);
+
+		std::vector<cv::Mat> mats;
+		mats.reserve(count);
+		for (size_t i = 0; i < count; i++)
+		{
+			mats.emplace_back(rows, cols, CV_8UC3, static_cast<uint8_t*>(info.ptr) + i * info.strides[0]);
+		}
+
+		std::vector<por::Permutation> permutations;
+		{
+			py::gil_scoped_release release;
+			const auto pool = Pool(threads);
+			permutations = por::OrderBatch(mats, cv::Size(patchSize, patchSize), mt, o, *pool);
+		}
+
+		const auto patches = permutations.empty() ? 0 : permutations[0].size();
+		py::array_t<uint16_t> result({ static_cast<py::ssize_t>(count), static_cast<py::ssize_t>(patches) });
+		auto out = result.mutable_unchecked<2>();
+		for (size_t i = 0; i < count; i++)
+			for (size_t j = 0; j < patches; j++)
+				out(i, j) = static_cast<uint16_t>(permutations[i][j]);
+
+		return result;
+	}, py::arg("images"), py::arg("patch_size"), py::arg("measure") = "ae", py::arg("order") = "increasing",
+		py::arg("threads") = 0,
+		"Orders a NxHxWx3 uint8 batch on the thread pool with the GIL released, returns a NxP uint16 array.");
+
+	m.def("reconstruct", [](const ImageArray& image, const int patchSize, const py::array_t<uint16_t, py::array::c_style>& permutation)
+	{
+		const auto mat = AsMat(image);
+		const auto p = permutation.unchecked<1>();
+		por::Permutation indices(static_cast<size_t>(p.shape(0)));
+		for (py::ssize_t i = 0; i < p.shape(0); i++) indices[i] = p(i);
+
+		cv::Mat output;
+		{
+			py::gil_scoped_release release;
+			output = por::Apply(mat, cv::Size(patchSize, patchSize), indices);
+		}
+
+		return ToArray(output);
+	}, py::arg("image"), py::arg("patch_size"), py::arg("permutation"),
+		"Reconstructs the reordered image, patch i of the permutation is placed in grid cell i.");
+
+	m.def("sort_pixels", [](const ImageArray& image, const std::string& key, const std::string& order,
+		const int patchSize, const bool rows)
+	{
+		PixelSortKey k;
+		if (!PixelSort::ToKey(key, k)) throw py::value_error("Unknown pixel sort key '" + key + "'");
+		const auto o = ToOrder(order);
+
+		auto mat = AsMat(image).clone();
+		{
+			py::gil_scoped_release release;
+			if (rows) PixelSort::SortRows(mat, k, o);
+			else if (patchSize > 0) PixelSort::SortPatches(mat, cv::Size(patchSize, patchSize), k, o);
+			else PixelSort::SortRegion(mat, k, o);
+		}
+
+		return ToArray(mat);
+	}, py::arg("image"), py::arg("key") = "sum", py::arg("order") = "increasing", py::arg("patch_size") = 0,
+		py::arg("rows") = false,
+		"Sorts the pixels of every row (rows=True), every patch (patch_size > 0) or the whole image by key "
+		"(sum, luminance, hue, c0, c1, c2). Replaces reconstructor/pixelsort.py.");
+}
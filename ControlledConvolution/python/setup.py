@@ -0,0 +1,40 @@
+# Builds the pypor extension (Python bindings of libpor).
+#
+#   set OPENCV_DIR=C:\phd\3rdparty
+#   python setup.py build_ext --inplace
+#
+# OPENCV_DIR must contain include\ and lib\ of the OpenCV build used by the Visual Studio projects.
+
+import glob
+import os
+
+from pybind11.setup_helpers import Pybind11Extension, build_ext
+from setuptools import setup
+
+here = os.path.dirname(os.path.abspath(__file__))
+src_dir = os.path.join(here, "..", "ControlledConvolution")
+opencv_dir = os.environ.get("OPENCV_DIR", r"C:\phd\3rdparty")
+opencv_lib = os.environ.get("OPENCV_LIB", "opencv_world340")
+
+# every libpor source, the executable's entry point and its operator new replacement excluded
+sources = [os.path.join(here, "pypor.cpp")] + sorted(
+    f for f in glob.glob(os.path.join(src_dir, "*.cpp"))
+    if os.path.basename(f) not in ("ccMain.cpp", "ControlledConvolution[Conflict].cpp", "AllocationCounter.cpp"))
+
+ext = Pybind11Extension(
+    "pypor",
+    sources,
+    include_dirs=[src_dir, os.path.join(opencv_dir, "include")],
+    library_dirs=[os.path.join(opencv_dir, "lib")],
+    libraries=[opencv_lib],
+    define_macros=[("NDEBUG", None), ("_CONSOLE", None)],
+    cxx_std=17,
+)
+
+setup(
+    name="pypor",
+    version="1.1.0",
+    description="Patch proposal, ordering and reconstruction (libpor) bindings",
+    ext_modules=[ext],
+    cmdclass={"build_ext": build_ext},
+)
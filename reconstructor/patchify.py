@@ -13,15 +13,8 @@ order = '0'
 #ControlledConvolution.exe --iDir="E:\DATA\cifar\cifar100\cifar100\train" --oDir="E:\DATA\cifar\cifar100\preprocessed\train\airplane" 
 # --measure=ae --patch_height=16 --patch_width=16 --resize=32 --order=0
 
-categories = os.listdir(dataset)
-
-for cat in categories:
-    iDir = os.path.join(dataset,cat)
-    args = "--iDir= \"{}\" --oDir=\"{}\" --measure=ae --patch_height=16 --patch_width=16 --resize={} --order={}".format(iDir,oDir,resize,order)
-    print (args)
-    sdfsdfclear
-    subprocess.Popen(args,executable=os.path.join(exe_dir,exe))
-    # args = "--iDir= \"{}\" --oDir=\"{}\" --measure=ae --patch_height={} --patch_width={} --resize={} --order={}".format(iDir,oDir,patch_height[0],patch_height[0],resize,order)
-    # subprocess.Popen(args,executable=os.path.join(exe_dir,exe))
-    # args = "--iDir= \"{}\" --oDir=\"{}\" --measure=ae --patch_height={} --patch_width={} --resize={} --order={}".format(iDir,oDir,patch_height[2],patch_height[2],resize,order)
-    # subprocess.Popen(args,executable=os.path.join(exe_dir,exe))
\ No newline at end of file
+# a single process for all categories: --per_class schedules all of them on a shared pool and
+# writes oDir/<size>/<measure>/<order>/<category>
+args = "--iDir=\"{}\" --oDir=\"{}\" --measure=ae --patch_height=16 --patch_width=16 --resize={} --order={} --per_class --io_limit=2".format(dataset,oDir,resize,order)
+print (args)
+subprocess.call(args,executable=os.path.join(exe_dir,exe))